@@ -0,0 +1,115 @@
+#ifndef __APICOUNTERS_H_INCLUDED__
+#define __APICOUNTERS_H_INCLUDED__
+
+// Counts and times the Vulkan calls below when built with
+// -DVULKAN_API_COUNTERS; without it the markers expand to nothing and no
+// call is touched. include.h pulls this in last, so every call in the
+// project goes through the macros. Calls through function pointers, like
+// Device::cmdDrawIndexedIndirectCount, are not counted.
+
+#ifdef VULKAN_API_COUNTERS
+
+// The entry points have to be declared before the macros below
+#include "include.h"
+
+#include <chrono>
+
+enum class ApiCall {
+	QueueSubmit,
+	QueuePresent,
+	AcquireNextImage,
+	WaitForFences,
+	QueueWaitIdle,
+	DeviceWaitIdle,
+	AllocateMemory,
+	FreeMemory,
+	CreateBuffer,
+	CreateImage,
+	AllocateCommandBuffers,
+	AllocateDescriptorSets,
+	ResetDescriptorPool,
+	UpdateDescriptorSets,
+	BindPipeline,
+	BindDescriptorSets,
+	BindVertexBuffers,
+	BindIndexBuffer,
+	DrawIndexed,
+	DrawIndexedIndirect,
+	Dispatch,
+	Count
+};
+
+// Times one call until the end of the full expression the macros put it
+// in. Safe on any thread.
+struct ApiCallTimer {
+	explicit ApiCallTimer(ApiCall call);
+	~ApiCallTimer();
+
+  private:
+	ApiCall call;
+	std::chrono::steady_clock::time_point start;
+};
+
+// Everything counted while one lives, on any thread, belongs to a frame.
+// Idling the device or a queue from the thread that made it is flagged.
+struct ApiFrameScope {
+	ApiFrameScope();
+	~ApiFrameScope();
+};
+
+// Per frame averages and peaks, totals, and the anomalies seen
+void reportApiCounters();
+
+#define API_COUNTERS_FRAME() ApiFrameScope apiFrameScope
+#define API_COUNTERS_REPORT() reportApiCounters()
+
+#define API_COUNTED(call, function, ...)                                      \
+	(ApiCallTimer(ApiCall::call), function(__VA_ARGS__))
+
+#define vkQueueSubmit(...) API_COUNTED(QueueSubmit, vkQueueSubmit, __VA_ARGS__)
+#define vkQueuePresentKHR(...)                                                 \
+	API_COUNTED(QueuePresent, vkQueuePresentKHR, __VA_ARGS__)
+#define vkAcquireNextImageKHR(...)                                             \
+	API_COUNTED(AcquireNextImage, vkAcquireNextImageKHR, __VA_ARGS__)
+#define vkWaitForFences(...)                                                   \
+	API_COUNTED(WaitForFences, vkWaitForFences, __VA_ARGS__)
+#define vkQueueWaitIdle(...)                                                   \
+	API_COUNTED(QueueWaitIdle, vkQueueWaitIdle, __VA_ARGS__)
+#define vkDeviceWaitIdle(...)                                                  \
+	API_COUNTED(DeviceWaitIdle, vkDeviceWaitIdle, __VA_ARGS__)
+#define vkAllocateMemory(...)                                                  \
+	API_COUNTED(AllocateMemory, vkAllocateMemory, __VA_ARGS__)
+#define vkFreeMemory(...) API_COUNTED(FreeMemory, vkFreeMemory, __VA_ARGS__)
+#define vkCreateBuffer(...)                                                    \
+	API_COUNTED(CreateBuffer, vkCreateBuffer, __VA_ARGS__)
+#define vkCreateImage(...) API_COUNTED(CreateImage, vkCreateImage, __VA_ARGS__)
+#define vkAllocateCommandBuffers(...)                                          \
+	API_COUNTED(AllocateCommandBuffers, vkAllocateCommandBuffers, __VA_ARGS__)
+#define vkAllocateDescriptorSets(...)                                          \
+	API_COUNTED(AllocateDescriptorSets, vkAllocateDescriptorSets, __VA_ARGS__)
+#define vkResetDescriptorPool(...)                                             \
+	API_COUNTED(ResetDescriptorPool, vkResetDescriptorPool, __VA_ARGS__)
+#define vkUpdateDescriptorSets(...)                                            \
+	API_COUNTED(UpdateDescriptorSets, vkUpdateDescriptorSets, __VA_ARGS__)
+#define vkCmdBindPipeline(...)                                                 \
+	API_COUNTED(BindPipeline, vkCmdBindPipeline, __VA_ARGS__)
+#define vkCmdBindDescriptorSets(...)                                           \
+	API_COUNTED(BindDescriptorSets, vkCmdBindDescriptorSets, __VA_ARGS__)
+#define vkCmdBindVertexBuffers(...)                                            \
+	API_COUNTED(BindVertexBuffers, vkCmdBindVertexBuffers, __VA_ARGS__)
+#define vkCmdBindIndexBuffer(...)                                              \
+	API_COUNTED(BindIndexBuffer, vkCmdBindIndexBuffer, __VA_ARGS__)
+#define vkCmdDrawIndexed(...)                                                  \
+	API_COUNTED(DrawIndexed, vkCmdDrawIndexed, __VA_ARGS__)
+#define vkCmdDrawIndexedIndirect(...)                                          \
+	API_COUNTED(DrawIndexedIndirect, vkCmdDrawIndexedIndirect, __VA_ARGS__)
+#define vkCmdDispatch(...) API_COUNTED(Dispatch, vkCmdDispatch, __VA_ARGS__)
+
+#else
+
+#define API_COUNTERS_FRAME()
+#define API_COUNTERS_REPORT()
+
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef __BATCH_H_INCLUDED__
+#define __BATCH_H_INCLUDED__
+
+#include "descriptorallocator.h"
+#include "readback.h"
+#include "util.h"
+
+#include <deque>
+
+struct Model;
+
+// Offscreen targets rendered into at once, unless the manifest says
+constexpr uint32_t BATCH_CONTEXTS = 4;
+// Jobs loading ahead of the contexts, per context
+constexpr uint32_t BATCH_PREFETCH = 2;
+constexpr uint32_t BATCH_IMAGE_SIZE = 512;
+
+// One asset to render. Without an eye the camera frames the model's
+// bounding sphere.
+struct BatchJob {
+	std::string model;
+	std::string texture;
+	std::string output;
+	std::optional<glm::vec3> eye;
+	glm::vec3 target;
+	glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
+	float fov = 45.0f;
+};
+
+// {"width": 512, "height": 512, "contexts": 4, "jobs": [{"model": ...,
+// "texture": ..., "output": "out.png", "eye": [x, y, z], "target": [...],
+// "up": [...], "fov": 45}]}. Everything but a job's model and output is
+// optional.
+struct BatchManifest {
+	uint32_t width = BATCH_IMAGE_SIZE;
+	uint32_t height = BATCH_IMAGE_SIZE;
+	uint32_t contexts = BATCH_CONTEXTS;
+	std::vector<BatchJob> jobs;
+};
+
+BatchManifest readBatchManifest(const std::string& path);
+
+// Renders manifest jobs to image files without a swap chain. While one
+// job's assets load on the thread pool, others are drawn and read back in
+// contexts of their own, each with its own fence, and earlier ones are
+// encoded, so loading, rendering, readback and encoding overlap across jobs.
+// Needs Instance::createCore() only.
+struct BatchRenderer {
+	void create(Instance* instance, const BatchManifest& manifest);
+	// Returns the number of jobs that failed
+	size_t run(Instance* instance);
+	void destroy(Instance* instance);
+
+  private:
+	struct Job {
+		size_t index;
+		Model* model;
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+		// Jobs whose texture failed to load are drawn with the placeholder
+		bool textured = false;
+		bool submitted = false;
+	};
+
+	struct Context {
+		VkImage colourImage;
+		VkDeviceMemory colourImageMemory;
+		VkImageView colourImageView;
+		VkImage depthImage;
+		VkDeviceMemory depthImageMemory;
+		VkImageView depthImageView;
+		VkImage resolveImage;
+		VkDeviceMemory resolveImageMemory;
+		VkImageView resolveImageView;
+		VkFramebuffer framebuffer;
+		VkCommandBuffer commandBuffer;
+		VkFence fence;
+		VkBuffer uniformBuffer;
+		VkDeviceMemory uniformBufferMemory;
+		void* uniformMapped;
+		std::optional<Job> job;
+	};
+
+	BatchManifest manifest;
+	VkFormat depthFormat;
+	VkRenderPass renderPass;
+	VkPipelineLayout pipelineLayout;
+	// Keyed by vertex layout
+	std::unordered_map<std::string, VkPipeline> pipelines;
+	// One frame per context
+	DescriptorAllocator descriptors;
+	std::vector<Context> contexts;
+	// Fences are named by context index
+	ReadbackRing readback;
+	// Loading, in manifest order
+	std::deque<Job> pending;
+	size_t nextJob = 0;
+	size_t finished = 0;
+	size_t failed = 0;
+
+	void createContext(Instance* instance, Context& context);
+	void destroyContext(Device* device, Context& context);
+	VkPipeline getPipeline(Instance* instance, const Model& model);
+
+	void load(Instance* instance);
+	// Starts the first loaded job on context, if any has loaded
+	bool start(Instance* instance, uint32_t contextIndex);
+	void record(Instance* instance, uint32_t contextIndex);
+	// Hands the image to the encoders once the context's fence has signalled
+	void finish(Instance* instance, uint32_t contextIndex);
+	void release(Device* device, Job& job);
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __BCENCODE_H_INCLUDED__
+#define __BCENCODE_H_INCLUDED__
+
+#include "include.h"
+
+// Bytes per 4x4 block
+constexpr size_t BC1_BLOCK_SIZE = 8;
+constexpr size_t BC7_BLOCK_SIZE = 16;
+// Below this many blocks an image is encoded on the calling thread
+constexpr size_t BC_PARALLEL_THRESHOLD = 4096;
+
+size_t getBlockCompressedSize(uint32_t width, uint32_t height,
+                              size_t blockSize);
+
+// Both encoders read RGBA8 rows and write blocks row by row. Partial blocks
+// at the right and bottom edges repeat the last column and row.
+void encodeBC1(const uint8_t* pixels, uint32_t width, uint32_t height,
+               uint8_t* blocks);
+// Uses mode 6 only: one RGBA line per block with 4-bit indices
+void encodeBC7(const uint8_t* pixels, uint32_t width, uint32_t height,
+               uint8_t* blocks);
+
+#endif
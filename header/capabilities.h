@@ -0,0 +1,46 @@
+#ifndef __CAPABILITIES_H_INCLUDED__
+#define __CAPABILITIES_H_INCLUDED__
+
+#include "util.h"
+
+// Environment variable naming the device to use, by index or by part of its
+// name. The --device option takes precedence.
+constexpr const char* DEVICE_OVERRIDE_VARIABLE = "VULKAN_DEVICE";
+
+// Everything device selection and the renderer's fast paths look at, queried
+// once per physical device
+struct DeviceCapabilities {
+	VkPhysicalDevice physical = VK_NULL_HANDLE;
+	uint32_t index;
+	VkPhysicalDeviceProperties properties;
+	VkPhysicalDeviceFeatures features;
+	VkPhysicalDeviceMemoryProperties memory;
+	QueueFamilyIndices queueFamilies;
+	std::set<std::string> extensions;
+	// Surface capabilities follow the window size, so they're queried when
+	// the swap chain is created instead
+	std::vector<VkSurfaceFormatKHR> surfaceFormats;
+	std::vector<VkPresentModeKHR> presentModes;
+
+	// Optional features, each backed by an extension and any feature bits
+	// it needs
+	bool timelineSemaphore = false;
+	bool descriptorIndexing = false;
+	bool drawIndirectCount = false;
+	bool memoryBudget = false;
+
+	void query(Instance* instance, VkPhysicalDevice device, uint32_t index);
+
+	bool hasExtension(const char* name) const;
+	bool isSuitable() const;
+	bool matches(const std::string& selector) const;
+	VkDeviceSize getDeviceLocalSize() const;
+	// Device type dominates, then device-local memory, then limits and
+	// optional features
+	uint64_t getScore() const;
+
+  private:
+	void queryExtendedFeatures(Instance* instance);
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef __COMMANDER_H_INCLUDED__
 #define __COMMANDER_H_INCLUDED__
 
+#include "culling.h"
 #include "util.h"
 
 struct Device;
@@ -8,28 +9,43 @@ struct Device;
 struct Commander {
 	VkCommandPool pool;
 	std::vector<VkCommandBuffer> buffers;
+	std::vector<DrawRange> draws;
 
 	void createPool(Instance* instance);
 	void createBuffers(Instance* instance);
+	void recordBuffer(Instance* instance, uint32_t imageIndex);
 
 	void destroyPool(Device* device);
 	void destroyBuffers(Device* device);
 
+	// Submits and waits for a one-off command buffer of its own
 	void transitionImageLayout(Device* device, VkImage image, VkFormat format,
 	                           VkImageLayout oldLayout, VkImageLayout newLayout,
 	                           uint32_t mipLevels);
-    void pushConstants(Instance* instance);
+	void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image,
+	                           VkFormat format, VkImageLayout oldLayout,
+	                           VkImageLayout newLayout, uint32_t mipLevels);
+    void pushConstants(Instance* instance, VkCommandBuffer commandBuffer);
 	void copyBuffer(Device* device, VkBuffer srcBuffer, VkBuffer dstBuffer,
 	                VkDeviceSize size);
-	void copyBufferToImage(Device* device, VkBuffer buffer, VkImage image,
-	                       uint32_t width, uint32_t height);
-	void generateMipmaps(Device* device, VkImage image, VkFormat imageFormat,
-	                     int32_t texWidth, int32_t texHeight,
-	                     uint32_t mipLevels);
+	// One region per mip level, all in TRANSFER_DST_OPTIMAL
+	void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer,
+	                       VkImage image,
+	                       const std::vector<VkBufferImageCopy>& regions);
 
-  private:
+	// Submission waits for the queue to go idle
 	VkCommandBuffer beginSingleTimeCommands(Device* device);
 	void endSingleTimeCommands(Device* device, VkCommandBuffer commandBuffer);
+
+  private:
+	// Both bracket the pass with a statistics query when those are enabled
+	void beginRenderPass(Instance* instance, VkCommandBuffer buffer,
+	                     VkRenderPass renderPass, VkFramebuffer framebuffer);
+	void endRenderPass(Instance* instance, VkCommandBuffer buffer);
+	void bindGeometry(Instance* instance, VkCommandBuffer buffer);
+	// Copies the swap chain image out for Instance::captureDirectory
+	void captureFrame(Instance* instance, VkCommandBuffer buffer,
+	                  uint32_t imageIndex);
 };
 
 #endif
@@ -0,0 +1,26 @@
+#ifndef __CULLING_H_INCLUDED__
+#define __CULLING_H_INCLUDED__
+
+#include "meshlet.h"
+
+struct Frustum {
+	glm::vec4 planes[6];
+};
+
+struct DrawRange {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+Frustum extractFrustum(const glm::mat4& mvp);
+
+bool sphereInFrustum(const Frustum& frustum, glm::vec3 center, float radius);
+
+bool coneBackfacing(const Meshlet& meshlet, glm::vec3 cameraPos);
+
+uint32_t cullMeshlets(const std::vector<Meshlet>& meshlets,
+                      uint32_t firstMeshlet, uint32_t meshletCount,
+                      const Frustum& frustum, glm::vec3 cameraPos,
+                      std::vector<DrawRange>& draws);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __DEDUP_H_INCLUDED__
+#define __DEDUP_H_INCLUDED__
+
+#include "util.h"
+
+// Below this many corners a single table beats splitting the work
+constexpr size_t DEDUP_PARALLEL_THRESHOLD = 1 << 18;
+
+// Merges corners with identical bit patterns into vertices and writes one
+// index per corner. The vertex set matches a single hash map's, but the
+// order doesn't: vertices appear in first-use order within each shard, and
+// shards follow one another.
+void deduplicateVertices(const std::vector<Vertex>& corners,
+                         std::vector<Vertex>& vertices,
+                         std::vector<uint32_t>& indices);
+
+#endif
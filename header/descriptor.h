@@ -3,13 +3,21 @@
 
 #include "util.h"
 
-struct Vertex;
+struct StagingBuffer;
+struct Texture;
 
+// Push constants, the same for every draw in a frame
 struct UniformBufferObject {
-	// alignas(16) glm::mat4 model;
-	// alignas(16) glm::mat4 view;
-	// alignas(16) glm::mat4 proj;
-    alignas(16) glm::mat4 mvp;
+	alignas(16) glm::mat4 viewProj;
+};
+
+// Per-draw data too big for push constants, read through the dynamic
+// uniform buffer at binding 0
+struct ObjectUniforms {
+	// Includes the vertex position decode
+	alignas(16) glm::mat4 model;
+	// Inverse transpose of the model view matrix, without the decode
+	alignas(16) glm::mat4 normal;
 };
 
 struct Descriptor {
@@ -18,29 +26,35 @@ struct Descriptor {
 	VkBuffer indexBuffer;
 	VkDeviceMemory indexBufferMemory;
 	uint32_t nIndices;
+	VkIndexType indexType;
 
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
 	VkDescriptorSetLayout descriptorSetLayout;
-	VkDescriptorPool descriptorPool;
-	std::vector<VkDescriptorSet> descriptorSets;
+	// Allocated afresh every frame, so texture can change at any time
+	VkDescriptorSet frameSet;
+	// The placeholder until the model's texture is resident
+	Texture* texture;
 
     UniformBufferObject ubo;
+	ObjectUniforms object;
+	glm::mat4 model;
+	glm::mat4 view;
+	glm::mat4 proj;
+	// proj * view * model, without the vertex position decode in
+	// object.model
+	glm::mat4 mvp;
 
 	void createDescriptorSetLayout(Instance* instance);
-	void createVertexBuffer(Instance* instance, std::vector<Vertex> vertices);
-	void createIndexBuffer(Instance* instance, std::vector<uint32_t> indices);
-	void createUniformBuffers(Instance* instance);
-	void createDescriptorPool(Instance* instance);
-	void createDescriptorSets(Instance* instance);
+	void createVertexBuffer(Instance* instance, const StagingBuffer& staging);
+	void createIndexBuffer(Instance* instance, const StagingBuffer& staging,
+	                       uint32_t indexCount, VkIndexType type);
+	// Points frameSet at the uniform ring and texture
+	void allocateFrameSet(Instance* instance);
 
 	void destroyDescriptorSetLayout(Device* device);
 	void destroyVertexBuffer(Device* device);
 	void destroyIndexBuffer(Device* device);
-	void destroyUniformBuffers(Instance* instance);
-	void destroyDescriptorPool(Device* device);
 
-	void updateUniformBuffer(Instance* instance, uint32_t currentImage);
+	void updateUniformBuffer(Instance* instance);
 };
 
 #endif
\ No newline at end of file
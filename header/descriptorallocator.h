@@ -0,0 +1,70 @@
+#ifndef __DESCRIPTORALLOCATOR_H_INCLUDED__
+#define __DESCRIPTORALLOCATOR_H_INCLUDED__
+
+#include "util.h"
+
+// Sets each pool has room for. Descriptors of each type are reserved in
+// proportion, see POOL_RATIOS in descriptorallocator.cpp.
+constexpr uint32_t DESCRIPTOR_POOL_SETS = 64;
+
+// What a single-descriptor binding of a set points at. Only the info
+// matching type is used.
+struct DescriptorBinding {
+	uint32_t binding;
+	VkDescriptorType type;
+	VkDescriptorBufferInfo buffer;
+	VkDescriptorImageInfo image;
+};
+
+DescriptorBinding bufferBinding(uint32_t binding, VkDescriptorType type,
+                                VkBuffer buffer, VkDeviceSize offset,
+                                VkDeviceSize range);
+DescriptorBinding imageBinding(uint32_t binding, VkDescriptorType type,
+                               VkSampler sampler, VkImageView view,
+                               VkImageLayout layout);
+
+// Hands out descriptor sets from lists of pools that grow by a pool
+// whenever the current one runs out. Main thread only.
+struct DescriptorAllocator {
+	void create(Device* device, uint32_t frameCount);
+	// Long-lived sets, written once. Asking again for the same layout and
+	// bindings returns the cached set without calling the driver.
+	VkDescriptorSet getSet(VkDescriptorSetLayout layout,
+	                       const std::vector<DescriptorBinding>& bindings);
+	// Drops every cached set; none of them may be in use. Needed once
+	// anything they point at is destroyed.
+	void clearCache();
+	// Sets that are only valid until frame comes round again
+	VkDescriptorSet allocateFrameSet(
+	    uint32_t frame, VkDescriptorSetLayout layout,
+	    const std::vector<DescriptorBinding>& bindings);
+	// Frees all of frame's sets at once, after its fence has signalled
+	void resetFrame(uint32_t frame);
+	void destroy();
+
+  private:
+	struct PoolList {
+		std::vector<VkDescriptorPool> pools;
+		// Pools before this one are full
+		size_t current = 0;
+	};
+
+	struct CachedSet {
+		VkDescriptorSetLayout layout;
+		std::vector<DescriptorBinding> bindings;
+		VkDescriptorSet set;
+	};
+
+	Device* device;
+	PoolList cachedPools;
+	std::vector<PoolList> framePools;
+	std::unordered_map<size_t, std::vector<CachedSet>> cache;
+
+	VkDescriptorSet allocate(PoolList& list, VkDescriptorSetLayout layout);
+	void write(VkDescriptorSet set,
+	           const std::vector<DescriptorBinding>& bindings);
+	void reset(PoolList& list);
+	void destroy(PoolList& list);
+};
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef __DEVICE_H_INCLUDED__
 #define __DEVICE_H_INCLUDED__
 
+#include "capabilities.h"
+#include "sampler.h"
 #include "util.h"
 
 struct Device {
@@ -8,14 +10,24 @@ struct Device {
 	VkPhysicalDevice physical = VK_NULL_HANDLE;
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+	VkPhysicalDeviceFeatures enabledFeatures;
+	// Of the picked device. Once the logical device exists its optional
+	// features are only left set if they were enabled.
+	DeviceCapabilities capabilities;
+	SamplerCache samplers;
+	PFN_vkCmdDrawIndexedIndirectCount cmdDrawIndexedIndirectCount = nullptr;
 
 	void pickPhysicalDevice(Instance* instance);
 	void createLogicalDevice(Instance* instance, bool enableValidationLayers);
 
 	void destroyLogicalDevice();
 
+	// Device-local memory the driver expects this process can still
+	// allocate. Needs the memory budget feature.
+	VkDeviceSize getAvailableMemory();
+
   private:
-	bool isDeviceSuitable(Instance* instance, VkPhysicalDevice device);
+	PFN_vkGetPhysicalDeviceMemoryProperties2 getMemoryProperties2 = nullptr;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef __GLTF_H_INCLUDED__
+#define __GLTF_H_INCLUDED__
+
+#include "util.h"
+
+struct Texture;
+
+// True for .gltf and .glb paths
+bool isGltfPath(const std::string& path);
+
+// Appends every triangle primitive reachable from the default scene, with
+// node transforms applied and converted from glTF's Y-up to Z-up. hasNormals
+// is false if any primitive lacks normals.
+void loadGltf(const std::string& path, std::vector<Vertex>& vertices,
+              std::vector<uint32_t>& indices, bool& hasNormals);
+
+// Decodes the first base colour texture a material references. Returns false
+// when the file references none.
+bool loadGltfTexture(const std::string& path, Texture& texture);
+
+#endif
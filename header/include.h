@@ -19,6 +19,7 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <optional>
 #include <set>
 #include <stdexcept>
@@ -26,4 +27,6 @@
 #include <unordered_map>
 #include <vector>
 
+#include "apicounters.h"
+
 #endif
\ No newline at end of file
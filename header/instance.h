@@ -7,12 +7,32 @@ struct Device;
 struct Surface;
 struct Renderer;
 struct Descriptor;
+struct DescriptorAllocator;
 struct Commander;
 struct Sync;
+struct Occlusion;
+struct OverdrawView;
 struct Model;
+struct Texture;
+struct ThreadPool;
+struct StagingPool;
+struct TextureStreamer;
+struct UniformRing;
+struct ReadbackRing;
+struct PipelineStatistics;
 
 struct Instance {
 	bool validationLayersEnabled;
+	// Lets device capabilities be queried through feature and property
+	// chains
+	bool physicalDeviceProperties2 = false;
+	// Overrides device selection, see DEVICE_OVERRIDE_VARIABLE
+	std::string deviceSelector;
+	// Writes every frame presented to this directory when set
+	std::string captureDirectory;
+	// Raw RGBA rows instead of PNG files, cheap enough to keep up with the
+	// frame rate and ready to pipe into a video encoder
+	bool captureRaw = false;
 	uint32_t currentFrame;
 	bool framebufferResized;
 	VkInstance instance;
@@ -21,14 +41,28 @@ struct Instance {
 	Surface* surface;
 	Renderer* renderer;
 	Descriptor* descriptor;
+	DescriptorAllocator* descriptorAllocator;
 	Commander* commander;
 	Sync* sync;
+	Occlusion* occlusion;
+	OverdrawView* overdraw;
+	ThreadPool* threadPool;
+	StagingPool* stagingPool;
+	TextureStreamer* streamer;
+	UniformRing* uniformRing;
+	ReadbackRing* readback;
+	PipelineStatistics* statistics;
+	Texture* placeholder;
 	std::vector<Model> models;
 
 	Instance();
 
 	void create(bool enableValidationLayers);
 	void destroy();
+	// Window, device and the pools, without a swap chain or models. create()
+	// starts with this; batch rendering uses it alone.
+	void createCore(bool enableValidationLayers);
+	void destroyCore();
 	bool shouldClose();
 	void waitIdle();
 
@@ -43,6 +77,9 @@ struct Instance {
 
 	void cleanupSwapChain();
 	void recreateSwapChain();
+
+	// Uploads whatever finished loading since the last frame
+	void updateResidency();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef __JSON_H_INCLUDED__
+#define __JSON_H_INCLUDED__
+
+#include "include.h"
+
+// Minimal read-only JSON document. Missing keys and out of range indices
+// return a shared null value so lookups can be chained.
+struct JsonValue {
+	enum class Type { Null, Bool, Number, String, Array, Object };
+
+	Type type = Type::Null;
+	bool boolean = false;
+	double number = 0.0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::vector<std::pair<std::string, JsonValue>> object;
+
+	bool isNull() const { return type == Type::Null; }
+	size_t size() const;
+	const JsonValue& operator[](size_t index) const;
+	const JsonValue& operator[](const std::string& key) const;
+
+	double asNumber(double fallback = 0.0) const;
+	int64_t asInt(int64_t fallback = -1) const;
+	bool asBool(bool fallback = false) const;
+	const std::string& asString() const;
+};
+
+// Throws std::runtime_error on malformed input
+JsonValue parseJson(const char* text, size_t size);
+
+#endif
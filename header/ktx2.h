@@ -0,0 +1,34 @@
+#ifndef __KTX2_H_INCLUDED__
+#define __KTX2_H_INCLUDED__
+
+#include "util.h"
+
+struct Texture;
+
+typedef std::vector<std::pair<std::string, std::string>> Ktx2KeyValues;
+
+// True for .ktx2 paths
+bool isKtx2Path(const std::string& path);
+
+// Reads every mip level of a 2D KTX2 texture into texture. Supports RGBA8,
+// BC1, BC3 and BC7 without supercompression. keyValues, when not null,
+// receives the file's key/value data.
+void readKtx2(const std::string& path, Texture& texture,
+              Ktx2KeyValues* keyValues);
+
+void writeKtx2(const std::string& path, const Texture& texture,
+               const Ktx2KeyValues& keyValues);
+
+// Where a level's data sits in a KTX2 file
+struct Ktx2LevelRange {
+	size_t offset;
+	size_t size;
+};
+
+// Maps path and finds each of its levels, provided it still holds
+// texture's whole mip chain in texture's format and size. Leaves file
+// unmapped and returns false otherwise.
+bool mapKtx2Levels(const std::string& path, const Texture& texture,
+                   MappedFile& file, std::vector<Ktx2LevelRange>& levels);
+
+#endif
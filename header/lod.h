@@ -0,0 +1,36 @@
+#ifndef __LOD_H_INCLUDED__
+#define __LOD_H_INCLUDED__
+
+#include "util.h"
+
+constexpr uint32_t MAX_LOD_LEVELS = 5;
+// Each level aims for this fraction of the previous level's triangles
+constexpr float LOD_REDUCTION = 0.5f;
+// Give up on further levels once the error exceeds this fraction of the
+// bounding radius
+constexpr float LOD_MAX_ERROR = 0.05f;
+// A level is acceptable while its error projects to at most this many pixels
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+// Relative band around LOD_PIXEL_ERROR that stops levels flickering
+constexpr float LOD_HYSTERESIS = 0.25f;
+
+struct LodLevel {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// Simplification error relative to the bounding sphere radius
+	float error;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+void buildLods(const std::vector<Vertex>& vertices,
+               std::vector<uint32_t>& indices, std::vector<LodLevel>& lods,
+               float radius);
+
+float projectedRadius(const glm::mat4& modelView, float projScale,
+                      float viewportHeight, glm::vec3 center, float radius);
+
+uint32_t selectLod(const std::vector<LodLevel>& lods, uint32_t currentLod,
+                   float screenRadius);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef __MESHCACHE_H_INCLUDED__
+#define __MESHCACHE_H_INCLUDED__
+
+#include "util.h"
+#include "vertexlayout.h"
+
+struct Model;
+
+constexpr uint32_t MESH_CACHE_MAGIC = 0x4843534d;
+// Bump whenever loading or mesh processing changes its output
+constexpr uint32_t MESH_CACHE_VERSION = 4;
+// Store the vertex and index sections through the mesh codec
+constexpr bool MESH_CACHE_COMPRESSION = true;
+
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	SourceStamp source;
+	// Layout the model asked for, and whether it ended up with normals
+	uint32_t positionFormat;
+	uint32_t texCoordFormat;
+	uint32_t requestedNormals;
+	uint32_t colour;
+	uint32_t normals;
+	uint32_t vertexCount;
+	uint32_t vertexStride;
+	uint32_t indexCount;
+	uint32_t lodCount;
+	uint32_t meshletCount;
+	uint32_t compressed;
+	float boundsMin[3];
+	float boundsMax[3];
+	float center[3];
+	float radius;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t lodOffset;
+	uint64_t meshletOffset;
+	// Encoded section sizes when compressed
+	uint64_t vertexBytes;
+	uint64_t indexBytes;
+};
+
+std::string getMeshCachePath(const std::string& sourcePath);
+
+// Fills the model from the cache next to sourcePath when it was built from
+// the same source with the same layout. Vertices and indices are decoded
+// straight into the model's staging buffers.
+bool readMeshCache(const std::string& sourcePath, Model& model);
+
+// Reads the vertices back from the model's staging buffer
+void writeMeshCache(const std::string& sourcePath, const Model& model,
+                    const VertexLayout& requested);
+
+#endif
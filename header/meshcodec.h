@@ -0,0 +1,30 @@
+#ifndef __MESHCODEC_H_INCLUDED__
+#define __MESHCODEC_H_INCLUDED__
+
+#include "include.h"
+
+// Vertices are decoded in blocks of this many so a block's byte planes stay
+// in L1 on their way into vertices
+constexpr size_t MESH_CODEC_BLOCK_SIZE = 256;
+// And coded in chunks of this many, which decode independently, so a buffer
+// decodes across the thread pool when decoded on one of its workers
+constexpr size_t MESH_CODEC_CHUNK_SIZE = 1 << 14;
+
+// Vertex bytes are split into one plane per byte of the stride, delta coded
+// against the previous vertex and rANS coded with a frequency table per
+// plane. Planes that rANS can't shrink are stored raw, and planes of one
+// repeated byte as that byte.
+void encodeVertexBuffer(const uint8_t* vertices, size_t vertexCount,
+                        size_t stride, std::vector<uint8_t>& out);
+// Returns false if data is truncated or malformed
+bool decodeVertexBuffer(const uint8_t* data, size_t size, size_t vertexCount,
+                        size_t stride, uint8_t* vertices);
+
+// Indices are zigzag coded as deltas from the previous index, then packed
+// like a vertex buffer of 4-byte elements.
+void encodeIndexBuffer(const uint32_t* indices, size_t indexCount,
+                       std::vector<uint8_t>& out);
+bool decodeIndexBuffer(const uint8_t* data, size_t size, size_t indexCount,
+                       uint32_t* indices);
+
+#endif
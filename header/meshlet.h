@@ -0,0 +1,24 @@
+#ifndef __MESHLET_H_INCLUDED__
+#define __MESHLET_H_INCLUDED__
+
+#include "util.h"
+
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet {
+	glm::vec3 center;
+	float radius;
+	// Every triangle faces away from cameras inside this cone
+	glm::vec3 coneApex;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+void buildMeshlets(const std::vector<Vertex>& vertices,
+                   std::vector<uint32_t>& indices, uint32_t firstIndex,
+                   uint32_t indexCount, std::vector<Meshlet>& meshlets);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __MIPGEN_H_INCLUDED__
+#define __MIPGEN_H_INCLUDED__
+
+#include "include.h"
+
+// Below this many output texels a level is filtered on the calling thread
+constexpr size_t MIP_PARALLEL_THRESHOLD = 1 << 16;
+
+// Box filters an RGBA8 level down to the next one, rounding odd sizes down.
+// With srgb set, colour is averaged in linear space; alpha always is.
+void downsampleRGBA8(const uint8_t* source, uint32_t width, uint32_t height,
+                     bool srgb, uint8_t* dest);
+
+// Offsets of each level of an RGBA8 chain stored back to back from level 0.
+// Returns the size of the whole chain.
+size_t getMipChainLayout(uint32_t width, uint32_t height, uint32_t levelCount,
+                         std::vector<size_t>& levelOffsets);
+
+// Fills every level after the first from the one before it
+void generateMipChain(uint8_t* pixels, uint32_t width, uint32_t height,
+                      const std::vector<size_t>& levelOffsets, bool srgb);
+
+#endif
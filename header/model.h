@@ -1,20 +1,68 @@
 #ifndef __MODEL_H_INCLUDED__
 #define __MODEL_H_INCLUDED__
 
+#include "lod.h"
+#include "meshlet.h"
+#include "staging.h"
 #include "texture.h"
+#include "threadpool.h"
+#include "util.h"
+#include "vertexlayout.h"
 
 struct Vertex;
 
 struct Model {
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
+	std::vector<LodLevel> lods;
+	std::vector<Meshlet> meshlets;
+	VertexLayout layout;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	// Vertices in the layout's GPU format and indices in indexType, written
+	// there by the loaders and copied to the device once the load finishes
+	StagingBuffer vertexStaging;
+	StagingBuffer indexStaging;
+	VkIndexType indexType;
+	glm::mat4 positionDecode;
+	uint32_t currentLod;
+	// Projected bounding radius in pixels as of the last selectLod()
+	float screenRadius;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec3 center;
+	float radius;
 	Texture* texture;
+	// CPU loading runs on the thread pool; Instance::updateResidency uploads
+	// each part once its future is ready
+	std::future<void> meshLoad;
+	std::future<void> textureLoad;
+	bool meshResident;
+	bool textureResident;
 
 	Model();
+	// Returns immediately. The model must not move until both loads finish.
 	void create(Instance* instance, std::string modelPath, std::string texPath);
 
+	// Maps staging spans of the final size, for vertexCount vertices in the
+	// current layout and indexCount indices
+	void allocateStaging(uint32_t vertexCount, uint32_t indexCount);
+	// Narrows to 16 bits when indexType asks for it
+	void writeIndices(const uint32_t* source);
+	// Leaves the texture's staging alone, as it may still be loading
+	void releaseMeshStaging();
+	void releaseStaging();
+
+	const LodLevel& selectLod(const glm::mat4& modelView, float projScale,
+	                          float viewportHeight);
+
   private:
+	Device* device;
+
+	void loadMesh(std::string modelPath);
 	void load(std::string modelPath);
+	void process();
+	void computeBounds();
 };
 
-#endif
\ No newline at end of file
+#endif
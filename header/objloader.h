@@ -0,0 +1,25 @@
+#ifndef __OBJLOADER_H_INCLUDED__
+#define __OBJLOADER_H_INCLUDED__
+
+#include "util.h"
+
+// Zero based attribute indices of a face corner, -1 when absent
+struct ObjCorner {
+	int32_t position;
+	int32_t texCoord;
+	int32_t normal;
+};
+
+struct ObjData {
+	std::vector<float> positions;
+	std::vector<float> texCoords;
+	std::vector<float> normals;
+	// Three corners per triangle, in file order
+	std::vector<ObjCorner> corners;
+};
+
+// Memory maps an OBJ file and parses line aligned chunks of it in parallel.
+// Polygons are triangulated as fans.
+void parseObj(const std::string& path, ObjData& data);
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef __OCCLUSION_H_INCLUDED__
+#define __OCCLUSION_H_INCLUDED__
+
+#include "culling.h"
+#include "lod.h"
+#include "util.h"
+
+struct Model;
+
+struct CullData {
+	alignas(16) glm::mat4 mvp;
+	alignas(16) glm::mat4 previousMvp;
+	alignas(16) glm::vec4 frustum[6];
+	alignas(16) glm::vec4 cameraPos;
+	alignas(8) glm::vec2 pyramidSize;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+	uint32_t pyramidValid;
+};
+
+struct GpuMeshlet {
+	glm::vec4 centerRadius;
+	glm::vec4 coneApexCutoff;
+	glm::vec4 coneAxis;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t padding[2];
+};
+
+// Two-phase Hi-Z occlusion culling: meshlets are first tested against the
+// depth pyramid built last frame, drawn, then the pyramid is rebuilt from
+// that depth and the rejected meshlets are tested again.
+struct Occlusion {
+	bool enabled = false;
+	// With draw indirect count the cull pass packs visible meshlets together
+	// and counts them, instead of zeroing the instance count of the rest
+	bool compactDraws = false;
+	bool pyramidValid;
+	glm::mat4 previousMvp;
+
+	VkImage pyramidImage;
+	VkDeviceMemory pyramidImageMemory;
+	VkImageView pyramidImageView;
+	std::vector<VkImageView> pyramidLevelViews;
+	uint32_t pyramidLevels;
+	uint32_t pyramidWidth;
+	uint32_t pyramidHeight;
+	VkSampler sampler;
+
+	uint32_t maxMeshlets;
+	VkBuffer meshletBuffer;
+	VkDeviceMemory meshletBufferMemory;
+	VkBuffer drawBuffer;
+	VkDeviceMemory drawBufferMemory;
+	VkBuffer visibilityBuffer;
+	VkDeviceMemory visibilityBufferMemory;
+	// One draw count per pass
+	VkBuffer countBuffer;
+	VkDeviceMemory countBufferMemory;
+	std::vector<VkBuffer> cullBuffers;
+	std::vector<VkDeviceMemory> cullBuffersMemory;
+	std::vector<void*> cullBuffersMapped;
+
+	VkDescriptorSetLayout reduceSetLayout;
+	VkDescriptorSetLayout cullSetLayout;
+	VkPipelineLayout reducePipelineLayout;
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline depthCopyPipeline;
+	VkPipeline depthReducePipeline;
+	VkPipeline cullPipeline;
+	// From the instance's descriptor cache, which drops them along with
+	// the swap chain
+	std::vector<VkDescriptorSet> reduceSets;
+	std::vector<VkDescriptorSet> cullSets;
+
+	void checkSupport(Instance* instance);
+	void createBuffers(Instance* instance, const Model& model);
+	void createResources(Instance* instance);
+
+	void destroyBuffers(Device* device);
+	void destroyResources(Device* device);
+
+	void updateCullData(Instance* instance, uint32_t imageIndex,
+	                    const LodLevel& lod, const Frustum& frustum,
+	                    glm::vec3 cameraPos);
+	void cull(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+	          uint32_t pass, const LodLevel& lod);
+	void buildPyramid(Instance* instance, VkCommandBuffer commandBuffer);
+	VkDeviceSize getDrawOffset(uint32_t pass) const;
+	VkDeviceSize getCountOffset(uint32_t pass) const;
+
+  private:
+	void createPyramid(Instance* instance);
+	void createPipelines(Instance* instance);
+	void createDescriptorSets(Instance* instance);
+	VkPipeline createComputePipeline(Device* device, const std::string& path,
+	                                 VkPipelineLayout layout);
+};
+
+#endif
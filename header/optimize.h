@@ -0,0 +1,30 @@
+#ifndef __OPTIMIZE_H_INCLUDED__
+#define __OPTIMIZE_H_INCLUDED__
+
+#include "lod.h"
+#include "meshlet.h"
+#include "util.h"
+
+// Size of the simulated post-transform cache, for both ordering and ACMR
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+// Average cache misses per triangle with a FIFO post-transform cache
+float computeAcmr(const uint32_t* indices, size_t indexCount,
+                  uint32_t cacheSize);
+
+// Tipsify (Sander et al. 2007) triangle reordering of an index range
+void optimizeVertexCache(uint32_t* indices, size_t indexCount,
+                         uint32_t cacheSize);
+
+// Sorts each level's meshlets so outward facing ones draw first, then
+// orders the triangles inside every meshlet for the vertex cache.
+void optimizeMeshlets(const std::vector<Vertex>& vertices,
+                      std::vector<uint32_t>& indices,
+                      std::vector<LodLevel>& lods,
+                      std::vector<Meshlet>& meshlets);
+
+// Renumbers vertices in order of first use and drops unreferenced ones
+void optimizeVertexFetch(std::vector<Vertex>& vertices,
+                         std::vector<uint32_t>& indices);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __OVERDRAW_H_INCLUDED__
+#define __OVERDRAW_H_INCLUDED__
+
+#include "util.h"
+
+// Blendable on every device, and exact up to 2048 layers
+constexpr VkFormat OVERDRAW_COUNT_FORMAT = VK_FORMAT_R16_SFLOAT;
+
+// The --overdraw view. The geometry pipeline adds one per fragment into a
+// single sample count attachment, with the depth test off so hidden layers
+// count too, and a fullscreen pass shows the counts on a colour ramp.
+struct OverdrawView {
+	bool enabled = false;
+
+	VkRenderPass countPass;
+	VkFramebuffer countFramebuffer;
+	VkImage countImage;
+	VkDeviceMemory countImageMemory;
+	VkImageView countImageView;
+	VkSampler sampler;
+
+	VkDescriptorSetLayout setLayout;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline displayPipeline;
+	// From the instance's descriptor cache, which drops it along with the
+	// swap chain
+	VkDescriptorSet set;
+
+	// Sized to the swap chain, and shown through the renderer's render
+	// pass, so both must exist
+	void createResources(Instance* instance);
+	void destroyResources(Device* device);
+
+	// Draws the counts into the swap chain image. Outside the pipeline
+	// statistics, which are left counting the geometry's fragments.
+	void display(Instance* instance, VkCommandBuffer commandBuffer,
+	             uint32_t imageIndex);
+
+  private:
+	void createCountPass(Instance* instance);
+	void createDisplayPipeline(Instance* instance);
+};
+
+#endif
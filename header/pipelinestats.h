@@ -0,0 +1,47 @@
+#ifndef __PIPELINESTATS_H_INCLUDED__
+#define __PIPELINESTATS_H_INCLUDED__
+
+#include "util.h"
+
+// Render passes a frame can have queries around; occlusion culling draws in
+// two
+constexpr uint32_t PIPELINE_STATISTICS_PASSES = 2;
+// Frames between reports
+constexpr uint32_t PIPELINE_STATISTICS_INTERVAL = 60;
+
+struct FrameStatistics {
+	uint64_t vertexInvocations = 0;
+	uint64_t clippingPrimitives = 0;
+	uint64_t fragmentInvocations = 0;
+	// Fragments shaded per pixel of the frame. The overdraw view, which
+	// turns the depth test off, makes this the scene's depth complexity.
+	double overdraw = 0.0;
+};
+
+// Pipeline statistics queries around each render pass Commander records,
+// read back without waiting once the frame's fence has signalled
+struct PipelineStatistics {
+	// Set by --stats; checkSupport() clears it without the device feature
+	bool enabled = false;
+	FrameStatistics last;
+
+	void checkSupport(Instance* instance);
+	void create(Instance* instance);
+	// Resets frame's queries, so must be recorded outside a render pass
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+	void beginPass(VkCommandBuffer commandBuffer, uint32_t frame);
+	void endPass(VkCommandBuffer commandBuffer, uint32_t frame);
+	// Reads the queries frame recorded, if any, and reports every
+	// PIPELINE_STATISTICS_INTERVAL frames. extent is the frame's size.
+	void collect(uint32_t frame, VkExtent2D extent);
+	void destroy(Device* device);
+
+  private:
+	Device* device;
+	VkQueryPool pool;
+	// Passes recorded per frame in flight and not yet collected
+	std::vector<uint32_t> passCounts;
+	uint64_t frameCount = 0;
+};
+
+#endif
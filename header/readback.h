@@ -0,0 +1,71 @@
+#ifndef __READBACK_H_INCLUDED__
+#define __READBACK_H_INCLUDED__
+
+#include "staging.h"
+#include "util.h"
+
+#include <future>
+
+struct ThreadPool;
+
+// Copies rendered images back to the host without stalling the queue. The
+// command buffer that draws an image also copies it into the next slot of a
+// ring of host buffers; once that submission's fence has signalled, often
+// frames later, the slot is handed to the thread pool to be written out and
+// reused after that. Main thread only, apart from the encoding.
+struct ReadbackRing {
+	// Images must be 8 bit RGBA or BGRA. Each slot holds one image, so
+	// slotCount has to exceed the copies that can be in flight at once.
+	void create(Instance* instance, uint32_t width, uint32_t height,
+	            VkFormat format, uint32_t slotCount);
+	// Flushes, then reallocates the slots for a new image size. The device
+	// must be idle.
+	void resize(uint32_t width, uint32_t height);
+	// Records a copy of image, which is in layout before and after, to be
+	// written to path: PNG for a .png path, raw rows of RGBA otherwise.
+	// fence names the fence the command buffer is submitted with. Waits for
+	// the slot's previous image to finish encoding if it hasn't.
+	void capture(VkCommandBuffer commandBuffer, VkImage image,
+	             VkImageLayout layout, uint32_t fence,
+	             const std::string& path);
+	// Starts encoding the copies recorded against fence, which must have
+	// signalled
+	void collect(uint32_t fence);
+	// Encodes whatever is still outstanding and waits for it. The device
+	// must be idle.
+	void flush();
+	void destroy();
+
+	// Both carry over resize()
+	size_t getCaptureCount() const;
+	size_t getFailureCount() const;
+
+  private:
+	enum class SlotState { Free, Copying, Encoding };
+
+	struct Slot {
+		StagingBuffer buffer;
+		SlotState state = SlotState::Free;
+		uint32_t fence;
+		std::string path;
+		std::future<void> encoded;
+	};
+
+	Device* device;
+	ThreadPool* threadPool;
+	uint32_t width;
+	uint32_t height;
+	VkFormat format;
+	std::vector<Slot> slots;
+	// The oldest slot, and so the next to be reused
+	size_t next = 0;
+	size_t captures = 0;
+	size_t failures = 0;
+
+	void allocate();
+	void encode(Slot& slot);
+	// Waits for an encoding slot and frees it
+	void reclaim(Slot& slot);
+};
+
+#endif
@@ -3,9 +3,12 @@
 
 #include "util.h"
 
+struct VertexLayout;
+
 struct Renderer {
 	VkSampleCountFlagBits msaaSamples;
 	VkRenderPass renderPass;
+	VkRenderPass renderPassLoad;
 	VkPipelineLayout pipelineLayout;
 	VkPipeline graphicsPipeline;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
@@ -23,6 +26,17 @@ struct Renderer {
 	void createColourResources(Instance* instance);
 	void createDepthResources(Instance* instance);
 	VkSampleCountFlagBits getMaxUsableSampleCount(Device* device);
+	// The builders behind the members above, for passes and pipelines that
+	// don't draw to the swap chain. Passes have a multisampled colour and
+	// depth attachment resolved into a third, left in resolveLayout. A
+	// countOverdraw pipeline suits OverdrawView::countPass instead.
+	VkRenderPass buildRenderPass(Instance* instance, VkAttachmentLoadOp loadOp,
+	                             VkFormat format, VkImageLayout resolveLayout);
+	VkPipelineLayout buildPipelineLayout(Instance* instance);
+	VkPipeline buildPipeline(Instance* instance, const VertexLayout& layout,
+	                         VkPipelineLayout pipelineLayout,
+	                         VkRenderPass renderPass, VkExtent2D extent,
+	                         bool countOverdraw = false);
 
 	void destroyRenderPass(Device* device);
 	void destroyGraphicsPipeline(Device* device);
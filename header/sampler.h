@@ -0,0 +1,29 @@
+#ifndef __SAMPLER_H_INCLUDED__
+#define __SAMPLER_H_INCLUDED__
+
+#include "util.h"
+
+// Samplers shared by everything that asks for the same state. Callers set
+// maxLod to VK_LOD_CLAMP_NONE and let the image view limit the levels, so
+// textures with different mip counts still share one sampler. Main thread
+// only.
+struct SamplerCache {
+	void create(Device* device);
+	// Creates the sampler on first use. Every acquire needs a release.
+	VkSampler acquire(const VkSamplerCreateInfo& samplerInfo);
+	// The sampler is destroyed with its last reference
+	void release(VkSampler sampler);
+	void destroy();
+
+  private:
+	struct Entry {
+		VkSamplerCreateInfo info;
+		VkSampler sampler;
+		uint32_t references;
+	};
+
+	Device* device;
+	std::vector<Entry> entries;
+};
+
+#endif
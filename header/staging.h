@@ -0,0 +1,61 @@
+#ifndef __STAGING_H_INCLUDED__
+#define __STAGING_H_INCLUDED__
+
+#include "util.h"
+
+#include <mutex>
+
+// Size of the blocks a StagingPool sub-allocates from
+constexpr VkDeviceSize STAGING_POOL_BLOCK_SIZE = 64 * 1024 * 1024;
+
+// Host visible transfer source that stays mapped for its whole life, so
+// loaders can write GPU data into it directly. Creating and filling one is
+// safe on a worker thread; the copy to the device is not.
+struct StagingBuffer {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	uint8_t* data = nullptr;
+	VkDeviceSize size = 0;
+
+	// Readback buffers are created as a TRANSFER_DST instead
+	void create(Device* device, VkDeviceSize bufferSize,
+	            VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	// Safe to call on a buffer that was never created
+	void destroy(Device* device);
+};
+
+// A range of a pooled staging buffer, mapped at data
+struct StagingSpan {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	uint8_t* data = nullptr;
+	VkDeviceSize size = 0;
+	uint32_t block = 0;
+};
+
+// Sub-allocates staging memory from large mapped blocks so many small
+// uploads don't each need their own buffer and allocation. Allocating and
+// freeing are safe from any thread. A block is reused once every span in
+// it has been freed; requests larger than a block get one of their own.
+struct StagingPool {
+	void create(Device* device);
+	StagingSpan allocate(VkDeviceSize size, VkDeviceSize alignment);
+	// Safe to call on a span that was never allocated
+	void free(StagingSpan& span);
+	void destroy();
+
+  private:
+	struct Block {
+		StagingBuffer buffer;
+		VkDeviceSize used = 0;
+		uint32_t live = 0;
+	};
+
+	Device* device;
+	std::mutex mutex;
+	std::vector<Block> blocks;
+
+	uint32_t createBlock(VkDeviceSize size);
+};
+
+#endif
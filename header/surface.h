@@ -7,6 +7,8 @@ struct Surface {
 	uint32_t width = 800;
 	uint32_t height = 600;
 	bool framebufferResized = true;
+	// Batch rendering still needs a surface to pick a device by
+	bool visible = true;
 	GLFWwindow* window;
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapChain;
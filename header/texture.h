@@ -1,22 +1,92 @@
 #ifndef __IMAGE_H_INCLUDED__
 #define __IMAGE_H_INCLUDED__
 
+#include "staging.h"
 #include "util.h"
 
+enum class TextureCompression {
+	None,
+	// 4 bits per texel, opaque sources only
+	BC1,
+	// 8 bits per texel
+	BC7,
+};
+
+// Used for JPEG/PNG sources when the device can sample BC formats. Sources
+// with transparency get BC7 either way.
+constexpr TextureCompression TEXTURE_COMPRESSION = TextureCompression::BC1;
+
+// Copy offsets have to be a multiple of the texel block size
+constexpr VkDeviceSize TEXTURE_STAGING_ALIGNMENT = 16;
+
 struct Texture {
 	VkImage image;
 	VkDeviceMemory memory;
 	VkImageView view;
 	VkSampler sampler;
+	VkFormat format;
 	uint32_t mipLevels;
+	// The full mip chain waiting for upload, back to back from level 0 in
+	// pooled staging memory. Freed once uploaded.
+	StagingSpan staging;
+	std::vector<size_t> levelOffsets;
+	// KTX2 file holding the same chain, which the streamer reloads levels
+	// from, or empty when there is none
+	std::string chainPath;
+	uint32_t width;
+	uint32_t height;
+	TextureCompression compression = TextureCompression::None;
+	// Must be set before loading
+	StagingPool* stagingPool = nullptr;
+	// The image holds levels baseLevel and coarser only
+	uint32_t baseLevel = 0;
 
 	void create(Instance* instance, std::string imgPath);
+	// A single white texel to sample until the real texture is resident
+	void createPlaceholder(Instance* instance);
+	// CPU half of create(), safe to run on a worker thread. Loads KTX2 files
+	// as they are; other images get their mip chain built, compressed when
+	// compression is set, and cached.
+	void load(std::string imgPath);
+	// Decodes an encoded image (PNG, JPEG, ...) already in memory. The
+	// compressed result is cached against cacheSource unless it is empty.
+	void loadFromMemory(const uint8_t* data, size_t size,
+	                    const std::string& cacheSource);
+	// GPU half of create(), must run on the main thread
+	void upload(Instance* instance);
+	// Replaces any staged levels with size bytes of fresh staging memory
+	uint8_t* allocatePixels(size_t size);
+	void releaseStaging();
 	void destroy(Device* device);
 
   private:
-	void createTextureImage(Instance* instance, std::string imgPath);
+	void destroyImage(Device* device);
+	void setPixels(const uint8_t* data, int texWidth, int texHeight,
+	               const std::string& cacheSource);
+	// Copies in level 0 and filters the rest of the chain from it
+	void buildMipChain(const uint8_t* data, bool srgb);
+	void compress(const uint8_t* data);
+	// Creates an undefined image for levels baseLevel and coarser
+	void allocateImage(Device* device);
+	void createTextureImage(Instance* instance, VkCommandBuffer commandBuffer);
 	void createTextureImageView(Device* device);
 	void createTextureSampler(Device* device);
+
+	friend struct TextureStreamer;
+	friend void recordTextureUploads(Instance* instance,
+	                                 VkCommandBuffer commandBuffer,
+	                                 const std::vector<Texture*>& textures);
+	friend void finishTextureUploads(const std::vector<Texture*>& textures);
 };
 
+// Uploads every staged texture with one submission and frees its staging
+// memory. Must run on the main thread.
+void uploadTextures(Instance* instance, const std::vector<Texture*>& textures);
+// The same in two halves, for callers with a command buffer of their own.
+// The textures are usable once it has been submitted, and their staging
+// must be left alone until it has finished executing.
+void recordTextureUploads(Instance* instance, VkCommandBuffer commandBuffer,
+                          const std::vector<Texture*>& textures);
+void finishTextureUploads(const std::vector<Texture*>& textures);
+
 #endif
\ No newline at end of file
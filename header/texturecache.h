@@ -0,0 +1,23 @@
+#ifndef __TEXTURECACHE_H_INCLUDED__
+#define __TEXTURECACHE_H_INCLUDED__
+
+#include "util.h"
+
+struct Texture;
+
+// Bump whenever mip generation or the block encoders change their output
+constexpr uint32_t TEXTURE_CACHE_VERSION = 2;
+
+// The cache is a regular KTX2 file, with the source it was built from
+// recorded in its key/value data
+std::string getTextureCachePath(const std::string& sourcePath);
+
+// Fills the texture from the cache next to sourcePath when it was built
+// from the same source with the texture's compression setting, and sets its
+// chainPath to the cache
+bool readTextureCache(const std::string& sourcePath, Texture& texture);
+
+// False when the cache couldn't be written
+bool writeTextureCache(const std::string& sourcePath, const Texture& texture);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __TEXTURESTREAM_H_INCLUDED__
+#define __TEXTURESTREAM_H_INCLUDED__
+
+#include "ktx2.h"
+#include "staging.h"
+#include "texture.h"
+#include "util.h"
+
+// Device memory streamed textures may take up together, unless
+// --texture-budget <MiB> says otherwise
+constexpr VkDeviceSize TEXTURE_STREAMING_BUDGET = 256ull * 1024 * 1024;
+// Levels this wide and smaller are always resident, so a texture can be
+// drawn as soon as it has loaded
+constexpr uint32_t TEXTURE_STREAMING_TAIL_SIZE = 128;
+
+// Finest level worth sampling on an object screenRadius pixels across,
+// assuming its texture is mapped over it once
+uint32_t estimateMipLevel(const Texture& texture, float screenRadius);
+
+// Keeps each texture's image down to the levels recently asked for. An
+// image gains or loses levels by being replaced: the levels it keeps are
+// copied across on the device, and the ones it gains are read from the
+// texture's chainPath, which stays mapped. Textures without one are left
+// whole.
+struct TextureStreamer {
+	// Configured budget
+	VkDeviceSize limit = TEXTURE_STREAMING_BUDGET;
+	// The limit, shrunk to fit when the driver reports a memory budget
+	VkDeviceSize budget = TEXTURE_STREAMING_BUDGET;
+	VkDeviceSize residentBytes = 0;
+
+	// Call before the texture's first upload, which is then limited to the
+	// tail of its chain when it can be streamed
+	void add(Texture* texture);
+	// Marks level and everything coarser as needed this frame
+	void request(Texture* texture, uint32_t level);
+	// Brings each texture at most one level closer to its request,
+	// evicting the least recently needed levels while over budget. Returns
+	// the textures whose image was replaced; the new images are filled by
+	// the next record().
+	std::vector<Texture*> update(Instance* instance);
+	// Records the copies into the frame's command buffer, ahead of any
+	// pass that samples the textures
+	void record(Instance* instance, VkCommandBuffer commandBuffer);
+	// Frees the images replaced in the frame submitted with fence, which
+	// must have signalled
+	void collect(Device* device, uint32_t fence);
+	// The device must be idle
+	void destroy(Device* device);
+
+  private:
+	struct Entry {
+		Texture* texture;
+		MappedFile file;
+		std::vector<Ktx2LevelRange> levels;
+		uint32_t tailLevel;
+		uint32_t requested;
+		// Frame each level was last requested in
+		std::vector<uint64_t> lastNeeded;
+	};
+
+	// A replaced image, and the levels staged for its replacement
+	struct Replacement {
+		Texture* texture;
+		Texture previous;
+		uint32_t previousLevel;
+		StagingSpan staging;
+		std::vector<VkBufferImageCopy> uploads;
+		uint32_t fence;
+	};
+
+	std::vector<Entry> entries;
+	uint64_t frame = 1;
+	// Waiting for record(), then for collect()
+	std::vector<Replacement> pending;
+	std::vector<Replacement> retired;
+
+	bool evict(std::vector<uint32_t>& levels, size_t keep);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef __THREADPOOL_H_INCLUDED__
+#define __THREADPOOL_H_INCLUDED__
+
+#include "include.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+// Fixed set of worker threads for CPU work that must not stall the frame
+// loop. Jobs may create and fill staging buffers, but command buffers and
+// queue submission stay on the main thread.
+struct ThreadPool {
+	// A threadCount of 0 uses one thread per hardware thread
+	void create(uint32_t threadCount = 0);
+	// Running jobs are finished, queued ones are dropped
+	void destroy();
+
+	std::future<void> submit(std::function<void()> job);
+	uint32_t getThreadCount() const;
+
+  private:
+	std::vector<std::thread> workers;
+	std::deque<std::packaged_task<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable available;
+	bool stopping = false;
+
+	void work();
+};
+
+template<typename T> bool isReady(const std::future<T>& future) {
+	return future.valid() && future.wait_for(std::chrono::seconds(0)) ==
+	                             std::future_status::ready;
+}
+
+// Threads parallelFor can spread work over from the calling thread: the
+// workers of its pool, or just itself off the pool
+size_t getParallelism();
+
+// Splits [0, count) into rangeCount ranges and runs body(begin, end) on
+// each, for data parallel work inside one job. On a pool worker, idle
+// workers of the same pool take ranges through jobs while the caller works
+// through the rest, so it never waits on a job that hasn't started. Off the
+// pool the ranges run in turn. Rethrows the first exception body throws.
+void parallelFor(size_t count, size_t rangeCount,
+                 const std::function<void(size_t, size_t)>& body);
+
+#endif
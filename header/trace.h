@@ -0,0 +1,36 @@
+#ifndef __TRACE_H_INCLUDED__
+#define __TRACE_H_INCLUDED__
+
+#include "include.h"
+
+#include <atomic>
+
+// Zones a thread records before further ones are dropped
+constexpr size_t TRACE_MAX_EVENTS_PER_THREAD = 1 << 20;
+
+// Times a scope for the trace, as one complete event on the calling
+// thread. name must outlive the trace, so it's normally a literal. With
+// tracing off this costs a relaxed load.
+struct TraceZone {
+	explicit TraceZone(const char* name);
+	~TraceZone();
+
+  private:
+	const char* name;
+	uint64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+
+// Starts recording zones, to be written to path in the Chrome trace event
+// format that chrome://tracing and Perfetto open. Set by --trace.
+void startTrace(const std::string& path);
+// Names the calling thread in the trace
+void setTraceThreadName(const char* name);
+// Every other thread that recorded zones must have finished. Does nothing
+// unless startTrace() was called.
+void writeTrace();
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __UNIFORMRING_H_INCLUDED__
+#define __UNIFORMRING_H_INCLUDED__
+
+#include "util.h"
+
+// Space each frame in flight has for per-draw uniform data
+constexpr VkDeviceSize UNIFORM_RING_FRAME_SIZE = 4 * 1024 * 1024;
+
+// One persistently mapped uniform buffer split into a region per frame in
+// flight. Draws copy their data in and bind it as UNIFORM_BUFFER_DYNAMIC at
+// the returned offset, so per-draw data needs no descriptor writes or
+// allocations.
+struct UniformRing {
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+
+	void create(Instance* instance);
+	// Starts over at the beginning of frame's region; the frame's fence
+	// must have signalled
+	void beginFrame(uint32_t frame);
+	// Copies size bytes in and returns their dynamic offset
+	uint32_t push(const void* data, VkDeviceSize size);
+	template<typename T>
+	uint32_t push(const T& value) {
+		return push(&value, sizeof(T));
+	}
+	void destroy(Device* device);
+
+  private:
+	uint8_t* mapped;
+	VkDeviceSize alignment;
+	VkDeviceSize frameSize;
+	VkDeviceSize frameStart;
+	VkDeviceSize offset;
+};
+
+#endif
@@ -18,64 +18,40 @@ struct Vertex {
 	glm::vec3 pos;
 	glm::vec3 colour;
 	glm::vec2 texCoord;
-
-	static VkVertexInputBindingDescription getBindingDescription() {
-		VkVertexInputBindingDescription bindingDescription = {};
-		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
-		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		return bindingDescription;
-	}
-
-	static std::array<VkVertexInputAttributeDescription, 3>
-	getAttributeDescriptions() {
-		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions =
-		    {};
-		attributeDescriptions[0].binding = 0;
-		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[0].offset = offsetof(Vertex, pos);
-		attributeDescriptions[1].binding = 0;
-		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, colour);
-		attributeDescriptions[2].binding = 0;
-		attributeDescriptions[2].location = 2;
-		attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-		attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
-		return attributeDescriptions;
-	}
+	glm::vec3 normal;
 
 	bool operator==(const Vertex& other) const {
 		return pos == other.pos && colour == other.colour &&
-		       texCoord == other.texCoord;
+		       texCoord == other.texCoord && normal == other.normal;
 	}
 };
 
-namespace std {
-	template<> struct hash<Vertex> {
-		size_t operator()(Vertex const& vertex) const {
-			return ((hash<glm::vec3>()(vertex.pos) ^
-			         (hash<glm::vec3>()(vertex.colour) << 1)) >>
-			        1) ^
-			       (hash<glm::vec2>()(vertex.texCoord) << 1);
-		}
-	};
-} // namespace std
-
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
 
-	bool isComplete() {
+	bool isComplete() const {
 		return graphicsFamily.has_value() && presentFamily.has_value();
 	}
 };
 
-struct SwapChainSupportDetails {
-	VkSurfaceCapabilitiesKHR capabilities;
-	std::vector<VkSurfaceFormatKHR> formats;
-	std::vector<VkPresentModeKHR> presentModes;
+// Read only memory mapping of a whole file
+struct MappedFile {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	// Nanoseconds since the epoch
+	int64_t mtime = 0;
+
+	void map(const std::string& path);
+	void unmap();
+};
+
+// Identifies the source file a cache was built from
+struct SourceStamp {
+	uint64_t size;
+	// Nanoseconds since the epoch
+	int64_t mtime;
+	uint64_t hash;
 };
 
 void createImage(Device* device, uint32_t width, uint32_t height,
@@ -123,15 +99,20 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance,
 
 std::vector<const char*> getRequiredExtensions(bool validationLayersEnabled);
 
-bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+bool checkInstanceExtensionSupport(const char* name);
+
+std::vector<char> readFile(const std::string& filename);
 
-QueueFamilyIndices findQueueFamilies(Instance* instance,
-                                     VkPhysicalDevice device);
+bool statFile(const std::string& path, size_t& size, int64_t& mtime);
 
-SwapChainSupportDetails querySwapChainSupport(Instance* instance,
-                                              VkPhysicalDevice device);
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed);
 
-std::vector<char> readFile(const std::string& filename);
+// Returns false if path can't be read
+bool stampSource(const std::string& path, SourceStamp& stamp);
+
+// Whether a cache stamped from path is still valid. A missing source keeps
+// its cache, so caches can ship without their sources.
+bool sourceMatches(const std::string& path, const SourceStamp& stamp);
 
 VkShaderModule createShaderModule(Device* device,
                                   const std::vector<char>& code);
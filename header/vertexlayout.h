@@ -0,0 +1,40 @@
+#ifndef __VERTEXLAYOUT_H_INCLUDED__
+#define __VERTEXLAYOUT_H_INCLUDED__
+
+#include "util.h"
+
+enum class PositionFormat {
+	Float32,
+	// 16-bit normalized, relative to the mesh bounding box
+	Unorm16,
+};
+
+enum class TexCoordFormat {
+	Float32,
+	Float16,
+};
+
+// Describes how Vertex data is packed for the GPU. The vertex shader
+// variant and the pipeline's vertex input state both come from here.
+struct VertexLayout {
+	PositionFormat position = PositionFormat::Unorm16;
+	TexCoordFormat texCoord = TexCoordFormat::Float16;
+	// Octahedral encoded, dropped when the mesh has no normals. Off until
+	// a shader lights with them; they cost 4 bytes a vertex and split
+	// vertices that would otherwise merge.
+	bool normals = false;
+	bool colour = false;
+
+	uint32_t getStride() const;
+	VkVertexInputBindingDescription getBindingDescription() const;
+	std::vector<VkVertexInputAttributeDescription>
+	getAttributeDescriptions() const;
+	std::string getShaderPath() const;
+	glm::mat4 getPositionDecode(glm::vec3 minPos, glm::vec3 maxPos) const;
+
+	// Writes getStride() bytes per vertex to data
+	void pack(const std::vector<Vertex>& vertices, glm::vec3 minPos,
+	          glm::vec3 maxPos, uint8_t* data) const;
+};
+
+#endif
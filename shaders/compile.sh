@@ -1,2 +1,13 @@
 /home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc shaders/shader.vert -o shaders/shader.vert.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc -DVERTEX_COLOUR shaders/shader.vert -o shaders/shader_colour.vert.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc -DVERTEX_NORMAL shaders/shader.vert -o shaders/shader_normal.vert.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc -DVERTEX_COLOUR -DVERTEX_NORMAL shaders/shader.vert -o shaders/shader_colour_normal.vert.spv
 /home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc shaders/shader.frag -o shaders/shader.frag.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc shaders/overdraw.frag -o shaders/overdraw.frag.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc shaders/fullscreen.vert -o shaders/fullscreen.vert.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc shaders/overdrawview.frag -o shaders/overdrawview.frag.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc shaders/depthcopy.comp -o shaders/depthcopy.comp.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc -DMULTISAMPLED shaders/depthcopy.comp -o shaders/depthcopy_ms.comp.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc shaders/depthreduce.comp -o shaders/depthreduce.comp.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc shaders/cull.comp -o shaders/cull.comp.spv
+/home/ben/dev/vulkan/1.2.131.2/x86_64/bin/glslc -DCOMPACT_DRAWS shaders/cull.comp -o shaders/cull_count.comp.spv
@@ -0,0 +1,9 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Blended additively into the count attachment, one per layer
+layout(location = 0) out float outCount;
+
+void main() {
+    outCount = 1.0;
+}
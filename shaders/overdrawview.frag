@@ -0,0 +1,26 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(binding = 0) uniform sampler2D countSampler;
+
+layout(location = 0) out vec4 outColour;
+
+// Layers at which the ramp reaches white
+const float OVERDRAW_MAX_LAYERS = 32.0;
+
+// Blue for a single layer through cyan, green, yellow and red to white
+const vec3 RAMP[6] = vec3[](vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 1.0),
+                            vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0),
+                            vec3(1.0, 0.0, 0.0), vec3(1.0, 1.0, 1.0));
+
+void main() {
+    float count = texelFetch(countSampler, ivec2(gl_FragCoord.xy), 0).r;
+    if (count < 0.5) {
+        outColour = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+    // Logarithmic, so one layer from two is as clear as 16 from 32
+    float t = clamp(log2(count) / log2(OVERDRAW_MAX_LAYERS), 0.0, 1.0) * 5.0;
+    int i = min(int(t), 4);
+    outColour = vec4(mix(RAMP[i], RAMP[i + 1], t - float(i)), 1.0);
+}
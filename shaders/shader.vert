@@ -2,21 +2,49 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(push_constant) uniform UniformBufferObject {
-    // mat4 model;
-    // mat4 view;
-    // mat4 proj;
-    mat4 mvp;
+    mat4 viewProj;
 } ubo;
 
+// Bound at a dynamic offset per draw
+layout(binding = 0) uniform ObjectUniforms {
+    // Also decodes quantized positions
+    mat4 model;
+    mat4 normal;
+} object;
+
 layout(location = 0) in vec3 inPosition;
+#ifdef VERTEX_COLOUR
 layout(location = 1) in vec3 inColour;
+#endif
 layout(location = 2) in vec2 inTexCoord;
+#ifdef VERTEX_NORMAL
+layout(location = 3) in vec2 inNormal;
+#endif
 
 layout(location = 0) out vec3 fragColour;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0,
+                                        n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
 
 void main() {
-    gl_Position = ubo.mvp * vec4(inPosition, 1.0);
+    gl_Position = ubo.viewProj * object.model * vec4(inPosition, 1.0);
+#ifdef VERTEX_COLOUR
     fragColour = inColour;
+#else
+    fragColour = vec3(1.0);
+#endif
     fragTexCoord = inTexCoord;
+#ifdef VERTEX_NORMAL
+    fragNormal = normalize(mat3(object.normal) * octahedralDecode(inNormal));
+#else
+    fragNormal = vec3(0.0, 0.0, 1.0);
+#endif
 }
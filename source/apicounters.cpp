@@ -0,0 +1,145 @@
+#include "apicounters.h"
+#include "include.h"
+
+#ifdef VULKAN_API_COUNTERS
+
+#include <atomic>
+#include <iomanip>
+#include <thread>
+
+namespace {
+	constexpr size_t API_CALL_COUNT = static_cast<size_t>(ApiCall::Count);
+
+	const char* API_CALL_NAMES[API_CALL_COUNT] = {
+	    "vkQueueSubmit",
+	    "vkQueuePresentKHR",
+	    "vkAcquireNextImageKHR",
+	    "vkWaitForFences",
+	    "vkQueueWaitIdle",
+	    "vkDeviceWaitIdle",
+	    "vkAllocateMemory",
+	    "vkFreeMemory",
+	    "vkCreateBuffer",
+	    "vkCreateImage",
+	    "vkAllocateCommandBuffers",
+	    "vkAllocateDescriptorSets",
+	    "vkResetDescriptorPool",
+	    "vkUpdateDescriptorSets",
+	    "vkCmdBindPipeline",
+	    "vkCmdBindDescriptorSets",
+	    "vkCmdBindVertexBuffers",
+	    "vkCmdBindIndexBuffer",
+	    "vkCmdDrawIndexed",
+	    "vkCmdDrawIndexedIndirect",
+	    "vkCmdDispatch"};
+
+	// Since the last frame began or ended, from every thread
+	struct Counter {
+		std::atomic<uint64_t> calls{0};
+		std::atomic<uint64_t> nanoseconds{0};
+	};
+
+	struct Total {
+		uint64_t calls = 0;
+		uint64_t nanoseconds = 0;
+		uint64_t frameCalls = 0;
+		uint64_t frameNanoseconds = 0;
+		uint64_t peakCalls = 0;
+		uint64_t peakNanoseconds = 0;
+		std::atomic<uint64_t> anomalies{0};
+	};
+
+	std::array<Counter, API_CALL_COUNT> counters;
+	// Only touched by the frame thread
+	std::array<Total, API_CALL_COUNT> totals;
+	uint64_t frames = 0;
+	std::atomic<bool> inFrame{false};
+	std::thread::id frameThread;
+
+	bool isIdleWait(ApiCall call) {
+		return call == ApiCall::QueueWaitIdle ||
+		       call == ApiCall::DeviceWaitIdle;
+	}
+
+	// Folds the counters into the totals and starts them over
+	void drain(bool frame) {
+		for (size_t i = 0; i < API_CALL_COUNT; i++) {
+			uint64_t calls = counters[i].calls.exchange(0);
+			uint64_t nanoseconds = counters[i].nanoseconds.exchange(0);
+			Total& total = totals[i];
+			total.calls += calls;
+			total.nanoseconds += nanoseconds;
+			if (frame) {
+				total.frameCalls += calls;
+				total.frameNanoseconds += nanoseconds;
+				total.peakCalls = std::max(total.peakCalls, calls);
+				total.peakNanoseconds =
+				    std::max(total.peakNanoseconds, nanoseconds);
+			}
+		}
+	}
+} // namespace
+
+ApiCallTimer::ApiCallTimer(ApiCall apiCall)
+    : call(apiCall), start(std::chrono::steady_clock::now()) {}
+
+ApiCallTimer::~ApiCallTimer() {
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	size_t index = static_cast<size_t>(call);
+	counters[index].calls.fetch_add(1, std::memory_order_relaxed);
+	counters[index].nanoseconds.fetch_add(
+	    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+	    std::memory_order_relaxed);
+	// Idling in the frame loop stalls everything queued behind it
+	if (isIdleWait(call) && inFrame &&
+	    std::this_thread::get_id() == frameThread) {
+		if (totals[index].anomalies++ == 0) {
+			std::cerr << API_CALL_NAMES[index] << " inside the frame loop, "
+			          << "frame " << frames << std::endl;
+		}
+	}
+}
+
+ApiFrameScope::ApiFrameScope() {
+	// Whatever ran between frames, startup included, isn't a frame's
+	drain(false);
+	frameThread = std::this_thread::get_id();
+	inFrame = true;
+}
+
+ApiFrameScope::~ApiFrameScope() {
+	inFrame = false;
+	drain(true);
+	frames++;
+}
+
+void reportApiCounters() {
+	drain(false);
+	double frameCount = std::max<double>(1.0, frames);
+	std::cout << "Vulkan calls over " << frames << " frames "
+	          << "(per frame average / peak, total):" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	for (size_t i = 0; i < API_CALL_COUNT; i++) {
+		const Total& total = totals[i];
+		if (total.calls == 0) {
+			continue;
+		}
+		std::cout << "  " << std::left << std::setw(26) << API_CALL_NAMES[i]
+		          << std::right << total.frameCalls / frameCount << " / "
+		          << total.peakCalls << " calls, "
+		          << total.frameNanoseconds / frameCount * 1e-6 << " / "
+		          << total.peakNanoseconds * 1e-6 << " ms; " << total.calls
+		          << " calls, " << total.nanoseconds * 1e-6 << " ms"
+		          << std::endl;
+	}
+	for (size_t i = 0; i < API_CALL_COUNT; i++) {
+		if (totals[i].anomalies > 0) {
+			std::cout << "  " << API_CALL_NAMES[i]
+			          << " inside the frame loop " << totals[i].anomalies
+			          << " times" << std::endl;
+		}
+	}
+	std::cout << std::defaultfloat;
+}
+
+#endif
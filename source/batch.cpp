@@ -0,0 +1,472 @@
+#include "batch.h"
+#include "commander.h"
+#include "descriptor.h"
+#include "device.h"
+#include "include.h"
+#include "instance.h"
+#include "json.h"
+#include "model.h"
+#include "readback.h"
+#include "renderer.h"
+#include "texture.h"
+#include "threadpool.h"
+#include "trace.h"
+#include "util.h"
+
+namespace {
+	// Read back as is, without a swizzle before encoding
+	constexpr VkFormat BATCH_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+	// How long an idle loop waits on the contexts before looking at the
+	// loads again, in nanoseconds
+	constexpr uint64_t BATCH_POLL_TIMEOUT = 1000000;
+
+	glm::vec3 readVec3(const JsonValue& value, glm::vec3 fallback) {
+		if (value.size() != 3) {
+			return fallback;
+		}
+		return glm::vec3(value[0].asNumber(), value[1].asNumber(),
+		                 value[2].asNumber());
+	}
+} // namespace
+
+BatchManifest readBatchManifest(const std::string& path) {
+	std::vector<char> text = readFile(path);
+	JsonValue json = parseJson(text.data(), text.size());
+	BatchManifest manifest;
+	manifest.width = static_cast<uint32_t>(
+	    json["width"].asInt(BATCH_IMAGE_SIZE));
+	manifest.height = static_cast<uint32_t>(
+	    json["height"].asInt(BATCH_IMAGE_SIZE));
+	manifest.contexts = static_cast<uint32_t>(
+	    std::max<int64_t>(1, json["contexts"].asInt(BATCH_CONTEXTS)));
+	const JsonValue& jobs = json["jobs"];
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const JsonValue& entry = jobs[i];
+		BatchJob job;
+		job.model = entry["model"].asString();
+		job.texture = entry["texture"].asString();
+		job.output = entry["output"].asString();
+		if (job.model.empty() || job.output.empty()) {
+			throw std::runtime_error("failed to read batch job " +
+			                         std::to_string(i) + "!");
+		}
+		if (!entry["eye"].isNull()) {
+			job.eye = readVec3(entry["eye"], glm::vec3(0.0f));
+		}
+		job.target = readVec3(entry["target"], glm::vec3(0.0f));
+		job.up = readVec3(entry["up"], job.up);
+		job.fov = static_cast<float>(entry["fov"].asNumber(job.fov));
+		manifest.jobs.push_back(job);
+	}
+	return manifest;
+}
+
+void BatchRenderer::create(Instance* instance, const BatchManifest& batch) {
+	manifest = batch;
+	Device* device = instance->device;
+	instance->descriptor->createDescriptorSetLayout(instance);
+	instance->commander->createPool(instance);
+	instance->placeholder->createPlaceholder(instance);
+	Renderer* renderer = instance->renderer;
+	renderer->msaaSamples = renderer->getMaxUsableSampleCount(device);
+	depthFormat = findDepthFormat(device);
+	renderPass =
+	    renderer->buildRenderPass(instance, VK_ATTACHMENT_LOAD_OP_CLEAR,
+	                              BATCH_FORMAT,
+	                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	pipelineLayout = renderer->buildPipelineLayout(instance);
+	descriptors.create(device, manifest.contexts);
+	contexts.resize(manifest.contexts);
+	for (Context& context : contexts) {
+		createContext(instance, context);
+	}
+	// Enough for every context to copy while each worker encodes
+	readback.create(instance, manifest.width, manifest.height, BATCH_FORMAT,
+	                manifest.contexts +
+	                    instance->threadPool->getThreadCount());
+}
+
+void BatchRenderer::createContext(Instance* instance, Context& context) {
+	Device* device = instance->device;
+	VkSampleCountFlagBits samples = instance->renderer->msaaSamples;
+	uint32_t width = manifest.width;
+	uint32_t height = manifest.height;
+	createImage(device, width, height, 1, samples, BATCH_FORMAT,
+	            VK_IMAGE_TILING_OPTIMAL,
+	            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+	                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, context.colourImage,
+	            context.colourImageMemory);
+	context.colourImageView =
+	    createImageView(device, context.colourImage, BATCH_FORMAT,
+	                    VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	createImage(device, width, height, 1, samples, depthFormat,
+	            VK_IMAGE_TILING_OPTIMAL,
+	            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+	                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, context.depthImage,
+	            context.depthImageMemory);
+	context.depthImageView =
+	    createImageView(device, context.depthImage, depthFormat,
+	                    VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+	createImage(device, width, height, 1, VK_SAMPLE_COUNT_1_BIT, BATCH_FORMAT,
+	            VK_IMAGE_TILING_OPTIMAL,
+	            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+	                VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, context.resolveImage,
+	            context.resolveImageMemory);
+	context.resolveImageView =
+	    createImageView(device, context.resolveImage, BATCH_FORMAT,
+	                    VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+	std::array<VkImageView, 3> attachments = {context.colourImageView,
+	                                          context.depthImageView,
+	                                          context.resolveImageView};
+	VkFramebufferCreateInfo framebufferInfo = {};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = renderPass;
+	framebufferInfo.attachmentCount =
+	    static_cast<uint32_t>(attachments.size());
+	framebufferInfo.pAttachments = attachments.data();
+	framebufferInfo.width = width;
+	framebufferInfo.height = height;
+	framebufferInfo.layers = 1;
+	if (vkCreateFramebuffer(device->logical, &framebufferInfo, nullptr,
+	                        &context.framebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create framebuffer!");
+	}
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = instance->commander->pool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+	if (vkAllocateCommandBuffers(device->logical, &allocInfo,
+	                             &context.commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate command buffers!");
+	}
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	if (vkCreateFence(device->logical, &fenceInfo, nullptr, &context.fence) !=
+	    VK_SUCCESS) {
+		throw std::runtime_error("failed to create batch fence!");
+	}
+
+	createBuffer(device, sizeof(ObjectUniforms),
+	             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+	             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	             context.uniformBuffer, context.uniformBufferMemory);
+	vkMapMemory(device->logical, context.uniformBufferMemory, 0,
+	            sizeof(ObjectUniforms), 0, &context.uniformMapped);
+}
+
+size_t BatchRenderer::run(Instance* instance) {
+	Device* device = instance->device;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	while (finished < manifest.jobs.size()) {
+		load(instance);
+		bool progress = false;
+		for (uint32_t i = 0; i < contexts.size(); i++) {
+			Context& context = contexts[i];
+			if (context.job && vkGetFenceStatus(device->logical,
+			                                    context.fence) == VK_SUCCESS) {
+				finish(instance, i);
+				progress = true;
+			}
+			// A job that fails to load leaves the context free for the next
+			while (!context.job && start(instance, i)) {
+				progress = true;
+			}
+		}
+		if (progress) {
+			continue;
+		}
+		std::vector<VkFence> busy;
+		for (const Context& context : contexts) {
+			if (context.job) {
+				busy.push_back(context.fence);
+			}
+		}
+		if (busy.empty()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		} else {
+			vkWaitForFences(device->logical,
+			                static_cast<uint32_t>(busy.size()), busy.data(),
+			                VK_FALSE, BATCH_POLL_TIMEOUT);
+		}
+	}
+	readback.flush();
+	failed += readback.getFailureCount();
+	float seconds = std::chrono::duration<float, std::chrono::seconds::period>(
+	                    std::chrono::high_resolution_clock::now() - startTime)
+	                    .count();
+	size_t rendered = finished - failed;
+	std::cout << "Rendered " << rendered << " assets in " << seconds << " s ("
+	          << rendered / std::max(seconds, 1e-6f) << " assets/s), "
+	          << failed << " failed" << std::endl;
+	return failed;
+}
+
+void BatchRenderer::load(Instance* instance) {
+	size_t limit = contexts.size() * BATCH_PREFETCH;
+	while (nextJob < manifest.jobs.size() && pending.size() < limit) {
+		const BatchJob& request = manifest.jobs[nextJob];
+		Job job;
+		job.index = nextJob++;
+		job.model = new Model();
+		job.model->create(instance, request.model, request.texture);
+		pending.push_back(job);
+	}
+}
+
+bool BatchRenderer::start(Instance* instance, uint32_t contextIndex) {
+	for (auto it = pending.begin(); it != pending.end(); ++it) {
+		Model& model = *it->model;
+		if (!isReady(model.meshLoad) || !isReady(model.textureLoad)) {
+			continue;
+		}
+		Job job = *it;
+		pending.erase(it);
+		const BatchJob& request = manifest.jobs[job.index];
+		try {
+			model.meshLoad.get();
+		} catch (const std::exception& e) {
+			std::cerr << request.model << ": " << e.what() << std::endl;
+			release(instance->device, job);
+			failed++;
+			finished++;
+			return true;
+		}
+		try {
+			model.textureLoad.get();
+			job.textured = true;
+		} catch (const std::exception& e) {
+			std::cerr << request.model << ": " << e.what()
+			          << ", rendering untextured" << std::endl;
+		}
+		contexts[contextIndex].job = job;
+		record(instance, contextIndex);
+		return true;
+	}
+	return false;
+}
+
+void BatchRenderer::record(Instance* instance, uint32_t contextIndex) {
+	TRACE_ZONE("Record job");
+	Device* device = instance->device;
+	Context& context = contexts[contextIndex];
+	Job& job = *context.job;
+	Model& model = *job.model;
+	const BatchJob& request = manifest.jobs[job.index];
+	VkCommandBuffer commandBuffer = context.commandBuffer;
+
+	vkResetCommandBuffer(commandBuffer, 0);
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording command buffer!");
+	}
+
+	// Geometry and texture go up in the same submission as the draw
+	createBuffer(device, model.vertexStaging.size,
+	             VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+	                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+	             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, job.vertexBuffer,
+	             job.vertexBufferMemory);
+	createBuffer(device, model.indexStaging.size,
+	             VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+	                 VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+	             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, job.indexBuffer,
+	             job.indexBufferMemory);
+	VkBufferCopy copyRegion = {};
+	copyRegion.size = model.vertexStaging.size;
+	vkCmdCopyBuffer(commandBuffer, model.vertexStaging.buffer,
+	                job.vertexBuffer, 1, &copyRegion);
+	copyRegion.size = model.indexStaging.size;
+	vkCmdCopyBuffer(commandBuffer, model.indexStaging.buffer, job.indexBuffer,
+	                1, &copyRegion);
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask =
+	    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0,
+	                     nullptr, 0, nullptr);
+	Texture* texture = instance->placeholder;
+	if (job.textured) {
+		texture = model.texture;
+		recordTextureUploads(instance, commandBuffer, {texture});
+	}
+	job.submitted = true;
+
+	// Without an eye, back off along the diagonal until the bounding sphere
+	// fills the field of view
+	float fov = glm::radians(request.fov);
+	glm::vec3 target = request.eye ? request.target : model.center;
+	glm::vec3 eye = request.eye
+	                    ? *request.eye
+	                    : model.center + glm::normalize(glm::vec3(1.0f)) *
+	                                         model.radius /
+	                                         std::sin(fov * 0.5f);
+	float reach = glm::length(eye - model.center);
+	float nearPlane = std::max(reach - model.radius, reach * 0.001f);
+	glm::mat4 view = glm::lookAt(eye, target, request.up);
+	glm::mat4 proj = glm::perspective(
+	    fov, manifest.width / (float)manifest.height, nearPlane,
+	    reach + model.radius);
+	proj[1][1] *= -1;
+	ObjectUniforms object;
+	object.model = model.positionDecode;
+	object.normal = glm::transpose(glm::inverse(view));
+	memcpy(context.uniformMapped, &object, sizeof(object));
+	UniformBufferObject ubo;
+	ubo.viewProj = proj * view;
+	const LodLevel& lod = model.selectLod(view, proj[1][1],
+	                                      static_cast<float>(manifest.height));
+
+	descriptors.resetFrame(contextIndex);
+	VkDescriptorSet set = descriptors.allocateFrameSet(
+	    contextIndex, instance->descriptor->descriptorSetLayout,
+	    {bufferBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+	                   context.uniformBuffer, 0, sizeof(ObjectUniforms)),
+	     imageBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+	                  texture->sampler, texture->view,
+	                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)});
+
+	// Transparent, so thumbnails composite over anything
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = {0.0f, 0.0f, 0.0f, 0.0f};
+	clearValues[1].depthStencil = {1.0f, 0};
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = context.framebuffer;
+	renderPassInfo.renderArea.offset = {0, 0};
+	renderPassInfo.renderArea.extent = {manifest.width, manifest.height};
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+	                     VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	                  getPipeline(instance, model));
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &job.vertexBuffer, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, job.indexBuffer, 0, model.indexType);
+	uint32_t dynamicOffset = 0;
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	                        pipelineLayout, 0, 1, &set, 1, &dynamicOffset);
+	vkCmdPushConstants(commandBuffer, pipelineLayout,
+	                   VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ubo), &ubo);
+	vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, lod.firstIndex, 0, 0);
+	vkCmdEndRenderPass(commandBuffer);
+	// The pass leaves the resolved image ready to copy from
+	readback.capture(commandBuffer, context.resolveImage,
+	                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, contextIndex,
+	                 request.output);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer!");
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	if (vkQueueSubmit(device->graphicsQueue, 1, &submitInfo, context.fence) !=
+	    VK_SUCCESS) {
+		throw std::runtime_error("failed to submit batch command buffer!");
+	}
+}
+
+void BatchRenderer::finish(Instance* instance, uint32_t contextIndex) {
+	TRACE_ZONE("Finish job");
+	Device* device = instance->device;
+	Context& context = contexts[contextIndex];
+	vkResetFences(device->logical, 1, &context.fence);
+	readback.collect(contextIndex);
+	release(device, *context.job);
+	context.job.reset();
+	finished++;
+}
+
+void BatchRenderer::release(Device* device, Job& job) {
+	Model* model = job.model;
+	vkDestroyBuffer(device->logical, job.vertexBuffer, nullptr);
+	vkFreeMemory(device->logical, job.vertexBufferMemory, nullptr);
+	vkDestroyBuffer(device->logical, job.indexBuffer, nullptr);
+	vkFreeMemory(device->logical, job.indexBufferMemory, nullptr);
+	if (job.textured && job.submitted) {
+		finishTextureUploads({model->texture});
+		model->texture->destroy(device);
+	}
+	// A texture that loaded but was never uploaded is still staged
+	model->texture->releaseStaging();
+	model->releaseStaging();
+	delete model->texture;
+	delete model;
+	job.model = nullptr;
+}
+
+VkPipeline BatchRenderer::getPipeline(Instance* instance, const Model& model) {
+	const VertexLayout& layout = model.layout;
+	std::string key = layout.getShaderPath() + "/" +
+	                  std::to_string(static_cast<int>(layout.position)) + "/" +
+	                  std::to_string(static_cast<int>(layout.texCoord));
+	auto found = pipelines.find(key);
+	if (found != pipelines.end()) {
+		return found->second;
+	}
+	VkPipeline pipeline = instance->renderer->buildPipeline(
+	    instance, layout, pipelineLayout, renderPass,
+	    {manifest.width, manifest.height});
+	pipelines[key] = pipeline;
+	return pipeline;
+}
+
+void BatchRenderer::destroy(Instance* instance) {
+	Device* device = instance->device;
+	vkDeviceWaitIdle(device->logical);
+	// Only left over when run() stopped early
+	for (Job& job : pending) {
+		job.model->meshLoad.wait();
+		job.model->textureLoad.wait();
+		release(device, job);
+	}
+	pending.clear();
+	for (Context& context : contexts) {
+		if (context.job) {
+			release(device, *context.job);
+		}
+		destroyContext(device, context);
+	}
+	contexts.clear();
+	readback.destroy();
+	for (auto& entry : pipelines) {
+		vkDestroyPipeline(device->logical, entry.second, nullptr);
+	}
+	pipelines.clear();
+	vkDestroyPipelineLayout(device->logical, pipelineLayout, nullptr);
+	vkDestroyRenderPass(device->logical, renderPass, nullptr);
+	descriptors.destroy();
+	instance->placeholder->destroy(device);
+	instance->commander->destroyPool(device);
+	instance->descriptor->destroyDescriptorSetLayout(device);
+}
+
+void BatchRenderer::destroyContext(Device* device, Context& context) {
+	vkDestroyBuffer(device->logical, context.uniformBuffer, nullptr);
+	vkFreeMemory(device->logical, context.uniformBufferMemory, nullptr);
+	vkDestroyFence(device->logical, context.fence, nullptr);
+	vkDestroyFramebuffer(device->logical, context.framebuffer, nullptr);
+	vkDestroyImageView(device->logical, context.resolveImageView, nullptr);
+	vkDestroyImage(device->logical, context.resolveImage, nullptr);
+	vkFreeMemory(device->logical, context.resolveImageMemory, nullptr);
+	vkDestroyImageView(device->logical, context.depthImageView, nullptr);
+	vkDestroyImage(device->logical, context.depthImage, nullptr);
+	vkFreeMemory(device->logical, context.depthImageMemory, nullptr);
+	vkDestroyImageView(device->logical, context.colourImageView, nullptr);
+	vkDestroyImage(device->logical, context.colourImage, nullptr);
+	vkFreeMemory(device->logical, context.colourImageMemory, nullptr);
+}
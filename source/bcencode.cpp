@@ -0,0 +1,429 @@
+#include "bcencode.h"
+#include "include.h"
+#include "threadpool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// How far each index sits from the first endpoint towards the second
+	constexpr float BC1_WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+	constexpr int BC7_WEIGHTS[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+	                                 34, 38, 43, 47, 51, 55, 60, 64};
+	constexpr int REFINE_PASSES = 2;
+
+	void fetchBlock(const uint8_t* pixels, uint32_t width, uint32_t height,
+	                uint32_t blockX, uint32_t blockY, uint8_t* block) {
+		for (uint32_t y = 0; y < 4; y++) {
+			uint32_t row = std::min(blockY * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; x++) {
+				uint32_t column = std::min(blockX * 4 + x, width - 1);
+				memcpy(block + (y * 4 + x) * 4,
+				       pixels + (size_t(row) * width + column) * 4, 4);
+			}
+		}
+	}
+
+	// Writes the index of the closest RGBA8 palette entry for each of the 16
+	// texels and returns the summed squared error
+#ifdef __SSE2__
+	uint32_t findNearest(const uint8_t* texels, const uint8_t* palette,
+	                     int paletteSize, uint8_t* indices) {
+		const __m128i zero = _mm_setzero_si128();
+		__m128i colours[16];
+		for (int k = 0; k < paletteSize; k++) {
+			int32_t colour;
+			memcpy(&colour, palette + 4 * k, 4);
+			colours[k] = _mm_unpacklo_epi8(_mm_set1_epi32(colour), zero);
+		}
+		__m128i total = zero;
+		for (int i = 0; i < 16; i += 4) {
+			__m128i four = _mm_loadu_si128(
+			    reinterpret_cast<const __m128i*>(texels + 4 * i));
+			__m128i low = _mm_unpacklo_epi8(four, zero);
+			__m128i high = _mm_unpackhi_epi8(four, zero);
+			__m128i best = _mm_set1_epi32(std::numeric_limits<int32_t>::max());
+			__m128i bestIndex = zero;
+			for (int k = 0; k < paletteSize; k++) {
+				__m128i dLow = _mm_sub_epi16(low, colours[k]);
+				__m128i dHigh = _mm_sub_epi16(high, colours[k]);
+				// Pairs of channels per lane, then pairs of lanes per texel
+				__m128 a = _mm_castsi128_ps(_mm_madd_epi16(dLow, dLow));
+				__m128 b = _mm_castsi128_ps(_mm_madd_epi16(dHigh, dHigh));
+				__m128i distance = _mm_add_epi32(
+				    _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+				    _mm_castps_si128(
+				        _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+				__m128i closer = _mm_cmplt_epi32(distance, best);
+				best = _mm_or_si128(_mm_and_si128(closer, distance),
+				                    _mm_andnot_si128(closer, best));
+				bestIndex =
+				    _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)),
+				                 _mm_andnot_si128(closer, bestIndex));
+			}
+			total = _mm_add_epi32(total, best);
+			alignas(16) int32_t lanes[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+			for (int j = 0; j < 4; j++) {
+				indices[i + j] = static_cast<uint8_t>(lanes[j]);
+			}
+		}
+		total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0x4e));
+		total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0xb1));
+		return static_cast<uint32_t>(_mm_cvtsi128_si32(total));
+	}
+#else
+	uint32_t findNearest(const uint8_t* texels, const uint8_t* palette,
+	                     int paletteSize, uint8_t* indices) {
+		uint32_t total = 0;
+		for (int i = 0; i < 16; i++) {
+			uint32_t best = std::numeric_limits<uint32_t>::max();
+			for (int k = 0; k < paletteSize; k++) {
+				uint32_t distance = 0;
+				for (int c = 0; c < 4; c++) {
+					int d = int(texels[4 * i + c]) - palette[4 * k + c];
+					distance += d * d;
+				}
+				if (distance < best) {
+					best = distance;
+					indices[i] = static_cast<uint8_t>(k);
+				}
+			}
+			total += best;
+		}
+		return total;
+	}
+#endif
+
+	// Mean and principal axis of the first channelCount channels, found by
+	// power iteration on the covariance matrix
+	void principalAxis(const uint8_t* texels, int channelCount, float* mean,
+	                   float* axis) {
+		for (int c = 0; c < 4; c++) {
+			mean[c] = 0.0f;
+			axis[c] = 0.0f;
+		}
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < channelCount; c++) {
+				mean[c] += texels[4 * i + c];
+			}
+		}
+		for (int c = 0; c < channelCount; c++) {
+			mean[c] /= 16.0f;
+		}
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++) {
+			float d[4];
+			for (int c = 0; c < channelCount; c++) {
+				d[c] = texels[4 * i + c] - mean[c];
+			}
+			for (int r = 0; r < channelCount; r++) {
+				for (int c = 0; c < channelCount; c++) {
+					covariance[r][c] += d[r] * d[c];
+				}
+			}
+		}
+		// The most varied channel is a good starting guess
+		int start = 0;
+		for (int c = 1; c < channelCount; c++) {
+			if (covariance[c][c] > covariance[start][start]) {
+				start = c;
+			}
+		}
+		if (covariance[start][start] == 0.0f) {
+			return;
+		}
+		float v[4];
+		for (int c = 0; c < channelCount; c++) {
+			v[c] = covariance[start][c];
+		}
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float w[4] = {};
+			float largest = 0.0f;
+			for (int r = 0; r < channelCount; r++) {
+				for (int c = 0; c < channelCount; c++) {
+					w[r] += covariance[r][c] * v[c];
+				}
+				largest = std::max(largest, std::fabs(w[r]));
+			}
+			if (largest == 0.0f) {
+				return;
+			}
+			for (int c = 0; c < channelCount; c++) {
+				v[c] = w[c] / largest;
+			}
+		}
+		float length = 0.0f;
+		for (int c = 0; c < channelCount; c++) {
+			length += v[c] * v[c];
+		}
+		length = std::sqrt(length);
+		for (int c = 0; c < channelCount; c++) {
+			axis[c] = v[c] / length;
+		}
+	}
+
+	// Endpoints at the extremes of the texels projected onto the axis
+	void fitEndpoints(const uint8_t* texels, int channelCount, float* e0,
+	                  float* e1) {
+		float mean[4], axis[4];
+		principalAxis(texels, channelCount, mean, axis);
+		float lowest = 0.0f;
+		float highest = 0.0f;
+		for (int i = 0; i < 16; i++) {
+			float t = 0.0f;
+			for (int c = 0; c < channelCount; c++) {
+				t += (texels[4 * i + c] - mean[c]) * axis[c];
+			}
+			lowest = std::min(lowest, t);
+			highest = std::max(highest, t);
+		}
+		for (int c = 0; c < 4; c++) {
+			e0[c] = std::max(0.0f, std::min(255.0f, mean[c] + lowest * axis[c]));
+			e1[c] =
+			    std::max(0.0f, std::min(255.0f, mean[c] + highest * axis[c]));
+		}
+	}
+
+	// Least squares endpoints for fixed indices
+	bool solveEndpoints(const uint8_t* texels, int channelCount,
+	                    const uint8_t* indices, const float* weights,
+	                    float* e0, float* e1) {
+		float a = 0.0f, b = 0.0f, c = 0.0f;
+		float x0[4] = {}, x1[4] = {};
+		for (int i = 0; i < 16; i++) {
+			float w1 = weights[indices[i]];
+			float w0 = 1.0f - w1;
+			a += w0 * w0;
+			b += w0 * w1;
+			c += w1 * w1;
+			for (int k = 0; k < channelCount; k++) {
+				x0[k] += w0 * texels[4 * i + k];
+				x1[k] += w1 * texels[4 * i + k];
+			}
+		}
+		float determinant = a * c - b * b;
+		if (std::fabs(determinant) < 1e-6f) {
+			return false;
+		}
+		for (int k = 0; k < channelCount; k++) {
+			e0[k] = std::max(
+			    0.0f, std::min(255.0f, (c * x0[k] - b * x1[k]) / determinant));
+			e1[k] = std::max(
+			    0.0f, std::min(255.0f, (a * x1[k] - b * x0[k]) / determinant));
+		}
+		return true;
+	}
+
+	uint16_t packRGB565(const float* colour) {
+		auto quantize = [](float value, int maximum) {
+			return static_cast<uint16_t>(value * maximum / 255.0f + 0.5f);
+		};
+		return static_cast<uint16_t>(quantize(colour[0], 31) << 11 |
+		                             quantize(colour[1], 63) << 5 |
+		                             quantize(colour[2], 31));
+	}
+
+	void unpackRGB565(uint16_t packed, uint8_t* colour) {
+		uint32_t r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+		colour[0] = static_cast<uint8_t>(r << 3 | r >> 2);
+		colour[1] = static_cast<uint8_t>(g << 2 | g >> 4);
+		colour[2] = static_cast<uint8_t>(b << 3 | b >> 2);
+		colour[3] = 0;
+	}
+
+	uint32_t evaluateBC1(const uint8_t* texels, uint16_t c0, uint16_t c1,
+	                     uint8_t* indices) {
+		uint8_t palette[16];
+		unpackRGB565(c0, palette);
+		unpackRGB565(c1, palette + 4);
+		for (int c = 0; c < 4; c++) {
+			palette[8 + c] = static_cast<uint8_t>(
+			    (2 * palette[c] + palette[4 + c]) / 3);
+			palette[12 + c] = static_cast<uint8_t>(
+			    (palette[c] + 2 * palette[4 + c]) / 3);
+		}
+		return findNearest(texels, palette, 4, indices);
+	}
+
+	void encodeBC1Block(const uint8_t* block, uint8_t* out) {
+		// Alpha is ignored, so zero it to match the palette
+		uint8_t texels[64];
+		for (int i = 0; i < 16; i++) {
+			memcpy(texels + 4 * i, block + 4 * i, 3);
+			texels[4 * i + 3] = 0;
+		}
+		float e0[4], e1[4];
+		fitEndpoints(texels, 3, e0, e1);
+		uint16_t c0 = packRGB565(e1);
+		uint16_t c1 = packRGB565(e0);
+		uint8_t indices[16], candidate[16];
+		uint32_t error = evaluateBC1(texels, c0, c1, indices);
+		for (int pass = 0; pass < REFINE_PASSES && error > 0; pass++) {
+			if (!solveEndpoints(texels, 3, indices, BC1_WEIGHTS, e0, e1)) {
+				break;
+			}
+			uint16_t n0 = packRGB565(e0);
+			uint16_t n1 = packRGB565(e1);
+			uint32_t candidateError = evaluateBC1(texels, n0, n1, candidate);
+			if (candidateError >= error) {
+				break;
+			}
+			error = candidateError;
+			c0 = n0;
+			c1 = n1;
+			memcpy(indices, candidate, sizeof(indices));
+		}
+		// c0 > c1 selects the four colour mode
+		if (c0 < c1) {
+			std::swap(c0, c1);
+			for (auto& index : indices) {
+				index ^= 1;
+			}
+		}
+		uint32_t selectors = 0;
+		if (c0 != c1) {
+			for (int i = 0; i < 16; i++) {
+				selectors |= uint32_t(indices[i]) << (2 * i);
+			}
+		}
+		memcpy(out, &c0, 2);
+		memcpy(out + 2, &c1, 2);
+		memcpy(out + 4, &selectors, 4);
+	}
+
+	// Seven bits per channel plus a p-bit shared by the whole endpoint,
+	// returned as the 8-bit values they decode to
+	void quantizeBC7Endpoint(const float* endpoint, uint8_t* out) {
+		float bestError = std::numeric_limits<float>::max();
+		for (int p = 0; p < 2; p++) {
+			uint8_t values[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; c++) {
+				int q = static_cast<int>((endpoint[c] - p) * 0.5f + 0.5f);
+				q = std::max(0, std::min(127, q));
+				values[c] = static_cast<uint8_t>(q << 1 | p);
+				float d = values[c] - endpoint[c];
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				memcpy(out, values, 4);
+			}
+		}
+	}
+
+	uint32_t evaluateBC7(const uint8_t* texels, const uint8_t* e0,
+	                     const uint8_t* e1, uint8_t* indices) {
+		uint8_t palette[64];
+		for (int k = 0; k < 16; k++) {
+			for (int c = 0; c < 4; c++) {
+				palette[4 * k + c] = static_cast<uint8_t>(
+				    (e0[c] * (64 - BC7_WEIGHTS[k]) + e1[c] * BC7_WEIGHTS[k] +
+				     32) >>
+				    6);
+			}
+		}
+		return findNearest(texels, palette, 16, indices);
+	}
+
+	void putBits(uint64_t* bits, int& position, uint32_t value, int count) {
+		int shift = position & 63;
+		bits[position >> 6] |= uint64_t(value) << shift;
+		if (shift + count > 64) {
+			bits[(position >> 6) + 1] |= uint64_t(value) >> (64 - shift);
+		}
+		position += count;
+	}
+
+	void encodeBC7Block(const uint8_t* texels, uint8_t* out) {
+		float weights[16];
+		for (int k = 0; k < 16; k++) {
+			weights[k] = BC7_WEIGHTS[k] / 64.0f;
+		}
+		float e0[4], e1[4];
+		fitEndpoints(texels, 4, e0, e1);
+		uint8_t q0[4], q1[4];
+		quantizeBC7Endpoint(e0, q0);
+		quantizeBC7Endpoint(e1, q1);
+		uint8_t indices[16], candidate[16];
+		uint32_t error = evaluateBC7(texels, q0, q1, indices);
+		for (int pass = 0; pass < REFINE_PASSES && error > 0; pass++) {
+			if (!solveEndpoints(texels, 4, indices, weights, e0, e1)) {
+				break;
+			}
+			uint8_t n0[4], n1[4];
+			quantizeBC7Endpoint(e0, n0);
+			quantizeBC7Endpoint(e1, n1);
+			uint32_t candidateError = evaluateBC7(texels, n0, n1, candidate);
+			if (candidateError >= error) {
+				break;
+			}
+			error = candidateError;
+			memcpy(q0, n0, 4);
+			memcpy(q1, n1, 4);
+			memcpy(indices, candidate, sizeof(indices));
+		}
+		// The first index is stored without its top bit
+		if (indices[0] & 8) {
+			std::swap(q0, q1);
+			for (auto& index : indices) {
+				index = 15 - index;
+			}
+		}
+		uint64_t bits[2] = {};
+		int position = 0;
+		putBits(bits, position, 1 << 6, 7);
+		for (int c = 0; c < 4; c++) {
+			putBits(bits, position, q0[c] >> 1, 7);
+			putBits(bits, position, q1[c] >> 1, 7);
+		}
+		putBits(bits, position, q0[0] & 1, 1);
+		putBits(bits, position, q1[0] & 1, 1);
+		putBits(bits, position, indices[0], 3);
+		for (int i = 1; i < 16; i++) {
+			putBits(bits, position, indices[i], 4);
+		}
+		memcpy(out, bits, 16);
+	}
+
+	template<typename F>
+	void encodeBlocks(const uint8_t* pixels, uint32_t width, uint32_t height,
+	                  uint8_t* blocks, size_t blockSize, F encodeBlock) {
+		uint32_t blocksX = (width + 3) / 4;
+		uint32_t blocksY = (height + 3) / 4;
+		size_t threadCount = 1;
+		if (size_t(blocksX) * blocksY >= BC_PARALLEL_THRESHOLD) {
+			threadCount = getParallelism();
+		}
+		parallelFor(blocksY, threadCount, [&](size_t begin, size_t end) {
+			uint8_t block[64];
+			for (size_t y = begin; y < end; y++) {
+				for (uint32_t x = 0; x < blocksX; x++) {
+					fetchBlock(pixels, width, height, x,
+					           static_cast<uint32_t>(y), block);
+					encodeBlock(block,
+					            blocks + (y * blocksX + x) * blockSize);
+				}
+			}
+		});
+	}
+} // namespace
+
+size_t getBlockCompressedSize(uint32_t width, uint32_t height,
+                              size_t blockSize) {
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+void encodeBC1(const uint8_t* pixels, uint32_t width, uint32_t height,
+               uint8_t* blocks) {
+	encodeBlocks(pixels, width, height, blocks, BC1_BLOCK_SIZE,
+	             encodeBC1Block);
+}
+
+void encodeBC7(const uint8_t* pixels, uint32_t width, uint32_t height,
+               uint8_t* blocks) {
+	encodeBlocks(pixels, width, height, blocks, BC7_BLOCK_SIZE,
+	             encodeBC7Block);
+}
@@ -0,0 +1,179 @@
+#include "capabilities.h"
+#include "include.h"
+#include "instance.h"
+#include "surface.h"
+#include "util.h"
+
+namespace {
+	uint64_t getTypeRank(VkPhysicalDeviceType type) {
+		switch (type) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+			return 4;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+			return 3;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+			return 2;
+		case VK_PHYSICAL_DEVICE_TYPE_OTHER:
+			return 1;
+		default:
+			// Software rasterizers only when nothing else will do
+			return 0;
+		}
+	}
+} // namespace
+
+void DeviceCapabilities::query(Instance* instance, VkPhysicalDevice device,
+                               uint32_t deviceIndex) {
+	physical = device;
+	index = deviceIndex;
+	vkGetPhysicalDeviceProperties(device, &properties);
+	vkGetPhysicalDeviceFeatures(device, &features);
+	vkGetPhysicalDeviceMemoryProperties(device, &memory);
+
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+	                                     nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+	                                     availableExtensions.data());
+	extensions.clear();
+	for (const auto& extension : availableExtensions) {
+		extensions.insert(extension.extensionName);
+	}
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+	                                         nullptr);
+	std::vector<VkQueueFamilyProperties> families(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+	                                         families.data());
+	queueFamilies = QueueFamilyIndices();
+	VkSurfaceKHR surface = instance->surface->surface;
+	for (uint32_t i = 0; i < queueFamilyCount; i++) {
+		bool graphics = families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT;
+		VkBool32 present = VK_FALSE;
+		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present);
+		// One family doing both saves sharing the swap chain images
+		if (graphics && present) {
+			queueFamilies.graphicsFamily = i;
+			queueFamilies.presentFamily = i;
+			break;
+		}
+		if (graphics && !queueFamilies.graphicsFamily.has_value()) {
+			queueFamilies.graphicsFamily = i;
+		}
+		if (present && !queueFamilies.presentFamily.has_value()) {
+			queueFamilies.presentFamily = i;
+		}
+	}
+
+	surfaceFormats.clear();
+	presentModes.clear();
+	if (hasExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
+		uint32_t formatCount = 0;
+		vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount,
+		                                     nullptr);
+		surfaceFormats.resize(formatCount);
+		vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount,
+		                                     surfaceFormats.data());
+		uint32_t presentModeCount = 0;
+		vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface,
+		                                          &presentModeCount, nullptr);
+		presentModes.resize(presentModeCount);
+		vkGetPhysicalDeviceSurfacePresentModesKHR(
+		    device, surface, &presentModeCount, presentModes.data());
+	}
+
+	drawIndirectCount = hasExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	timelineSemaphore = false;
+	descriptorIndexing = false;
+	memoryBudget = false;
+	if (instance->physicalDeviceProperties2) {
+		queryExtendedFeatures(instance);
+	}
+}
+
+void DeviceCapabilities::queryExtendedFeatures(Instance* instance) {
+	auto getFeatures2 =
+	    (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(
+	        instance->instance, "vkGetPhysicalDeviceFeatures2KHR");
+	if (getFeatures2 == nullptr) {
+		return;
+	}
+	VkPhysicalDeviceFeatures2 features2 = {};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+	timelineFeatures.sType =
+	    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {};
+	indexingFeatures.sType =
+	    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+	// Only structures of supported extensions may be chained
+	bool timelineExtension =
+	    hasExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	bool indexingExtension =
+	    hasExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+	    hasExtension(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+	void** next = &features2.pNext;
+	if (timelineExtension) {
+		*next = &timelineFeatures;
+		next = &timelineFeatures.pNext;
+	}
+	if (indexingExtension) {
+		*next = &indexingFeatures;
+		next = &indexingFeatures.pNext;
+	}
+	getFeatures2(physical, &features2);
+	timelineSemaphore = timelineExtension && timelineFeatures.timelineSemaphore;
+	descriptorIndexing =
+	    indexingExtension && indexingFeatures.runtimeDescriptorArray &&
+	    indexingFeatures.descriptorBindingPartiallyBound &&
+	    indexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+	memoryBudget = hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+}
+
+bool DeviceCapabilities::hasExtension(const char* name) const {
+	return extensions.count(name) > 0;
+}
+
+bool DeviceCapabilities::isSuitable() const {
+	for (const char* extension : deviceExtensions) {
+		if (!hasExtension(extension)) {
+			return false;
+		}
+	}
+	return queueFamilies.isComplete() && !surfaceFormats.empty() &&
+	       !presentModes.empty() && features.samplerAnisotropy;
+}
+
+bool DeviceCapabilities::matches(const std::string& selector) const {
+	bool numeric = !selector.empty() &&
+	               std::all_of(selector.begin(), selector.end(),
+	                           [](char c) { return c >= '0' && c <= '9'; });
+	if (numeric) {
+		return std::stoul(selector) == index;
+	}
+	return std::string(properties.deviceName).find(selector) !=
+	       std::string::npos;
+}
+
+VkDeviceSize DeviceCapabilities::getDeviceLocalSize() const {
+	VkDeviceSize size = 0;
+	for (uint32_t i = 0; i < memory.memoryHeapCount; i++) {
+		if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			size += memory.memoryHeaps[i].size;
+		}
+	}
+	return size;
+}
+
+uint64_t DeviceCapabilities::getScore() const {
+	uint64_t score = getTypeRank(properties.deviceType) << 48;
+	// In MiB, which leaves room below for the tie breakers
+	score += std::min<uint64_t>(getDeviceLocalSize() >> 20, 0xffffff) << 24;
+	score += std::min<uint64_t>(properties.limits.maxImageDimension2D, 0xffff)
+	         << 4;
+	score += features.multiDrawIndirect + features.textureCompressionBC +
+	         drawIndirectCount + memoryBudget;
+	return score;
+}
@@ -1,22 +1,30 @@
 #include "commander.h"
+#include "culling.h"
 #include "descriptor.h"
 #include "device.h"
 #include "include.h"
 #include "instance.h"
 #include "model.h"
+#include "occlusion.h"
+#include "overdraw.h"
+#include "pipelinestats.h"
+#include "readback.h"
 #include "renderer.h"
 #include "surface.h"
 #include "sync.h"
 #include "texture.h"
+#include "texturestream.h"
+#include "trace.h"
+#include "uniformring.h"
 #include "util.h"
 
 void Commander::createPool(Instance* instance) {
-	QueueFamilyIndices queueFamilyIndices =
-	    findQueueFamilies(instance, instance->device->physical);
+	const QueueFamilyIndices& queueFamilyIndices =
+	    instance->device->capabilities.queueFamilies;
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-	poolInfo.flags = 0; // Optional
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 	if (vkCreateCommandPool(instance->device->logical, &poolInfo, nullptr,
 	                        &pool) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create command pool!");
@@ -34,41 +42,148 @@ void Commander::createBuffers(Instance* instance) {
 	                             buffers.data()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate command buffers!");
 	}
-	for (size_t i = 0; i < buffers.size(); i++) {
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		if (vkBeginCommandBuffer(buffers[i], &beginInfo) != VK_SUCCESS) {
-			throw std::runtime_error(
-			    "failed to begin recording command buffer!");
-		}
-		VkRenderPassBeginInfo renderPassInfo =
-		    instance->renderer->getRenderPassInfo(instance, i);
-		std::array<VkClearValue, 2> clearValues = {};
-		clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-		clearValues[1].depthStencil = {1.0f, 0};
-		renderPassInfo.clearValueCount =
-		    static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
-		vkCmdBeginRenderPass(buffers[i], &renderPassInfo,
-		                     VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-		                  instance->renderer->graphicsPipeline);
-		VkBuffer vertexBuffers[] = {instance->descriptor->vertexBuffer};
-		VkDeviceSize offsets[] = {0};
-		vkCmdBindVertexBuffers(buffers[i], 0, 1, vertexBuffers, offsets);
-		vkCmdBindIndexBuffer(buffers[i], instance->descriptor->indexBuffer, 0,
-		                     VK_INDEX_TYPE_UINT32);
-		vkCmdBindDescriptorSets(buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-		                        instance->renderer->pipelineLayout, 0, 1,
-		                        &instance->descriptor->descriptorSets[i], 0,
-		                        nullptr);
-		vkCmdDrawIndexed(buffers[i], instance->descriptor->nIndices, 1, 0, 0,
-		                 0);
-		vkCmdEndRenderPass(buffers[i]);
-		if (vkEndCommandBuffer(buffers[i]) != VK_SUCCESS) {
+}
+
+void Commander::recordBuffer(Instance* instance, uint32_t imageIndex) {
+	TRACE_ZONE("Record");
+	VkCommandBuffer buffer = buffers[imageIndex];
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(buffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording command buffer!");
+	}
+	if (instance->statistics->enabled) {
+		instance->statistics->beginFrame(buffer, instance->currentFrame);
+	}
+	instance->streamer->record(instance, buffer);
+	Renderer* renderer = instance->renderer;
+	VkFramebuffer framebuffer = renderer->swapChainFramebuffers[imageIndex];
+	if (!instance->models[0].meshResident) {
+		// Present cleared frames while the model is still loading
+		beginRenderPass(instance, buffer, renderer->renderPass, framebuffer);
+		endRenderPass(instance, buffer);
+		if (vkEndCommandBuffer(buffer) != VK_SUCCESS) {
 			throw std::runtime_error("failed to record command buffer!");
 		}
+		return;
+	}
+	const Descriptor* descriptor = instance->descriptor;
+	glm::mat4 modelView = descriptor->view * descriptor->model;
+	const LodLevel& lod = instance->models[0].selectLod(
+	    modelView, descriptor->proj[1][1],
+	    static_cast<float>(instance->surface->getExtents().height));
+	Frustum frustum = extractFrustum(descriptor->mvp);
+	glm::vec3 cameraPos = glm::vec3(glm::inverse(modelView)[3]);
+	Occlusion* occlusion = instance->occlusion;
+	if (occlusion->enabled) {
+		occlusion->updateCullData(instance, imageIndex, lod, frustum,
+		                          cameraPos);
+		for (uint32_t pass = 0; pass < 2; pass++) {
+			occlusion->cull(buffer, imageIndex, pass, lod);
+			beginRenderPass(instance, buffer,
+			                pass == 0 ? renderer->renderPass
+			                          : renderer->renderPassLoad,
+			                framebuffer);
+			bindGeometry(instance, buffer);
+			if (occlusion->compactDraws) {
+				instance->device->cmdDrawIndexedIndirectCount(
+				    buffer, occlusion->drawBuffer,
+				    occlusion->getDrawOffset(pass), occlusion->countBuffer,
+				    occlusion->getCountOffset(pass), lod.meshletCount,
+				    sizeof(VkDrawIndexedIndirectCommand));
+			} else {
+				vkCmdDrawIndexedIndirect(buffer, occlusion->drawBuffer,
+				                         occlusion->getDrawOffset(pass),
+				                         lod.meshletCount,
+				                         sizeof(VkDrawIndexedIndirectCommand));
+			}
+			endRenderPass(instance, buffer);
+			if (pass == 0) {
+				occlusion->buildPyramid(instance, buffer);
+			}
+		}
+	} else {
+		OverdrawView* overdraw = instance->overdraw;
+		if (overdraw->enabled) {
+			beginRenderPass(instance, buffer, overdraw->countPass,
+			                overdraw->countFramebuffer);
+		} else {
+			beginRenderPass(instance, buffer, renderer->renderPass,
+			                framebuffer);
+		}
+		bindGeometry(instance, buffer);
+		cullMeshlets(instance->models[0].meshlets, lod.firstMeshlet,
+		             lod.meshletCount, frustum, cameraPos, draws);
+		for (const auto& draw : draws) {
+			vkCmdDrawIndexed(buffer, draw.indexCount, 1, draw.firstIndex, 0,
+			                 0);
+		}
+		endRenderPass(instance, buffer);
+		if (overdraw->enabled) {
+			overdraw->display(instance, buffer, imageIndex);
+		}
 	}
+	if (!instance->captureDirectory.empty()) {
+		captureFrame(instance, buffer, imageIndex);
+	}
+	if (vkEndCommandBuffer(buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer!");
+	}
+}
+
+void Commander::captureFrame(Instance* instance, VkCommandBuffer buffer,
+                             uint32_t imageIndex) {
+	ReadbackRing* readback = instance->readback;
+	char name[32];
+	snprintf(name, sizeof(name), "/frame_%06zu.%s",
+	         readback->getCaptureCount(), instance->captureRaw ? "raw" : "png");
+	readback->capture(buffer, instance->surface->swapChainImages[imageIndex],
+	                  VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, instance->currentFrame,
+	                  instance->captureDirectory + name);
+}
+
+void Commander::beginRenderPass(Instance* instance, VkCommandBuffer buffer,
+                                VkRenderPass renderPass,
+                                VkFramebuffer framebuffer) {
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = framebuffer;
+	renderPassInfo.renderArea.extent = instance->surface->getExtents();
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+	clearValues[1].depthStencil = {1.0f, 0};
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+	if (instance->statistics->enabled) {
+		instance->statistics->beginPass(buffer, instance->currentFrame);
+	}
+	vkCmdBeginRenderPass(buffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void Commander::endRenderPass(Instance* instance, VkCommandBuffer buffer) {
+	vkCmdEndRenderPass(buffer);
+	if (instance->statistics->enabled) {
+		instance->statistics->endPass(buffer, instance->currentFrame);
+	}
+}
+
+void Commander::bindGeometry(Instance* instance, VkCommandBuffer buffer) {
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	                  instance->renderer->graphicsPipeline);
+	VkBuffer vertexBuffers[] = {instance->descriptor->vertexBuffer};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(buffer, 0, 1, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(buffer, instance->descriptor->indexBuffer, 0,
+	                     instance->descriptor->indexType);
+	uint32_t objectOffset =
+	    instance->uniformRing->push(instance->descriptor->object);
+	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	                        instance->renderer->pipelineLayout, 0, 1,
+	                        &instance->descriptor->frameSet, 1,
+	                        &objectOffset);
+	pushConstants(instance, buffer);
 }
 
 VkCommandBuffer Commander::beginSingleTimeCommands(Device* device) {
@@ -112,6 +227,16 @@ void Commander::transitionImageLayout(Device* device, VkImage image,
                                       VkImageLayout newLayout,
                                       uint32_t mipLevels) {
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands(device);
+	transitionImageLayout(commandBuffer, image, format, oldLayout, newLayout,
+	                      mipLevels);
+	endSingleTimeCommands(device, commandBuffer);
+}
+
+void Commander::transitionImageLayout(VkCommandBuffer commandBuffer,
+                                      VkImage image, VkFormat format,
+                                      VkImageLayout oldLayout,
+                                      VkImageLayout newLayout,
+                                      uint32_t mipLevels) {
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = oldLayout;
@@ -145,6 +270,12 @@ void Commander::transitionImageLayout(Device* device, VkImage image,
 		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	} else if (oldLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+	           newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		sourceStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 	} else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
 	           newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
 		barrier.srcAccessMask = 0;
@@ -152,20 +283,25 @@ void Commander::transitionImageLayout(Device* device, VkImage image,
 		                         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
 		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	} else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+	           newLayout == VK_IMAGE_LAYOUT_GENERAL) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask =
+		    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 	} else {
 		throw std::invalid_argument("unsupported layout transition!");
 	}
 	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0,
 	                     nullptr, 0, nullptr, 1, &barrier);
-	endSingleTimeCommands(device, commandBuffer);
 }
 
-void Commander::pushConstants(Instance* instance) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands(instance->device);
+void Commander::pushConstants(Instance* instance,
+                              VkCommandBuffer commandBuffer) {
     vkCmdPushConstants(commandBuffer, instance->renderer->pipelineLayout,
         VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(UniformBufferObject),
         (void*)&instance->descriptor->ubo);
-	endSingleTimeCommands(instance->device, commandBuffer);
 }
 
 void Commander::copyBuffer(Device* device, VkBuffer srcBuffer,
@@ -177,93 +313,11 @@ void Commander::copyBuffer(Device* device, VkBuffer srcBuffer,
 	endSingleTimeCommands(device, commandBuffer);
 }
 
-void Commander::copyBufferToImage(Device* device, VkBuffer buffer,
-                                  VkImage image, uint32_t width,
-                                  uint32_t height) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands(device);
-	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.imageOffset = {0, 0, 0};
-	region.imageExtent = {width, height, 1};
+void Commander::copyBufferToImage(
+    VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image,
+    const std::vector<VkBufferImageCopy>& regions) {
 	vkCmdCopyBufferToImage(commandBuffer, buffer, image,
-	                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-	endSingleTimeCommands(device, commandBuffer);
-}
-
-void Commander::generateMipmaps(Device* device, VkImage image,
-                                VkFormat imageFormat, int32_t texWidth,
-                                int32_t texHeight, uint32_t mipLevels) {
-	VkFormatProperties formatProperties;
-	vkGetPhysicalDeviceFormatProperties(device->physical, imageFormat,
-	                                    &formatProperties);
-	if (!(formatProperties.optimalTilingFeatures &
-	      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-		throw std::runtime_error(
-		    "texture image format does not support linear blitting!");
-	}
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands(device);
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.image = image;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.levelCount = 1;
-	int32_t mipWidth = texWidth;
-	int32_t mipHeight = texHeight;
-	for (uint32_t i = 1; i < mipLevels; i++) {
-		barrier.subresourceRange.baseMipLevel = i - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-		                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
-		                     nullptr, 1, &barrier);
-		VkImageBlit blit = {};
-		blit.srcOffsets[0] = {0, 0, 0};
-		blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
-		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.srcSubresource.mipLevel = i - 1;
-		blit.srcSubresource.baseArrayLayer = 0;
-		blit.srcSubresource.layerCount = 1;
-		blit.dstOffsets[0] = {0, 0, 0};
-		blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth / 2 : 1,
-		                      mipHeight > 1 ? mipHeight / 2 : 1, 1};
-		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.dstSubresource.mipLevel = i;
-		blit.dstSubresource.baseArrayLayer = 0;
-		blit.dstSubresource.layerCount = 1;
-		vkCmdBlitImage(
-		    commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
-		    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-		                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
-		                     nullptr, 0, nullptr, 1, &barrier);
-		if (mipWidth > 1)
-			mipWidth /= 2;
-		if (mipHeight > 1)
-			mipHeight /= 2;
-	}
-	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-	                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr,
-	                     0, nullptr, 1, &barrier);
-	endSingleTimeCommands(device, commandBuffer);
+	                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	                       static_cast<uint32_t>(regions.size()),
+	                       regions.data());
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "culling.h"
+#include "include.h"
+#include "meshlet.h"
+#include "util.h"
+
+Frustum extractFrustum(const glm::mat4& mvp) {
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+	}
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	// Depth runs from 0 to 1 (GLM_FORCE_DEPTH_ZERO_TO_ONE)
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+	for (auto& plane : frustum.planes) {
+		plane = plane / glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+bool sphereInFrustum(const Frustum& frustum, glm::vec3 center, float radius) {
+	for (const auto& plane : frustum.planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool coneBackfacing(const Meshlet& meshlet, glm::vec3 cameraPos) {
+	glm::vec3 view = meshlet.coneApex - cameraPos;
+	float distance = glm::length(view);
+	return glm::dot(view, meshlet.coneAxis) >= meshlet.coneCutoff * distance;
+}
+
+uint32_t cullMeshlets(const std::vector<Meshlet>& meshlets,
+                      uint32_t firstMeshlet, uint32_t meshletCount,
+                      const Frustum& frustum, glm::vec3 cameraPos,
+                      std::vector<DrawRange>& draws) {
+	draws.clear();
+	uint32_t visible = 0;
+	for (uint32_t i = firstMeshlet; i < firstMeshlet + meshletCount; i++) {
+		const Meshlet& meshlet = meshlets[i];
+		if (!sphereInFrustum(frustum, meshlet.center, meshlet.radius) ||
+		    coneBackfacing(meshlet, cameraPos)) {
+			continue;
+		}
+		visible++;
+		// Neighbouring survivors are contiguous in the index buffer
+		if (!draws.empty() && draws.back().firstIndex +
+		                              draws.back().indexCount ==
+		                          meshlet.firstIndex) {
+			draws.back().indexCount += meshlet.indexCount;
+		} else {
+			draws.push_back({meshlet.firstIndex, meshlet.indexCount});
+		}
+	}
+	return visible;
+}
@@ -0,0 +1,133 @@
+#include "dedup.h"
+#include "include.h"
+#include "threadpool.h"
+#include "util.h"
+
+#include <atomic>
+
+namespace {
+	constexpr uint32_t EMPTY_SLOT = ~0u;
+
+	struct Slot {
+		uint32_t id;
+		// Upper hash bits, checked before comparing whole vertices
+		uint32_t tag;
+	};
+
+	uint64_t hashVertex(const Vertex& vertex) {
+		return hashBytes(&vertex, sizeof(vertex), 0);
+	}
+
+	size_t nextPowerOfTwo(size_t value) {
+		size_t result = 1;
+		while (result < value) {
+			result <<= 1;
+		}
+		return result;
+	}
+
+	// Assigns shard-local ids to the corners listed in order
+	void deduplicateShard(const std::vector<Vertex>& corners,
+	                      const std::vector<uint64_t>& hashes,
+	                      const uint32_t* order, size_t count,
+	                      std::vector<uint32_t>& unique, uint32_t* localIds) {
+		// Every corner could be unique, so this keeps the load under half
+		size_t mask = nextPowerOfTwo(count * 2) - 1;
+		std::vector<Slot> slots(mask + 1, {EMPTY_SLOT, 0});
+		unique.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			uint32_t corner = order[i];
+			uint64_t hash = hashes[corner];
+			uint32_t tag = static_cast<uint32_t>(hash >> 32);
+			size_t slot = hash & mask;
+			while (true) {
+				Slot& entry = slots[slot];
+				if (entry.id == EMPTY_SLOT) {
+					entry.id = static_cast<uint32_t>(unique.size());
+					entry.tag = tag;
+					unique.push_back(corner);
+					localIds[corner] = entry.id;
+					break;
+				}
+				if (entry.tag == tag &&
+				    memcmp(&corners[unique[entry.id]], &corners[corner],
+				           sizeof(Vertex)) == 0) {
+					localIds[corner] = entry.id;
+					break;
+				}
+				slot = (slot + 1) & mask;
+			}
+		}
+	}
+} // namespace
+
+void deduplicateVertices(const std::vector<Vertex>& corners,
+                         std::vector<Vertex>& vertices,
+                         std::vector<uint32_t>& indices) {
+	size_t count = corners.size();
+	size_t threadCount = 1;
+	uint32_t shardBits = 0;
+	if (count >= DEDUP_PARALLEL_THRESHOLD) {
+		threadCount = getParallelism();
+		// Several shards per thread evens out uneven shard sizes
+		while ((size_t(1) << shardBits) < threadCount * 4) {
+			shardBits++;
+		}
+	}
+	size_t shardCount = size_t(1) << shardBits;
+	// The table uses the low hash bits, shards take the top ones
+	auto shardOf = [shardBits](uint64_t hash) {
+		return shardBits == 0 ? 0 : static_cast<size_t>(hash >> (64 - shardBits));
+	};
+
+	std::vector<uint64_t> hashes(count);
+	parallelFor(count, threadCount, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			hashes[i] = hashVertex(corners[i]);
+		}
+	});
+
+	// Stable counting sort keeps first-use order within a shard
+	std::vector<size_t> shardStart(shardCount + 1, 0);
+	for (size_t i = 0; i < count; i++) {
+		shardStart[shardOf(hashes[i]) + 1]++;
+	}
+	for (size_t s = 0; s < shardCount; s++) {
+		shardStart[s + 1] += shardStart[s];
+	}
+	std::vector<uint32_t> order(count);
+	std::vector<size_t> fill(shardStart.begin(), shardStart.end() - 1);
+	for (size_t i = 0; i < count; i++) {
+		order[fill[shardOf(hashes[i])]++] = static_cast<uint32_t>(i);
+	}
+
+	indices.resize(count);
+	std::vector<std::vector<uint32_t>> unique(shardCount);
+	std::atomic<size_t> nextShard(0);
+	parallelFor(threadCount, threadCount, [&](size_t, size_t) {
+		for (size_t s = nextShard++; s < shardCount; s = nextShard++) {
+			deduplicateShard(corners, hashes, order.data() + shardStart[s],
+			                 shardStart[s + 1] - shardStart[s], unique[s],
+			                 indices.data());
+		}
+	});
+
+	std::vector<uint32_t> shardBase(shardCount + 1, 0);
+	for (size_t s = 0; s < shardCount; s++) {
+		shardBase[s + 1] =
+		    shardBase[s] + static_cast<uint32_t>(unique[s].size());
+	}
+	vertices.resize(shardBase[shardCount]);
+	parallelFor(shardCount, threadCount, [&](size_t begin, size_t end) {
+		for (size_t s = begin; s < end; s++) {
+			for (size_t j = 0; j < unique[s].size(); j++) {
+				vertices[shardBase[s] + j] = corners[unique[s][j]];
+			}
+		}
+	});
+	parallelFor(count, threadCount, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			indices[i] += shardBase[shardOf(hashes[i])];
+		}
+	});
+}
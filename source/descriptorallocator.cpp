@@ -0,0 +1,214 @@
+#include "descriptorallocator.h"
+#include "device.h"
+#include "include.h"
+#include "util.h"
+
+namespace {
+	// Descriptors of each type per set in a pool
+	const std::pair<VkDescriptorType, uint32_t> POOL_RATIOS[] = {
+	    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+	    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+	    {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2},
+	    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4},
+	    {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+	};
+
+	void hashCombine(size_t& seed, size_t value) {
+		seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+
+	template<typename T>
+	size_t hashHandle(T handle) {
+		return std::hash<uint64_t>()((uint64_t)handle);
+	}
+
+	size_t hashSet(VkDescriptorSetLayout layout,
+	               const std::vector<DescriptorBinding>& bindings) {
+		size_t seed = hashHandle(layout);
+		for (const auto& binding : bindings) {
+			hashCombine(seed, binding.binding);
+			hashCombine(seed, binding.type);
+			hashCombine(seed, hashHandle(binding.buffer.buffer));
+			hashCombine(seed, binding.buffer.offset);
+			hashCombine(seed, binding.buffer.range);
+			hashCombine(seed, hashHandle(binding.image.sampler));
+			hashCombine(seed, hashHandle(binding.image.imageView));
+			hashCombine(seed, binding.image.imageLayout);
+		}
+		return seed;
+	}
+
+	bool sameBindings(const std::vector<DescriptorBinding>& a,
+	                  const std::vector<DescriptorBinding>& b) {
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); i++) {
+			if (a[i].binding != b[i].binding || a[i].type != b[i].type ||
+			    a[i].buffer.buffer != b[i].buffer.buffer ||
+			    a[i].buffer.offset != b[i].buffer.offset ||
+			    a[i].buffer.range != b[i].buffer.range ||
+			    a[i].image.sampler != b[i].image.sampler ||
+			    a[i].image.imageView != b[i].image.imageView ||
+			    a[i].image.imageLayout != b[i].image.imageLayout) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool isImageType(VkDescriptorType type) {
+		return type == VK_DESCRIPTOR_TYPE_SAMPLER ||
+		       type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+		       type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+		       type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+		       type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	}
+
+	VkDescriptorPool createPool(Device* device) {
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (const auto& ratio : POOL_RATIOS) {
+			poolSizes.push_back({ratio.first,
+			                     ratio.second * DESCRIPTOR_POOL_SETS});
+		}
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = DESCRIPTOR_POOL_SETS;
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool(device->logical, &poolInfo, nullptr,
+		                           &pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create descriptor pool!");
+		}
+		return pool;
+	}
+} // namespace
+
+DescriptorBinding bufferBinding(uint32_t binding, VkDescriptorType type,
+                                VkBuffer buffer, VkDeviceSize offset,
+                                VkDeviceSize range) {
+	DescriptorBinding result = {};
+	result.binding = binding;
+	result.type = type;
+	result.buffer = {buffer, offset, range};
+	return result;
+}
+
+DescriptorBinding imageBinding(uint32_t binding, VkDescriptorType type,
+                               VkSampler sampler, VkImageView view,
+                               VkImageLayout layout) {
+	DescriptorBinding result = {};
+	result.binding = binding;
+	result.type = type;
+	result.image = {sampler, view, layout};
+	return result;
+}
+
+void DescriptorAllocator::create(Device* device, uint32_t frameCount) {
+	this->device = device;
+	framePools.resize(frameCount);
+}
+
+VkDescriptorSet DescriptorAllocator::getSet(
+    VkDescriptorSetLayout layout,
+    const std::vector<DescriptorBinding>& bindings) {
+	std::vector<CachedSet>& bucket = cache[hashSet(layout, bindings)];
+	for (const auto& cached : bucket) {
+		if (cached.layout == layout && sameBindings(cached.bindings, bindings)) {
+			return cached.set;
+		}
+	}
+	VkDescriptorSet set = allocate(cachedPools, layout);
+	write(set, bindings);
+	bucket.push_back({layout, bindings, set});
+	return set;
+}
+
+void DescriptorAllocator::clearCache() {
+	reset(cachedPools);
+	cache.clear();
+}
+
+VkDescriptorSet DescriptorAllocator::allocateFrameSet(
+    uint32_t frame, VkDescriptorSetLayout layout,
+    const std::vector<DescriptorBinding>& bindings) {
+	VkDescriptorSet set = allocate(framePools[frame], layout);
+	write(set, bindings);
+	return set;
+}
+
+void DescriptorAllocator::resetFrame(uint32_t frame) {
+	reset(framePools[frame]);
+}
+
+void DescriptorAllocator::destroy() {
+	destroy(cachedPools);
+	for (auto& list : framePools) {
+		destroy(list);
+	}
+	cache.clear();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(PoolList& list,
+                                              VkDescriptorSetLayout layout) {
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+	VkDescriptorSet set;
+	// Vulkan 1.0 doesn't say which error a full pool returns, so any
+	// failure moves on to the next pool, and only a fresh one is final
+	while (true) {
+		bool fresh = list.current == list.pools.size();
+		if (fresh) {
+			list.pools.push_back(createPool(device));
+		}
+		allocInfo.descriptorPool = list.pools[list.current];
+		if (vkAllocateDescriptorSets(device->logical, &allocInfo, &set) ==
+		    VK_SUCCESS) {
+			return set;
+		}
+		if (fresh) {
+			throw std::runtime_error("failed to allocate descriptor sets!");
+		}
+		list.current++;
+	}
+}
+
+void DescriptorAllocator::write(
+    VkDescriptorSet set, const std::vector<DescriptorBinding>& bindings) {
+	std::vector<VkWriteDescriptorSet> descriptorWrites(bindings.size());
+	for (size_t i = 0; i < bindings.size(); i++) {
+		descriptorWrites[i] = {};
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = set;
+		descriptorWrites[i].dstBinding = bindings[i].binding;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = bindings[i].type;
+		descriptorWrites[i].descriptorCount = 1;
+		if (isImageType(bindings[i].type)) {
+			descriptorWrites[i].pImageInfo = &bindings[i].image;
+		} else {
+			descriptorWrites[i].pBufferInfo = &bindings[i].buffer;
+		}
+	}
+	vkUpdateDescriptorSets(device->logical,
+	                       static_cast<uint32_t>(descriptorWrites.size()),
+	                       descriptorWrites.data(), 0, nullptr);
+}
+
+void DescriptorAllocator::reset(PoolList& list) {
+	for (size_t i = 0; i <= list.current && i < list.pools.size(); i++) {
+		vkResetDescriptorPool(device->logical, list.pools[i], 0);
+	}
+	list.current = 0;
+}
+
+void DescriptorAllocator::destroy(PoolList& list) {
+	for (auto pool : list.pools) {
+		vkDestroyDescriptorPool(device->logical, pool, nullptr);
+	}
+	list.pools.clear();
+	list.current = 0;
+}
@@ -19,21 +19,45 @@ void Device::pickPhysicalDevice(Instance* instance) {
 	std::vector<VkPhysicalDevice> candidateDevices(deviceCount);
 	vkEnumeratePhysicalDevices(instance->instance, &deviceCount,
 	                           candidateDevices.data());
-	for (const auto& candidateDevice : candidateDevices) {
-		if (isDeviceSuitable(instance, candidateDevice)) {
-			physical = candidateDevice;
-			break;
+	std::string selector = instance->deviceSelector;
+	const char* variable = std::getenv(DEVICE_OVERRIDE_VARIABLE);
+	if (selector.empty() && variable != nullptr) {
+		selector = variable;
+	}
+	std::vector<DeviceCapabilities> candidates(deviceCount);
+	const DeviceCapabilities* best = nullptr;
+	for (uint32_t i = 0; i < deviceCount; i++) {
+		DeviceCapabilities& candidate = candidates[i];
+		candidate.query(instance, candidateDevices[i], i);
+		bool suitable = candidate.isSuitable();
+		std::cout << "GPU " << i << ": " << candidate.properties.deviceName
+		          << (suitable ? "" : " (unsuitable)") << std::endl;
+		if (!suitable) {
+			continue;
+		}
+		// An explicit choice takes the first match whatever its score
+		if (!selector.empty()) {
+			if (best == nullptr && candidate.matches(selector)) {
+				best = &candidate;
+			}
+		} else if (best == nullptr ||
+		           candidate.getScore() > best->getScore()) {
+			best = &candidate;
 		}
 	}
-	if (physical == VK_NULL_HANDLE) {
-		throw std::runtime_error("failed to find a suitable GPU!");
+	if (best == nullptr) {
+		throw std::runtime_error(selector.empty()
+		                             ? "failed to find a suitable GPU!"
+		                             : "failed to find the requested GPU!");
 	}
+	capabilities = *best;
+	physical = capabilities.physical;
+	std::cout << "Using GPU " << capabilities.index << std::endl;
 }
 
 void Device::createLogicalDevice(Instance* instance,
                                  bool enableValidationLayers) {
-	QueueFamilyIndices indices =
-	    findQueueFamilies(instance, instance->device->physical);
+	const QueueFamilyIndices& indices = capabilities.queueFamilies;
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(),
 	                                          indices.presentFamily.value()};
@@ -48,15 +72,58 @@ void Device::createLogicalDevice(Instance* instance,
 	}
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = capabilities.features.multiDrawIndirect;
+	deviceFeatures.textureCompressionBC =
+	    capabilities.features.textureCompressionBC;
+	deviceFeatures.pipelineStatisticsQuery =
+	    capabilities.features.pipelineStatisticsQuery;
+	enabledFeatures = deviceFeatures;
+	std::vector<const char*> extensions = deviceExtensions;
+	// Extension features go in a chain, which then carries the core ones
+	VkPhysicalDeviceFeatures2 features2 = {};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.features = deviceFeatures;
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+	timelineFeatures.sType =
+	    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = {};
+	indexingFeatures.sType =
+	    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+	void** next = &features2.pNext;
+	if (capabilities.timelineSemaphore) {
+		extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		timelineFeatures.timelineSemaphore = VK_TRUE;
+		*next = &timelineFeatures;
+		next = &timelineFeatures.pNext;
+	}
+	if (capabilities.descriptorIndexing) {
+		extensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+		extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+		indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+		indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		*next = &indexingFeatures;
+		next = &indexingFeatures.pNext;
+	}
+	if (capabilities.drawIndirectCount) {
+		extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	}
+	if (capabilities.memoryBudget) {
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	createInfo.queueCreateInfoCount =
 	    static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
-	createInfo.pEnabledFeatures = &deviceFeatures;
+	if (features2.pNext != nullptr) {
+		createInfo.pNext = &features2;
+	} else {
+		createInfo.pEnabledFeatures = &deviceFeatures;
+	}
 	createInfo.enabledExtensionCount =
-	    static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	    static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 	if (enableValidationLayers) {
 		createInfo.enabledLayerCount =
 		    static_cast<uint32_t>(validationLayers.size());
@@ -71,22 +138,51 @@ void Device::createLogicalDevice(Instance* instance,
 	vkGetDeviceQueue(logical, indices.graphicsFamily.value(), 0,
 	                 &graphicsQueue);
 	vkGetDeviceQueue(logical, indices.presentFamily.value(), 0, &presentQueue);
+	if (capabilities.drawIndirectCount) {
+		cmdDrawIndexedIndirectCount =
+		    (PFN_vkCmdDrawIndexedIndirectCount)vkGetDeviceProcAddr(
+		        logical, "vkCmdDrawIndexedIndirectCountKHR");
+		capabilities.drawIndirectCount = cmdDrawIndexedIndirectCount != nullptr;
+	}
+	if (capabilities.memoryBudget) {
+		getMemoryProperties2 =
+		    (PFN_vkGetPhysicalDeviceMemoryProperties2)vkGetInstanceProcAddr(
+		        instance->instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+		capabilities.memoryBudget = getMemoryProperties2 != nullptr;
+	}
+	std::cout << "Timeline semaphores "
+	          << (capabilities.timelineSemaphore ? "enabled" : "disabled")
+	          << ", descriptor indexing "
+	          << (capabilities.descriptorIndexing ? "enabled" : "disabled")
+	          << ", draw indirect count "
+	          << (capabilities.drawIndirectCount ? "enabled" : "disabled")
+	          << ", memory budget "
+	          << (capabilities.memoryBudget ? "enabled" : "disabled")
+	          << std::endl;
+	samplers.create(this);
 }
 
-void Device::destroyLogicalDevice() { vkDestroyDevice(logical, nullptr); }
+void Device::destroyLogicalDevice() {
+	samplers.destroy();
+	vkDestroyDevice(logical, nullptr);
+}
 
-bool Device::isDeviceSuitable(Instance* instance, VkPhysicalDevice device) {
-	QueueFamilyIndices indices = findQueueFamilies(instance, device);
-	bool extensionsSupported = checkDeviceExtensionSupport(device);
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
-		SwapChainSupportDetails swapChainSupport =
-		    querySwapChainSupport(instance, device);
-		swapChainAdequate = !swapChainSupport.formats.empty() &&
-		                    !swapChainSupport.presentModes.empty();
+VkDeviceSize Device::getAvailableMemory() {
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+	budget.sType =
+	    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	VkPhysicalDeviceMemoryProperties2 properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	properties.pNext = &budget;
+	getMemoryProperties2(physical, &properties);
+	VkDeviceSize available = 0;
+	const VkPhysicalDeviceMemoryProperties& memory =
+	    properties.memoryProperties;
+	for (uint32_t i = 0; i < memory.memoryHeapCount; i++) {
+		if ((memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+		    budget.heapBudget[i] > budget.heapUsage[i]) {
+			available += budget.heapBudget[i] - budget.heapUsage[i];
+		}
 	}
-	VkPhysicalDeviceFeatures supportedFeatures;
-	vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
-	return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-	       supportedFeatures.samplerAnisotropy;
+	return available;
 }
\ No newline at end of file
@@ -0,0 +1,575 @@
+#include "gltf.h"
+#include "include.h"
+#include "json.h"
+#include "texture.h"
+#include "util.h"
+
+namespace {
+	constexpr uint32_t GLB_MAGIC = 0x46546c67;
+	constexpr uint32_t GLB_CHUNK_JSON = 0x4e4f534a;
+	constexpr uint32_t GLB_CHUNK_BIN = 0x004e4942;
+	constexpr uint32_t GLB_HEADER_SIZE = 12;
+	constexpr uint32_t GLB_CHUNK_HEADER_SIZE = 8;
+
+	constexpr int64_t COMPONENT_BYTE = 5120;
+	constexpr int64_t COMPONENT_UNSIGNED_BYTE = 5121;
+	constexpr int64_t COMPONENT_SHORT = 5122;
+	constexpr int64_t COMPONENT_UNSIGNED_SHORT = 5123;
+	constexpr int64_t COMPONENT_UNSIGNED_INT = 5125;
+	constexpr int64_t COMPONENT_FLOAT = 5126;
+	constexpr int64_t MODE_TRIANGLES = 4;
+	// Guards against cyclic node hierarchies in malformed files
+	constexpr int MAX_NODE_DEPTH = 64;
+
+	[[noreturn]] void fail(const std::string& path, const char* what) {
+		throw std::runtime_error("failed to load glTF " + path + ": " + what +
+		                         "!");
+	}
+
+	void decodeBase64(const char* text, size_t size,
+	                  std::vector<uint8_t>& out) {
+		auto value = [](char c) -> int {
+			if (c >= 'A' && c <= 'Z') return c - 'A';
+			if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+			if (c >= '0' && c <= '9') return c - '0' + 52;
+			if (c == '+' || c == '-') return 62;
+			if (c == '/' || c == '_') return 63;
+			return -1;
+		};
+		out.clear();
+		out.reserve(size / 4 * 3);
+		uint32_t bits = 0;
+		int bitCount = 0;
+		for (size_t i = 0; i < size; i++) {
+			int v = value(text[i]);
+			if (v < 0) {
+				continue;
+			}
+			bits = (bits << 6) | static_cast<uint32_t>(v);
+			bitCount += 6;
+			if (bitCount >= 8) {
+				bitCount -= 8;
+				out.push_back(static_cast<uint8_t>(bits >> bitCount));
+			}
+		}
+	}
+
+	// Splits "data:<mime>;base64,<payload>" and decodes the payload
+	bool decodeDataUri(const std::string& uri, std::vector<uint8_t>& out) {
+		if (uri.compare(0, 5, "data:") != 0) {
+			return false;
+		}
+		size_t comma = uri.find(',');
+		if (comma == std::string::npos ||
+		    uri.rfind(";base64", comma) == std::string::npos) {
+			return false;
+		}
+		decodeBase64(uri.data() + comma + 1, uri.size() - comma - 1, out);
+		return true;
+	}
+
+	size_t getComponentSize(int64_t componentType) {
+		switch (componentType) {
+		case COMPONENT_BYTE:
+		case COMPONENT_UNSIGNED_BYTE: return 1;
+		case COMPONENT_SHORT:
+		case COMPONENT_UNSIGNED_SHORT: return 2;
+		case COMPONENT_UNSIGNED_INT:
+		case COMPONENT_FLOAT: return 4;
+		default: return 0;
+		}
+	}
+
+	struct GltfBuffer {
+		bool loaded = false;
+		MappedFile file;
+		std::vector<uint8_t> decoded;
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+	};
+
+	struct Accessor {
+		const uint8_t* data;
+		size_t count;
+		size_t stride;
+		int64_t componentType;
+		uint32_t components;
+		bool normalized;
+	};
+
+	struct GltfFile {
+		std::string path;
+		std::string directory;
+		MappedFile file;
+		JsonValue json;
+		const uint8_t* binChunk = nullptr;
+		size_t binSize = 0;
+		std::vector<GltfBuffer> buffers;
+
+		~GltfFile() {
+			file.unmap();
+			for (auto& buffer : buffers) {
+				buffer.file.unmap();
+			}
+		}
+
+		void open(const std::string& gltfPath) {
+			path = gltfPath;
+			size_t slash = path.find_last_of('/');
+			directory = slash == std::string::npos ? ""
+			                                       : path.substr(0, slash + 1);
+			file.map(path);
+			uint32_t magic = 0;
+			if (file.size >= sizeof(magic)) {
+				memcpy(&magic, file.data, sizeof(magic));
+			}
+			if (magic != GLB_MAGIC) {
+				json = parseJson(reinterpret_cast<const char*>(file.data),
+				                 file.size);
+			} else {
+				openBinary();
+			}
+			buffers.resize(json["buffers"].size());
+		}
+
+		const uint8_t* getBufferView(int64_t index, size_t& size,
+		                             size_t& stride) {
+			const JsonValue& view = json["bufferViews"][index];
+			if (view.isNull()) {
+				fail(path, "bad buffer view");
+			}
+			const GltfBuffer& buffer = getBuffer(view["buffer"].asInt());
+			size_t offset = view["byteOffset"].asInt(0);
+			size = view["byteLength"].asInt(0);
+			stride = view["byteStride"].asInt(0);
+			if (offset > buffer.size || size > buffer.size - offset) {
+				fail(path, "buffer view out of range");
+			}
+			return buffer.data + offset;
+		}
+
+		Accessor getAccessor(int64_t index) {
+			const JsonValue& accessor = json["accessors"][index];
+			if (accessor.isNull()) {
+				fail(path, "bad accessor");
+			}
+			if (!accessor["sparse"].isNull()) {
+				fail(path, "sparse accessors are not supported");
+			}
+			Accessor result = {};
+			result.count = accessor["count"].asInt(0);
+			result.componentType = accessor["componentType"].asInt();
+			result.normalized = accessor["normalized"].asBool();
+			const std::string& type = accessor["type"].asString();
+			result.components = type == "SCALAR" ? 1
+			                    : type == "VEC2" ? 2
+			                    : type == "VEC3" ? 3
+			                    : type == "VEC4" ? 4
+			                                     : 0;
+			size_t componentSize = getComponentSize(result.componentType);
+			if (result.components == 0 || componentSize == 0) {
+				fail(path, "unsupported accessor type");
+			}
+			size_t elementSize = componentSize * result.components;
+			result.stride = elementSize;
+			int64_t viewIndex = accessor["bufferView"].asInt();
+			if (viewIndex < 0) {
+				// No view means all zeros
+				return result;
+			}
+			size_t viewSize, viewStride;
+			const uint8_t* view = getBufferView(viewIndex, viewSize, viewStride);
+			size_t offset = accessor["byteOffset"].asInt(0);
+			if (viewStride != 0) {
+				result.stride = viewStride;
+			}
+			if (result.count > 0 &&
+			    (offset > viewSize ||
+			     (result.count - 1) * result.stride + elementSize >
+			         viewSize - offset)) {
+				fail(path, "accessor out of range");
+			}
+			result.data = view + offset;
+			return result;
+		}
+
+	  private:
+		void openBinary() {
+			uint32_t header[3];
+			if (file.size < GLB_HEADER_SIZE) {
+				fail(path, "truncated GLB header");
+			}
+			memcpy(header, file.data, sizeof(header));
+			if (header[1] != 2) {
+				fail(path, "unsupported GLB version");
+			}
+			size_t length = std::min<size_t>(header[2], file.size);
+			size_t offset = GLB_HEADER_SIZE;
+			bool hasJson = false;
+			while (offset + GLB_CHUNK_HEADER_SIZE <= length) {
+				uint32_t chunk[2];
+				memcpy(chunk, file.data + offset, sizeof(chunk));
+				offset += GLB_CHUNK_HEADER_SIZE;
+				if (chunk[0] > length - offset) {
+					fail(path, "truncated GLB chunk");
+				}
+				const uint8_t* data = file.data + offset;
+				if (chunk[1] == GLB_CHUNK_JSON && !hasJson) {
+					json = parseJson(reinterpret_cast<const char*>(data),
+					                 chunk[0]);
+					hasJson = true;
+				} else if (chunk[1] == GLB_CHUNK_BIN && !binChunk) {
+					binChunk = data;
+					binSize = chunk[0];
+				}
+				// Chunks are padded to 4 bytes
+				offset += (chunk[0] + 3) & ~3u;
+			}
+			if (!hasJson) {
+				fail(path, "GLB has no JSON chunk");
+			}
+		}
+
+		const GltfBuffer& getBuffer(int64_t index) {
+			if (index < 0 || static_cast<size_t>(index) >= buffers.size()) {
+				fail(path, "bad buffer");
+			}
+			GltfBuffer& buffer = buffers[index];
+			if (buffer.loaded) {
+				return buffer;
+			}
+			const std::string& uri = json["buffers"][index]["uri"].asString();
+			if (uri.empty()) {
+				// A GLB's first buffer is its binary chunk
+				if (index != 0 || !binChunk) {
+					fail(path, "buffer has no data");
+				}
+				buffer.data = binChunk;
+				buffer.size = binSize;
+			} else if (decodeDataUri(uri, buffer.decoded)) {
+				buffer.data = buffer.decoded.data();
+				buffer.size = buffer.decoded.size();
+			} else {
+				buffer.file.map(directory + uri);
+				buffer.data = buffer.file.data;
+				buffer.size = buffer.file.size;
+			}
+			size_t declared = json["buffers"][index]["byteLength"].asInt(0);
+			buffer.size = std::min(buffer.size, declared);
+			buffer.loaded = true;
+			return buffer;
+		}
+	};
+
+	float readComponent(const uint8_t* data, int64_t componentType,
+	                    bool normalized) {
+		switch (componentType) {
+		case COMPONENT_FLOAT: {
+			float value;
+			memcpy(&value, data, sizeof(value));
+			return value;
+		}
+		case COMPONENT_UNSIGNED_BYTE:
+			return normalized ? data[0] / 255.0f : data[0];
+		case COMPONENT_BYTE: {
+			int8_t value = static_cast<int8_t>(data[0]);
+			return normalized ? std::max(value / 127.0f, -1.0f) : value;
+		}
+		case COMPONENT_UNSIGNED_SHORT: {
+			uint16_t value;
+			memcpy(&value, data, sizeof(value));
+			return normalized ? value / 65535.0f : value;
+		}
+		case COMPONENT_SHORT: {
+			int16_t value;
+			memcpy(&value, data, sizeof(value));
+			return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+		}
+		case COMPONENT_UNSIGNED_INT: {
+			uint32_t value;
+			memcpy(&value, data, sizeof(value));
+			return static_cast<float>(value);
+		}
+		}
+		return 0.0f;
+	}
+
+	// Reads the first `components` components of every element
+	void readFloats(const Accessor& accessor, uint32_t components,
+	                std::vector<float>& out) {
+		out.assign(accessor.count * components, 0.0f);
+		if (!accessor.data) {
+			return;
+		}
+		if (accessor.componentType == COMPONENT_FLOAT &&
+		    accessor.components == components &&
+		    accessor.stride == sizeof(float) * components) {
+			// Tightly packed floats come straight out of the mapping
+			memcpy(out.data(), accessor.data, out.size() * sizeof(float));
+			return;
+		}
+		size_t componentSize = getComponentSize(accessor.componentType);
+		uint32_t available = std::min(components, accessor.components);
+		for (size_t i = 0; i < accessor.count; i++) {
+			const uint8_t* element = accessor.data + i * accessor.stride;
+			for (uint32_t c = 0; c < available; c++) {
+				out[i * components + c] =
+				    readComponent(element + c * componentSize,
+				                  accessor.componentType, accessor.normalized);
+			}
+		}
+	}
+
+	void readIndices(const std::string& path, const Accessor& accessor,
+	                 uint32_t base, size_t vertexCount,
+	                 std::vector<uint32_t>& indices) {
+		size_t first = indices.size();
+		indices.resize(first + accessor.count);
+		uint32_t* out = indices.data() + first;
+		if (!accessor.data) {
+			std::fill(out, out + accessor.count, base);
+			return;
+		}
+		if (accessor.componentType == COMPONENT_UNSIGNED_INT &&
+		    accessor.stride == sizeof(uint32_t)) {
+			memcpy(out, accessor.data, accessor.count * sizeof(uint32_t));
+		} else if (accessor.componentType == COMPONENT_UNSIGNED_SHORT) {
+			for (size_t i = 0; i < accessor.count; i++) {
+				uint16_t index;
+				memcpy(&index, accessor.data + i * accessor.stride,
+				       sizeof(index));
+				out[i] = index;
+			}
+		} else if (accessor.componentType == COMPONENT_UNSIGNED_BYTE) {
+			for (size_t i = 0; i < accessor.count; i++) {
+				out[i] = accessor.data[i * accessor.stride];
+			}
+		} else if (accessor.componentType == COMPONENT_UNSIGNED_INT) {
+			for (size_t i = 0; i < accessor.count; i++) {
+				memcpy(&out[i], accessor.data + i * accessor.stride,
+				       sizeof(uint32_t));
+			}
+		} else {
+			fail(path, "bad index type");
+		}
+		for (size_t i = 0; i < accessor.count; i++) {
+			if (out[i] >= vertexCount) {
+				fail(path, "index out of range");
+			}
+			out[i] += base;
+		}
+	}
+
+	glm::mat4 getNodeTransform(const JsonValue& node) {
+		const JsonValue& matrix = node["matrix"];
+		if (matrix.size() == 16) {
+			glm::mat4 result;
+			for (int i = 0; i < 16; i++) {
+				result[i / 4][i % 4] = static_cast<float>(matrix[i].asNumber());
+			}
+			return result;
+		}
+		glm::mat4 result(1.0f);
+		const JsonValue& translation = node["translation"];
+		if (translation.size() == 3) {
+			result = glm::translate(
+			    result, glm::vec3(translation[0].asNumber(),
+			                      translation[1].asNumber(),
+			                      translation[2].asNumber()));
+		}
+		const JsonValue& rotation = node["rotation"];
+		if (rotation.size() == 4) {
+			float x = static_cast<float>(rotation[0].asNumber());
+			float y = static_cast<float>(rotation[1].asNumber());
+			float z = static_cast<float>(rotation[2].asNumber());
+			float w = static_cast<float>(rotation[3].asNumber(1.0));
+			glm::mat4 r(1.0f);
+			r[0] = glm::vec4(1 - 2 * (y * y + z * z), 2 * (x * y + w * z),
+			                 2 * (x * z - w * y), 0.0f);
+			r[1] = glm::vec4(2 * (x * y - w * z), 1 - 2 * (x * x + z * z),
+			                 2 * (y * z + w * x), 0.0f);
+			r[2] = glm::vec4(2 * (x * z + w * y), 2 * (y * z - w * x),
+			                 1 - 2 * (x * x + y * y), 0.0f);
+			result = result * r;
+		}
+		const JsonValue& scale = node["scale"];
+		if (scale.size() == 3) {
+			result = glm::scale(result, glm::vec3(scale[0].asNumber(1.0),
+			                                      scale[1].asNumber(1.0),
+			                                      scale[2].asNumber(1.0)));
+		}
+		return result;
+	}
+
+	void appendMesh(GltfFile& gltf, int64_t meshIndex,
+	                const glm::mat4& transform, std::vector<Vertex>& vertices,
+	                std::vector<uint32_t>& indices, bool& hasNormals) {
+		const JsonValue& primitives =
+		    gltf.json["meshes"][meshIndex]["primitives"];
+		glm::mat4 normalMatrix = glm::transpose(glm::inverse(transform));
+		std::vector<float> positions, texCoords, normals, colours;
+		for (size_t p = 0; p < primitives.size(); p++) {
+			const JsonValue& primitive = primitives[p];
+			if (primitive["mode"].asInt(MODE_TRIANGLES) != MODE_TRIANGLES) {
+				continue;
+			}
+			const JsonValue& attributes = primitive["attributes"];
+			if (attributes["POSITION"].isNull()) {
+				continue;
+			}
+			Accessor position =
+			    gltf.getAccessor(attributes["POSITION"].asInt());
+			readFloats(position, 3, positions);
+			size_t count = position.count;
+			texCoords.assign(count * 2, 0.0f);
+			if (!attributes["TEXCOORD_0"].isNull()) {
+				readFloats(gltf.getAccessor(attributes["TEXCOORD_0"].asInt()),
+				           2, texCoords);
+			}
+			normals.clear();
+			if (!attributes["NORMAL"].isNull()) {
+				readFloats(gltf.getAccessor(attributes["NORMAL"].asInt()), 3,
+				           normals);
+			} else {
+				hasNormals = false;
+			}
+			colours.assign(count * 3, 1.0f);
+			if (!attributes["COLOR_0"].isNull()) {
+				readFloats(gltf.getAccessor(attributes["COLOR_0"].asInt()), 3,
+				           colours);
+			}
+			if (texCoords.size() < count * 2 || colours.size() < count * 3 ||
+			    (!normals.empty() && normals.size() < count * 3)) {
+				fail(gltf.path, "attribute counts differ");
+			}
+
+			uint32_t base = static_cast<uint32_t>(vertices.size());
+			vertices.resize(base + count);
+			for (size_t i = 0; i < count; i++) {
+				Vertex& vertex = vertices[base + i];
+				vertex.pos = glm::vec3(
+				    transform * glm::vec4(positions[i * 3 + 0],
+				                          positions[i * 3 + 1],
+				                          positions[i * 3 + 2], 1.0f));
+				vertex.colour = {colours[i * 3 + 0], colours[i * 3 + 1],
+				                 colours[i * 3 + 2]};
+				// glTF puts the texture origin top left, as Vulkan samples
+				vertex.texCoord = {texCoords[i * 2 + 0], texCoords[i * 2 + 1]};
+				vertex.normal = glm::vec3(0.0f);
+				if (!normals.empty()) {
+					glm::vec3 normal = glm::vec3(
+					    normalMatrix * glm::vec4(normals[i * 3 + 0],
+					                             normals[i * 3 + 1],
+					                             normals[i * 3 + 2], 0.0f));
+					float length = glm::length(normal);
+					vertex.normal = length > 0.0f ? normal / length : normal;
+				}
+			}
+			if (primitive["indices"].isNull()) {
+				size_t first = indices.size();
+				indices.resize(first + count);
+				for (size_t i = 0; i < count; i++) {
+					indices[first + i] = base + static_cast<uint32_t>(i);
+				}
+			} else {
+				readIndices(gltf.path,
+				            gltf.getAccessor(primitive["indices"].asInt()),
+				            base, count, indices);
+			}
+			indices.resize(indices.size() - indices.size() % 3);
+		}
+	}
+
+	void visitNode(GltfFile& gltf, int64_t nodeIndex,
+	               const glm::mat4& parent, int depth,
+	               std::vector<Vertex>& vertices,
+	               std::vector<uint32_t>& indices, bool& hasNormals) {
+		const JsonValue& node = gltf.json["nodes"][nodeIndex];
+		if (node.isNull() || depth > MAX_NODE_DEPTH) {
+			fail(gltf.path, "bad node hierarchy");
+		}
+		glm::mat4 transform = parent * getNodeTransform(node);
+		if (!node["mesh"].isNull()) {
+			appendMesh(gltf, node["mesh"].asInt(), transform, vertices,
+			           indices, hasNormals);
+		}
+		const JsonValue& children = node["children"];
+		for (size_t i = 0; i < children.size(); i++) {
+			visitNode(gltf, children[i].asInt(), transform, depth + 1,
+			          vertices, indices, hasNormals);
+		}
+	}
+} // namespace
+
+bool isGltfPath(const std::string& path) {
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos) {
+		return false;
+	}
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(),
+	               [](unsigned char c) { return std::tolower(c); });
+	return extension == "gltf" || extension == "glb";
+}
+
+void loadGltf(const std::string& path, std::vector<Vertex>& vertices,
+              std::vector<uint32_t>& indices, bool& hasNormals) {
+	GltfFile gltf;
+	gltf.open(path);
+	hasNormals = true;
+	// The viewer is Z-up, glTF is Y-up
+	glm::mat4 root = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f),
+	                             glm::vec3(1.0f, 0.0f, 0.0f));
+	const JsonValue& scenes = gltf.json["scenes"];
+	if (scenes.size() == 0) {
+		for (size_t i = 0; i < gltf.json["meshes"].size(); i++) {
+			appendMesh(gltf, i, root, vertices, indices, hasNormals);
+		}
+	} else {
+		const JsonValue& scene = scenes[gltf.json["scene"].asInt(0)];
+		const JsonValue& nodes = scene["nodes"];
+		for (size_t i = 0; i < nodes.size(); i++) {
+			visitNode(gltf, nodes[i].asInt(), root, 0, vertices, indices,
+			          hasNormals);
+		}
+	}
+	if (indices.empty()) {
+		fail(path, "no triangles");
+	}
+}
+
+bool loadGltfTexture(const std::string& path, Texture& texture) {
+	GltfFile gltf;
+	gltf.open(path);
+	const JsonValue& materials = gltf.json["materials"];
+	for (size_t i = 0; i < materials.size(); i++) {
+		int64_t textureIndex =
+		    materials[i]["pbrMetallicRoughness"]["baseColorTexture"]["index"]
+		        .asInt();
+		if (textureIndex < 0) {
+			continue;
+		}
+		int64_t imageIndex =
+		    gltf.json["textures"][textureIndex]["source"].asInt();
+		const JsonValue& image = gltf.json["images"][imageIndex];
+		if (image.isNull()) {
+			fail(path, "bad texture");
+		}
+		int64_t viewIndex = image["bufferView"].asInt();
+		if (viewIndex >= 0) {
+			size_t size, stride;
+			const uint8_t* data = gltf.getBufferView(viewIndex, size, stride);
+			texture.loadFromMemory(data, size, path);
+			return true;
+		}
+		const std::string& uri = image["uri"].asString();
+		std::vector<uint8_t> decoded;
+		if (decodeDataUri(uri, decoded)) {
+			texture.loadFromMemory(decoded.data(), decoded.size(), path);
+		} else {
+			texture.load(gltf.directory + uri);
+		}
+		return true;
+	}
+	return false;
+}
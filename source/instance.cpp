@@ -1,13 +1,23 @@
 #include "instance.h"
 #include "commander.h"
 #include "descriptor.h"
+#include "descriptorallocator.h"
 #include "device.h"
 #include "include.h"
 #include "model.h"
+#include "occlusion.h"
+#include "overdraw.h"
+#include "pipelinestats.h"
+#include "readback.h"
 #include "renderer.h"
+#include "staging.h"
 #include "surface.h"
 #include "sync.h"
 #include "texture.h"
+#include "texturestream.h"
+#include "threadpool.h"
+#include "trace.h"
+#include "uniformring.h"
 #include "util.h"
 
 Instance::Instance() {
@@ -16,53 +26,141 @@ Instance::Instance() {
 	surface = new Surface();
 	renderer = new Renderer();
 	descriptor = new Descriptor();
+	descriptorAllocator = new DescriptorAllocator();
 	commander = new Commander();
 	sync = new Sync();
+	occlusion = new Occlusion();
+	overdraw = new OverdrawView();
+	threadPool = new ThreadPool();
+	stagingPool = new StagingPool();
+	streamer = new TextureStreamer();
+	uniformRing = new UniformRing();
+	readback = new ReadbackRing();
+	statistics = new PipelineStatistics();
+	placeholder = new Texture();
 	models = std::vector<Model>();
 }
 
 void Instance::create(bool enableValidationLayers) {
-	surface->createWindow(this);
-	validationLayersEnabled = enableValidationLayers;
-	currentFrame = 0;
-	createInstance();
-	setupDebugMessenger();
-	surface->createSurface(this);
-	device->pickPhysicalDevice(this);
-	device->createLogicalDevice(this, validationLayersEnabled);
-	surface->createSwapChain(this);
-	surface->createImageViews(device);
+	TRACE_ZONE("Startup");
+	createCore(enableValidationLayers);
+	{
+		TRACE_ZONE("Start model load");
+		// The loaders write into staging buffers, so they need the device
+		models = std::vector<Model>();
+		models.push_back(Model());
+		models[0].create(this, "models/chalet.obj", "textures/chalet.jpg");
+	}
+	occlusion->checkSupport(this);
+	statistics->checkSupport(this);
+	{
+		TRACE_ZONE("Create swap chain");
+		surface->createSwapChain(this);
+		surface->createImageViews(device);
+	}
 	std::cout << "Surface created" << std::endl;
-	renderer->createRenderPass(this);
-	descriptor->createDescriptorSetLayout(this);
-	renderer->createGraphicsPipeline(this);
-	commander->createPool(this);
-	renderer->createColourResources(this);
-	renderer->createDepthResources(this);
-	renderer->createFramebuffers(this);
+	{
+		TRACE_ZONE("Create renderer");
+		renderer->createRenderPass(this);
+		if (overdraw->enabled) {
+			overdraw->createResources(this);
+		}
+		descriptor->createDescriptorSetLayout(this);
+		commander->createPool(this);
+		renderer->createColourResources(this);
+		renderer->createDepthResources(this);
+		renderer->createFramebuffers(this);
+	}
 	std::cout << "Renderer created" << std::endl;
-	models = std::vector<Model>();
-	models.push_back(Model());
-	models[0].create(this, "models/chalet.obj", "textures/chalet.jpg");
-	std::cout << "Model created" << std::endl;
-	descriptor->createVertexBuffer(this, models[0].vertices);
-	descriptor->createIndexBuffer(this, models[0].indices);
-	descriptor->createUniformBuffers(this);
-	descriptor->createDescriptorPool(this);
-	descriptor->createDescriptorSets(this);
+	{
+		TRACE_ZONE("Create placeholder");
+		placeholder->createPlaceholder(this);
+		descriptor->texture = placeholder;
+	}
 	std::cout << "Descriptors created" << std::endl;
-	commander->createBuffers(this);
-	sync->createSyncObjects(this);
+	{
+		TRACE_ZONE("Create command buffers");
+		commander->createBuffers(this);
+		sync->createSyncObjects(this);
+	}
+	if (statistics->enabled) {
+		statistics->create(this);
+	}
+	if (!captureDirectory.empty()) {
+		// A slot per frame in flight being copied and per worker encoding
+		const VkExtent2D extent = surface->getExtents();
+		readback->create(this, extent.width, extent.height,
+		                 surface->getFormat(),
+		                 MAX_FRAMES_IN_FLIGHT + threadPool->getThreadCount());
+	}
+}
+
+void Instance::createCore(bool enableValidationLayers) {
+	TRACE_ZONE("Create core");
+	{
+		TRACE_ZONE("Create window");
+		surface->createWindow(this);
+	}
+	validationLayersEnabled = enableValidationLayers;
+	currentFrame = 0;
+	threadPool->create();
+	{
+		TRACE_ZONE("Create Vulkan instance");
+		createInstance();
+		setupDebugMessenger();
+		surface->createSurface(this);
+	}
+	{
+		TRACE_ZONE("Pick physical device");
+		device->pickPhysicalDevice(this);
+	}
+	{
+		TRACE_ZONE("Create logical device");
+		device->createLogicalDevice(this, validationLayersEnabled);
+	}
+	stagingPool->create(device);
+	descriptorAllocator->create(device, MAX_FRAMES_IN_FLIGHT);
+	uniformRing->create(this);
 }
 
 void Instance::destroy() {
+	// Encoding needs the thread pool
+	readback->destroy();
+	if (!captureDirectory.empty()) {
+		std::cout << "Captured " << readback->getCaptureCount()
+		          << " frames, " << readback->getFailureCount() << " failed"
+		          << std::endl;
+	}
+	threadPool->destroy();
+	// Loads that never became resident are still staged
+	for (Model& model : models) {
+		model.releaseStaging();
+	}
+	streamer->destroy(device);
 	cleanupSwapChain();
-	models[0].texture->destroy(device);
+	if (models[0].meshResident) {
+		if (occlusion->enabled) {
+			occlusion->destroyBuffers(device);
+		}
+		descriptor->destroyIndexBuffer(device);
+		descriptor->destroyVertexBuffer(device);
+	}
+	if (models[0].textureResident) {
+		models[0].texture->destroy(device);
+	}
+	placeholder->destroy(device);
 	descriptor->destroyDescriptorSetLayout(device);
-	descriptor->destroyIndexBuffer(device);
-	descriptor->destroyVertexBuffer(device);
+	statistics->destroy(device);
 	sync->destroySyncObjects(device);
 	commander->destroyPool(device);
+	destroyCore();
+}
+
+void Instance::destroyCore() {
+	threadPool->destroy();
+	descriptorAllocator->destroy();
+	uniformRing->destroy(device);
+	stagingPool->destroy();
 	device->destroyLogicalDevice();
 	if (validationLayersEnabled) {
 		destroyDebugMessenger();
@@ -71,6 +169,9 @@ void Instance::destroy() {
 	vkDestroyInstance(instance, nullptr);
 	surface->destroyWindow();
 	glfwTerminate();
+	API_COUNTERS_REPORT();
+	// Every worker has been joined
+	writeTrace();
 }
 
 bool Instance::shouldClose() { return glfwWindowShouldClose(surface->window); }
@@ -78,13 +179,31 @@ bool Instance::shouldClose() { return glfwWindowShouldClose(surface->window); }
 void Instance::waitIdle() { vkDeviceWaitIdle(device->logical); }
 
 void Instance::drawFrame() {
-	vkWaitForFences(device->logical, 1, &sync->inFlightFences[currentFrame],
-	                VK_TRUE, UINT64_MAX);
+	API_COUNTERS_FRAME();
+	TRACE_ZONE("Frame");
+	updateResidency();
+	{
+		TRACE_ZONE("Wait for frame");
+		vkWaitForFences(device->logical, 1,
+		                &sync->inFlightFences[currentFrame], VK_TRUE,
+		                UINT64_MAX);
+	}
+	readback->collect(currentFrame);
+	streamer->collect(device, currentFrame);
+	if (statistics->enabled) {
+		statistics->collect(currentFrame, surface->getExtents());
+	}
+	descriptorAllocator->resetFrame(currentFrame);
+	uniformRing->beginFrame(currentFrame);
 	uint32_t imageIndex;
-	VkResult result =
-	    vkAcquireNextImageKHR(device->logical, surface->swapChain, UINT64_MAX,
-	                          sync->imageAvailableSemaphores[currentFrame],
-	                          VK_NULL_HANDLE, &imageIndex);
+	VkResult result;
+	{
+		TRACE_ZONE("Acquire image");
+		result = vkAcquireNextImageKHR(
+		    device->logical, surface->swapChain, UINT64_MAX,
+		    sync->imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE,
+		    &imageIndex);
+	}
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		recreateSwapChain();
 		return;
@@ -92,13 +211,15 @@ void Instance::drawFrame() {
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
 
-	descriptor->updateUniformBuffer(this, imageIndex);
+	descriptor->updateUniformBuffer(this);
+	descriptor->allocateFrameSet(this);
 
 	if (sync->imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
 		vkWaitForFences(device->logical, 1, &sync->imagesInFlight[imageIndex],
 		                VK_TRUE, UINT64_MAX);
 	}
 	sync->imagesInFlight[imageIndex] = sync->inFlightFences[currentFrame];
+	commander->recordBuffer(this, imageIndex);
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	VkSemaphore waitSemaphores[] = {
@@ -115,9 +236,12 @@ void Instance::drawFrame() {
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 	vkResetFences(device->logical, 1, &sync->inFlightFences[currentFrame]);
-	if (vkQueueSubmit(device->graphicsQueue, 1, &submitInfo,
-	                  sync->inFlightFences[currentFrame]) != VK_SUCCESS) {
-		throw std::runtime_error("failed to submit draw command buffer!");
+	{
+		TRACE_ZONE("Submit");
+		if (vkQueueSubmit(device->graphicsQueue, 1, &submitInfo,
+		                  sync->inFlightFences[currentFrame]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit draw command buffer!");
+		}
 	}
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -127,7 +251,10 @@ void Instance::drawFrame() {
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = swapChains;
 	presentInfo.pImageIndices = &imageIndex;
-	result = vkQueuePresentKHR(device->presentQueue, &presentInfo);
+	{
+		TRACE_ZONE("Present");
+		result = vkQueuePresentKHR(device->presentQueue, &presentInfo);
+	}
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
 	    framebufferResized) {
 		framebufferResized = false;
@@ -154,6 +281,12 @@ void Instance::createInstance() {
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	createInfo.pApplicationInfo = &appInfo;
 	auto extensions = getRequiredExtensions(validationLayersEnabled);
+	physicalDeviceProperties2 = checkInstanceExtensionSupport(
+	    VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	if (physicalDeviceProperties2) {
+		extensions.push_back(
+		    VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+	}
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
 	createInfo.ppEnabledExtensionNames = extensions.data();
 	VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo;
@@ -188,16 +321,25 @@ void Instance::destroyDebugMessenger() {
 }
 
 void Instance::cleanupSwapChain() {
+	bool meshResident = models[0].meshResident;
+	if (occlusion->enabled && meshResident) {
+		occlusion->destroyResources(device);
+	}
+	if (overdraw->enabled) {
+		overdraw->destroyResources(device);
+	}
 	renderer->destroyColourResources(device);
 	renderer->destroyDepthResources(device);
 	renderer->destroyFramebuffers(this);
 	commander->destroyBuffers(device);
-	renderer->destroyGraphicsPipeline(device);
+	if (meshResident) {
+		renderer->destroyGraphicsPipeline(device);
+	}
 	renderer->destroyRenderPass(device);
 	surface->destroyImageViews(device);
 	surface->destroySwapChain(device);
-	descriptor->destroyUniformBuffers(this);
-	descriptor->destroyDescriptorPool(device);
+	// Cached sets point at the resources destroyed above
+	descriptorAllocator->clearCache();
 }
 
 void Instance::recreateSwapChain() {
@@ -211,13 +353,74 @@ void Instance::recreateSwapChain() {
 	cleanupSwapChain();
 	surface->createSwapChain(this);
 	surface->createImageViews(device);
+	if (!captureDirectory.empty()) {
+		const VkExtent2D extent = surface->getExtents();
+		readback->resize(extent.width, extent.height);
+	}
 	renderer->createRenderPass(this);
-	renderer->createGraphicsPipeline(this);
+	if (overdraw->enabled) {
+		overdraw->createResources(this);
+	}
+	if (models[0].meshResident) {
+		renderer->createGraphicsPipeline(this);
+	}
 	renderer->createColourResources(this);
 	renderer->createDepthResources(this);
 	renderer->createFramebuffers(this);
-	descriptor->createUniformBuffers(this);
-	descriptor->createDescriptorPool(this);
-	descriptor->createDescriptorSets(this);
+	if (occlusion->enabled && models[0].meshResident) {
+		occlusion->createResources(this);
+	}
 	commander->createBuffers(this);
 }
+
+void Instance::updateResidency() {
+	TRACE_ZONE("Update residency");
+	Model& model = models[0];
+	if (!model.meshResident && isReady(model.meshLoad)) {
+		// Rethrows anything the loading thread threw
+		model.meshLoad.get();
+		// The vertex input state depends on the model's vertex layout
+		renderer->createGraphicsPipeline(this);
+		descriptor->createVertexBuffer(this, model.vertexStaging);
+		descriptor->createIndexBuffer(this, model.indexStaging,
+		                              model.indexCount, model.indexType);
+		model.releaseMeshStaging();
+		if (occlusion->enabled) {
+			occlusion->createBuffers(this, model);
+			occlusion->createResources(this);
+		}
+		model.meshResident = true;
+		std::cout << "Model resident" << std::endl;
+	}
+	// Every texture that finished decoding goes up in one submission, only
+	// its smallest levels at first
+	std::vector<Model*> loaded;
+	std::vector<Texture*> textures;
+	for (Model& other : models) {
+		if (!other.textureResident && isReady(other.textureLoad)) {
+			other.textureLoad.get();
+			loaded.push_back(&other);
+			textures.push_back(other.texture);
+			streamer->add(other.texture);
+		}
+	}
+	if (!textures.empty()) {
+		uploadTextures(this, textures);
+		for (Model* other : loaded) {
+			other->textureResident = true;
+		}
+		if (loaded.front() == &model) {
+			// Frames in flight keep sampling the placeholder
+			descriptor->texture = model.texture;
+		}
+		std::cout << textures.size() << " textures resident" << std::endl;
+	}
+	for (Model& other : models) {
+		if (other.textureResident) {
+			streamer->request(other.texture,
+			                  estimateMipLevel(*other.texture,
+			                                   other.screenRadius));
+		}
+	}
+	streamer->update(this);
+}
@@ -0,0 +1,253 @@
+#include "json.h"
+#include "include.h"
+
+namespace {
+	const JsonValue NULL_VALUE = {};
+
+	struct JsonParser {
+		const char* p;
+		const char* end;
+
+		[[noreturn]] void fail(const char* what) {
+			throw std::runtime_error(std::string("failed to parse JSON: ") +
+			                         what + "!");
+		}
+
+		void skipWhitespace() {
+			while (p < end &&
+			       (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+				p++;
+			}
+		}
+
+		void expect(char c) {
+			skipWhitespace();
+			if (p == end || *p != c) {
+				fail("unexpected character");
+			}
+			p++;
+		}
+
+		bool consumeLiteral(const char* literal) {
+			size_t length = strlen(literal);
+			if (static_cast<size_t>(end - p) < length ||
+			    memcmp(p, literal, length) != 0) {
+				return false;
+			}
+			p += length;
+			return true;
+		}
+
+		void appendUtf8(std::string& out, uint32_t code) {
+			if (code < 0x80) {
+				out += static_cast<char>(code);
+			} else if (code < 0x800) {
+				out += static_cast<char>(0xc0 | (code >> 6));
+				out += static_cast<char>(0x80 | (code & 0x3f));
+			} else if (code < 0x10000) {
+				out += static_cast<char>(0xe0 | (code >> 12));
+				out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+				out += static_cast<char>(0x80 | (code & 0x3f));
+			} else {
+				out += static_cast<char>(0xf0 | (code >> 18));
+				out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+				out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+				out += static_cast<char>(0x80 | (code & 0x3f));
+			}
+		}
+
+		uint32_t parseHex4() {
+			if (end - p < 4) {
+				fail("truncated escape");
+			}
+			uint32_t code = 0;
+			for (int i = 0; i < 4; i++) {
+				char c = *p++;
+				code <<= 4;
+				if (c >= '0' && c <= '9') {
+					code |= c - '0';
+				} else if (c >= 'a' && c <= 'f') {
+					code |= c - 'a' + 10;
+				} else if (c >= 'A' && c <= 'F') {
+					code |= c - 'A' + 10;
+				} else {
+					fail("bad escape");
+				}
+			}
+			return code;
+		}
+
+		std::string parseString() {
+			expect('"');
+			std::string out;
+			while (true) {
+				if (p == end) {
+					fail("unterminated string");
+				}
+				char c = *p++;
+				if (c == '"') {
+					return out;
+				}
+				if (c != '\\') {
+					out += c;
+					continue;
+				}
+				if (p == end) {
+					fail("unterminated string");
+				}
+				c = *p++;
+				switch (c) {
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'n': out += '\n'; break;
+				case 'r': out += '\r'; break;
+				case 't': out += '\t'; break;
+				case 'u': {
+					uint32_t code = parseHex4();
+					if (code >= 0xd800 && code < 0xdc00 && end - p >= 6 &&
+					    p[0] == '\\' && p[1] == 'u') {
+						p += 2;
+						uint32_t low = parseHex4();
+						code = 0x10000 + ((code - 0xd800) << 10) +
+						       (low - 0xdc00);
+					}
+					appendUtf8(out, code);
+					break;
+				}
+				default: out += c; break;
+				}
+			}
+		}
+
+		void parseValue(JsonValue& value, int depth) {
+			if (depth > 256) {
+				fail("nesting too deep");
+			}
+			skipWhitespace();
+			if (p == end) {
+				fail("unexpected end");
+			}
+			if (*p == '{') {
+				value.type = JsonValue::Type::Object;
+				p++;
+				skipWhitespace();
+				if (p < end && *p == '}') {
+					p++;
+					return;
+				}
+				while (true) {
+					std::string key = parseString();
+					expect(':');
+					value.object.emplace_back(std::move(key), JsonValue());
+					parseValue(value.object.back().second, depth + 1);
+					skipWhitespace();
+					if (p < end && *p == ',') {
+						p++;
+						continue;
+					}
+					expect('}');
+					return;
+				}
+			}
+			if (*p == '[') {
+				value.type = JsonValue::Type::Array;
+				p++;
+				skipWhitespace();
+				if (p < end && *p == ']') {
+					p++;
+					return;
+				}
+				while (true) {
+					value.array.emplace_back();
+					parseValue(value.array.back(), depth + 1);
+					skipWhitespace();
+					if (p < end && *p == ',') {
+						p++;
+						continue;
+					}
+					expect(']');
+					return;
+				}
+			}
+			if (*p == '"') {
+				value.type = JsonValue::Type::String;
+				value.string = parseString();
+				return;
+			}
+			if (consumeLiteral("true")) {
+				value.type = JsonValue::Type::Bool;
+				value.boolean = true;
+				return;
+			}
+			if (consumeLiteral("false")) {
+				value.type = JsonValue::Type::Bool;
+				return;
+			}
+			if (consumeLiteral("null")) {
+				return;
+			}
+			// Copied so strtod cannot run past the end of an unterminated buffer
+			char buffer[64];
+			size_t length = 0;
+			while (p + length < end && length < sizeof(buffer) - 1 &&
+			       strchr("+-0123456789.eE", p[length])) {
+				length++;
+			}
+			memcpy(buffer, p, length);
+			buffer[length] = '\0';
+			char* numberEnd;
+			value.number = strtod(buffer, &numberEnd);
+			if (length == 0 || numberEnd != buffer + length) {
+				fail("bad value");
+			}
+			value.type = JsonValue::Type::Number;
+			p += length;
+		}
+	};
+} // namespace
+
+size_t JsonValue::size() const {
+	return type == Type::Array ? array.size()
+	                           : type == Type::Object ? object.size() : 0;
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const {
+	return type == Type::Array && index < array.size() ? array[index]
+	                                                   : NULL_VALUE;
+}
+
+const JsonValue& JsonValue::operator[](const std::string& key) const {
+	for (const auto& member : object) {
+		if (member.first == key) {
+			return member.second;
+		}
+	}
+	return NULL_VALUE;
+}
+
+double JsonValue::asNumber(double fallback) const {
+	return type == Type::Number ? number : fallback;
+}
+
+int64_t JsonValue::asInt(int64_t fallback) const {
+	return type == Type::Number ? static_cast<int64_t>(number) : fallback;
+}
+
+bool JsonValue::asBool(bool fallback) const {
+	return type == Type::Bool ? boolean : fallback;
+}
+
+const std::string& JsonValue::asString() const {
+	return type == Type::String ? string : NULL_VALUE.string;
+}
+
+JsonValue parseJson(const char* text, size_t size) {
+	JsonParser parser = {text, text + size};
+	JsonValue root;
+	parser.parseValue(root, 0);
+	parser.skipWhitespace();
+	if (parser.p != parser.end) {
+		parser.fail("trailing characters");
+	}
+	return root;
+}
@@ -0,0 +1,364 @@
+#include "ktx2.h"
+#include "include.h"
+#include "texture.h"
+#include "util.h"
+
+namespace {
+	const uint8_t KTX2_IDENTIFIER[12] = {0xab, 0x4b, 0x54, 0x58, 0x20, 0x32,
+	                                     0x30, 0xbb, 0x0d, 0x0a, 0x1a, 0x0a};
+
+	// Values from the Khronos Data Format specification
+	constexpr uint8_t DF_MODEL_RGBSDA = 1;
+	constexpr uint8_t DF_MODEL_BC1A = 128;
+	constexpr uint8_t DF_MODEL_BC3 = 130;
+	constexpr uint8_t DF_MODEL_BC7 = 134;
+	constexpr uint8_t DF_PRIMARIES_BT709 = 1;
+	constexpr uint8_t DF_TRANSFER_LINEAR = 1;
+	constexpr uint8_t DF_TRANSFER_SRGB = 2;
+	constexpr uint8_t DF_CHANNEL_ALPHA = 15;
+	constexpr uint8_t DF_SAMPLE_LINEAR = 0x10;
+
+	struct Ktx2Header {
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+
+	struct Ktx2Level {
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	struct FormatInfo {
+		VkFormat format;
+		uint32_t blockBytes;
+		uint32_t blockSize;
+		uint8_t colourModel;
+		bool srgb;
+	};
+
+	const FormatInfo FORMATS[] = {
+	    {VK_FORMAT_R8G8B8A8_UNORM, 4, 1, DF_MODEL_RGBSDA, false},
+	    {VK_FORMAT_R8G8B8A8_SRGB, 4, 1, DF_MODEL_RGBSDA, true},
+	    {VK_FORMAT_BC1_RGB_UNORM_BLOCK, 8, 4, DF_MODEL_BC1A, false},
+	    {VK_FORMAT_BC1_RGB_SRGB_BLOCK, 8, 4, DF_MODEL_BC1A, true},
+	    {VK_FORMAT_BC1_RGBA_UNORM_BLOCK, 8, 4, DF_MODEL_BC1A, false},
+	    {VK_FORMAT_BC1_RGBA_SRGB_BLOCK, 8, 4, DF_MODEL_BC1A, true},
+	    {VK_FORMAT_BC3_UNORM_BLOCK, 16, 4, DF_MODEL_BC3, false},
+	    {VK_FORMAT_BC3_SRGB_BLOCK, 16, 4, DF_MODEL_BC3, true},
+	    {VK_FORMAT_BC7_UNORM_BLOCK, 16, 4, DF_MODEL_BC7, false},
+	    {VK_FORMAT_BC7_SRGB_BLOCK, 16, 4, DF_MODEL_BC7, true},
+	};
+
+	[[noreturn]] void fail(const std::string& path, const char* what) {
+		throw std::runtime_error("failed to load KTX2 " + path + ": " + what +
+		                         "!");
+	}
+
+	const FormatInfo* findFormat(uint32_t format) {
+		for (const auto& info : FORMATS) {
+			if (info.format == static_cast<VkFormat>(format)) {
+				return &info;
+			}
+		}
+		return nullptr;
+	}
+
+	size_t getLevelSize(const FormatInfo& info, uint32_t width,
+	                    uint32_t height, uint32_t level) {
+		uint32_t levelWidth = std::max(1u, width >> level);
+		uint32_t levelHeight = std::max(1u, height >> level);
+		return size_t((levelWidth + info.blockSize - 1) / info.blockSize) *
+		       ((levelHeight + info.blockSize - 1) / info.blockSize) *
+		       info.blockBytes;
+	}
+
+	size_t alignTo(size_t offset, size_t alignment) {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// A basic data format descriptor block, which KTX2 requires even though
+	// readKtx2 relies on vkFormat alone
+	std::vector<uint32_t> buildDfd(const FormatInfo& info) {
+		struct Sample {
+			uint32_t bitOffset;
+			uint32_t bitLength;
+			uint8_t channel;
+			uint32_t upper;
+		};
+		std::vector<Sample> samples;
+		switch (info.colourModel) {
+		case DF_MODEL_RGBSDA:
+			samples = {{0, 8, 0, 255},
+			           {8, 8, 1, 255},
+			           {16, 8, 2, 255},
+			           {24, 8, DF_CHANNEL_ALPHA, 255}};
+			break;
+		case DF_MODEL_BC3:
+			samples = {{0, 64, DF_CHANNEL_ALPHA, ~0u}, {64, 64, 0, ~0u}};
+			break;
+		default:
+			samples = {{0, info.blockBytes * 8, 0, ~0u}};
+			break;
+		}
+		uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+		uint32_t blockDimension = info.blockSize - 1;
+		std::vector<uint32_t> dfd = {
+		    4 + blockSize,
+		    0,
+		    2 | blockSize << 16,
+		    uint32_t(info.colourModel) | uint32_t(DF_PRIMARIES_BT709) << 8 |
+		        uint32_t(info.srgb ? DF_TRANSFER_SRGB : DF_TRANSFER_LINEAR)
+		            << 16,
+		    blockDimension | blockDimension << 8,
+		    info.blockBytes,
+		    0,
+		};
+		for (const auto& sample : samples) {
+			uint32_t channel = sample.channel;
+			// Alpha is never sRGB encoded
+			if (info.srgb && channel == DF_CHANNEL_ALPHA) {
+				channel |= DF_SAMPLE_LINEAR;
+			}
+			dfd.push_back(sample.bitOffset | (sample.bitLength - 1) << 16 |
+			              channel << 24);
+			dfd.push_back(0);
+			dfd.push_back(0);
+			dfd.push_back(sample.upper);
+		}
+		return dfd;
+	}
+
+	// Checks the header and level index of a mapped file, returning what's
+	// wrong with them or nullptr
+	const char* indexLevels(const MappedFile& file, Ktx2Header& header,
+	                        const FormatInfo*& info,
+	                        std::vector<Ktx2Level>& levels) {
+		if (file.size < sizeof(header)) {
+			return "truncated header";
+		}
+		memcpy(&header, file.data, sizeof(header));
+		info = findFormat(header.vkFormat);
+		uint32_t levelCount = std::max(1u, header.levelCount);
+		if (memcmp(header.identifier, KTX2_IDENTIFIER,
+		           sizeof(KTX2_IDENTIFIER))) {
+			return "not a KTX2 file";
+		} else if (!info) {
+			return "unsupported format";
+		} else if (header.pixelWidth == 0 || header.pixelHeight == 0 ||
+		           header.pixelDepth > 1 || header.layerCount > 1 ||
+		           header.faceCount != 1) {
+			return "only 2D textures are supported";
+		} else if (header.supercompressionScheme != 0) {
+			return "supercompression is not supported";
+		} else if (levelCount > 32 ||
+		           std::max(header.pixelWidth, header.pixelHeight) >>
+		                   (levelCount - 1) ==
+		               0 ||
+		           sizeof(header) + levelCount * sizeof(Ktx2Level) >
+		               file.size) {
+			return "bad level index";
+		}
+		levels.resize(levelCount);
+		memcpy(levels.data(), file.data + sizeof(header),
+		       levelCount * sizeof(Ktx2Level));
+		for (uint32_t i = 0; i < levelCount; i++) {
+			if (levels[i].byteLength != getLevelSize(*info, header.pixelWidth,
+			                                         header.pixelHeight, i) ||
+			    levels[i].byteOffset > file.size ||
+			    levels[i].byteLength > file.size - levels[i].byteOffset) {
+				return "bad mip level";
+			}
+		}
+		return nullptr;
+	}
+} // namespace
+
+bool isKtx2Path(const std::string& path) {
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos) {
+		return false;
+	}
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(),
+	               [](unsigned char c) { return std::tolower(c); });
+	return extension == "ktx2";
+}
+
+void readKtx2(const std::string& path, Texture& texture,
+              Ktx2KeyValues* keyValues) {
+	MappedFile file;
+	file.map(path);
+	Ktx2Header header;
+	const FormatInfo* info;
+	std::vector<Ktx2Level> levels;
+	if (const char* error = indexLevels(file, header, info, levels)) {
+		file.unmap();
+		fail(path, error);
+	}
+	uint32_t levelCount = static_cast<uint32_t>(levels.size());
+	size_t total = 0;
+	for (const Ktx2Level& level : levels) {
+		total += level.byteLength;
+	}
+	if (keyValues) {
+		keyValues->clear();
+		uint64_t offset = header.kvdByteOffset;
+		uint64_t end = offset + header.kvdByteLength;
+		while (end <= file.size && offset + 4 <= end) {
+			uint32_t length;
+			memcpy(&length, file.data + offset, 4);
+			const char* entry =
+			    reinterpret_cast<const char*>(file.data + offset + 4);
+			if (length > end - offset - 4) {
+				break;
+			}
+			size_t keyLength = strnlen(entry, length);
+			if (keyLength < length) {
+				keyValues->emplace_back(
+				    std::string(entry, keyLength),
+				    std::string(entry + keyLength + 1,
+				                length - keyLength - 1));
+			}
+			offset = alignTo(offset + 4 + length, 4);
+		}
+	}
+	texture.format = info->format;
+	texture.width = header.pixelWidth;
+	texture.height = header.pixelHeight;
+	texture.mipLevels = levelCount;
+	if (header.levelCount == 0 && info->blockSize == 1) {
+		// No stored mips asks for them to be generated
+		texture.mipLevels = static_cast<uint32_t>(std::floor(std::log2(
+		                        std::max(header.pixelWidth,
+		                                 header.pixelHeight)))) +
+		                    1;
+	}
+	uint8_t* pixels = texture.allocatePixels(total);
+	texture.levelOffsets.resize(levelCount);
+	size_t offset = 0;
+	for (uint32_t i = 0; i < levelCount; i++) {
+		texture.levelOffsets[i] = offset;
+		memcpy(pixels + offset,
+		       file.data + levels[i].byteOffset, levels[i].byteLength);
+		offset += levels[i].byteLength;
+	}
+	file.unmap();
+}
+
+void writeKtx2(const std::string& path, const Texture& texture,
+               const Ktx2KeyValues& keyValues) {
+	const FormatInfo* info = findFormat(texture.format);
+	if (!info) {
+		throw std::runtime_error("failed to write KTX2 " + path +
+		                         ": unsupported format!");
+	}
+	uint32_t levelCount = static_cast<uint32_t>(texture.levelOffsets.size());
+	Ktx2Header header = {};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat = info->format;
+	header.typeSize = 1;
+	header.pixelWidth = texture.width;
+	header.pixelHeight = texture.height;
+	header.faceCount = 1;
+	header.levelCount = levelCount;
+
+	std::vector<uint32_t> dfd = buildDfd(*info);
+	std::string kvd;
+	Ktx2KeyValues sorted = keyValues;
+	std::sort(sorted.begin(), sorted.end());
+	for (const auto& keyValue : sorted) {
+		uint32_t length =
+		    static_cast<uint32_t>(keyValue.first.size() + 1 +
+		                          keyValue.second.size());
+		kvd.append(reinterpret_cast<const char*>(&length), 4);
+		kvd.append(keyValue.first);
+		kvd.push_back('\0');
+		kvd.append(keyValue.second);
+		kvd.resize(alignTo(kvd.size(), 4), '\0');
+	}
+	header.dfdByteOffset = static_cast<uint32_t>(
+	    sizeof(header) + levelCount * sizeof(Ktx2Level));
+	header.dfdByteLength = static_cast<uint32_t>(dfd.size() * 4);
+	header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+	header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+
+	// Levels are stored smallest first, each aligned to a whole block
+	std::vector<Ktx2Level> levels(levelCount);
+	size_t alignment = std::max<size_t>(4, info->blockBytes);
+	size_t offset = header.kvdByteOffset + header.kvdByteLength;
+	for (uint32_t i = levelCount; i-- > 0;) {
+		size_t size = (i + 1 < levelCount ? texture.levelOffsets[i + 1]
+		                                  : texture.staging.size) -
+		              texture.levelOffsets[i];
+		offset = alignTo(offset, alignment);
+		levels[i] = {offset, size, size};
+		offset += size;
+	}
+
+	std::string tempPath = path + ".tmp";
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to write KTX2 " + path + "!");
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(levels.data()),
+	           levelCount * sizeof(Ktx2Level));
+	file.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * 4);
+	file.write(kvd.data(), kvd.size());
+	for (uint32_t i = levelCount; i-- > 0;) {
+		static const char zeros[16] = {};
+		file.write(zeros, levels[i].byteOffset -
+		                      static_cast<uint64_t>(file.tellp()));
+		file.write(reinterpret_cast<const char*>(texture.staging.data +
+		                                         texture.levelOffsets[i]),
+		           levels[i].byteLength);
+	}
+	file.close();
+	// Renamed into place so a crash never leaves a torn file
+	if (!file || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+		std::remove(tempPath.c_str());
+		throw std::runtime_error("failed to write KTX2 " + path + "!");
+	}
+}
+
+bool mapKtx2Levels(const std::string& path, const Texture& texture,
+                   MappedFile& file, std::vector<Ktx2LevelRange>& levels) {
+	try {
+		file.map(path);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+	Ktx2Header header;
+	const FormatInfo* info;
+	std::vector<Ktx2Level> index;
+	if (indexLevels(file, header, info, index) ||
+	    info->format != texture.format ||
+	    header.pixelWidth != texture.width ||
+	    header.pixelHeight != texture.height ||
+	    index.size() != texture.mipLevels) {
+		file.unmap();
+		return false;
+	}
+	levels.resize(index.size());
+	for (size_t i = 0; i < index.size(); i++) {
+		levels[i] = {static_cast<size_t>(index[i].byteOffset),
+		             static_cast<size_t>(index[i].byteLength)};
+	}
+	return true;
+}
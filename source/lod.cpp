@@ -0,0 +1,368 @@
+#include "lod.h"
+#include "include.h"
+#include "util.h"
+
+namespace {
+	enum VertexKind : uint8_t {
+		kManifold,
+		kBorder,
+		kLocked,
+	};
+
+	struct Quadric {
+		float a00, a11, a22;
+		float a01, a02, a12;
+		float b0, b1, b2;
+		float c;
+		float w;
+	};
+
+	void quadricAdd(Quadric& q, const Quadric& r) {
+		q.a00 += r.a00;
+		q.a11 += r.a11;
+		q.a22 += r.a22;
+		q.a01 += r.a01;
+		q.a02 += r.a02;
+		q.a12 += r.a12;
+		q.b0 += r.b0;
+		q.b1 += r.b1;
+		q.b2 += r.b2;
+		q.c += r.c;
+		q.w += r.w;
+	}
+
+	Quadric quadricFromPlane(glm::vec3 n, float d, float w) {
+		Quadric q;
+		q.a00 = w * n.x * n.x;
+		q.a11 = w * n.y * n.y;
+		q.a22 = w * n.z * n.z;
+		q.a01 = w * n.x * n.y;
+		q.a02 = w * n.x * n.z;
+		q.a12 = w * n.y * n.z;
+		q.b0 = w * n.x * d;
+		q.b1 = w * n.y * d;
+		q.b2 = w * n.z * d;
+		q.c = w * d * d;
+		q.w = w;
+		return q;
+	}
+
+	// Squared distance from p to the planes accumulated in q
+	float quadricError(const Quadric& q, glm::vec3 p) {
+		float rx = q.a00 * p.x + q.a01 * p.y + q.a02 * p.z;
+		float ry = q.a01 * p.x + q.a11 * p.y + q.a12 * p.z;
+		float rz = q.a02 * p.x + q.a12 * p.y + q.a22 * p.z;
+		float r = rx * p.x + ry * p.y + rz * p.z +
+		          2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+		return q.w == 0.0f ? 0.0f : std::fabs(r) / q.w;
+	}
+
+	uint64_t edgeKey(uint32_t a, uint32_t b) {
+		return (static_cast<uint64_t>(a) << 32) | b;
+	}
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		float error;
+	};
+
+	struct Simplifier {
+		const std::vector<Vertex>& vertices;
+		std::vector<uint32_t> weld;
+		std::vector<uint8_t> kind;
+		std::unordered_map<uint64_t, uint32_t> halfEdges;
+		std::vector<Quadric> quadrics;
+
+		// Triangle adjacency, rebuilt every pass
+		std::vector<uint32_t> triOffsets;
+		std::vector<uint32_t> triCounts;
+		std::vector<uint32_t> triList;
+
+		Simplifier(const std::vector<Vertex>& vertices) : vertices(vertices) {}
+
+		bool isBorderEdge(uint32_t a, uint32_t b) const {
+			uint32_t wa = weld[a], wb = weld[b];
+			return halfEdges.count(edgeKey(wa, wb)) == 0 ||
+			       halfEdges.count(edgeKey(wb, wa)) == 0;
+		}
+
+		void classify(const std::vector<uint32_t>& indices) {
+			size_t vertexCount = vertices.size();
+			weld.resize(vertexCount);
+			std::unordered_map<glm::vec3, uint32_t> positions;
+			std::vector<uint32_t> wedges(vertexCount, 0);
+			for (uint32_t i = 0; i < vertexCount; i++) {
+				auto it = positions.emplace(vertices[i].pos, i).first;
+				weld[i] = it->second;
+				wedges[weld[i]]++;
+			}
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				for (int e = 0; e < 3; e++) {
+					uint32_t a = weld[indices[i + e]];
+					uint32_t b = weld[indices[i + (e + 1) % 3]];
+					halfEdges[edgeKey(a, b)]++;
+				}
+			}
+			kind.assign(vertexCount, kManifold);
+			for (uint32_t i = 0; i < vertexCount; i++) {
+				// Texture seams would tear if either side moved on its own
+				if (wedges[weld[i]] > 1) {
+					kind[i] = kLocked;
+				}
+			}
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				for (int e = 0; e < 3; e++) {
+					uint32_t a = indices[i + e];
+					uint32_t b = indices[i + (e + 1) % 3];
+					if (!isBorderEdge(a, b)) {
+						continue;
+					}
+					for (uint32_t v : {a, b}) {
+						if (kind[v] == kManifold) {
+							kind[v] = kBorder;
+						}
+					}
+				}
+			}
+			// Non-manifold edges lock their vertices
+			for (const auto& halfEdge : halfEdges) {
+				if (halfEdge.second > 1) {
+					kind[halfEdge.first >> 32] = kLocked;
+					kind[halfEdge.first & 0xffffffff] = kLocked;
+				}
+			}
+		}
+
+		void computeQuadrics(const std::vector<uint32_t>& indices) {
+			quadrics.assign(vertices.size(), Quadric {});
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				uint32_t tri[3] = {indices[i], indices[i + 1], indices[i + 2]};
+				glm::vec3 p0 = vertices[tri[0]].pos;
+				glm::vec3 p1 = vertices[tri[1]].pos;
+				glm::vec3 p2 = vertices[tri[2]].pos;
+				glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(n);
+				if (area == 0.0f) {
+					continue;
+				}
+				n = n / area;
+				Quadric q = quadricFromPlane(n, -glm::dot(n, p0), area);
+				for (uint32_t v : tri) {
+					quadricAdd(quadrics[v], q);
+				}
+				for (int e = 0; e < 3; e++) {
+					uint32_t a = tri[e];
+					uint32_t b = tri[(e + 1) % 3];
+					if (!isBorderEdge(a, b)) {
+						continue;
+					}
+					// Plane through the border edge, perpendicular to the
+					// triangle, keeps the outline in place
+					glm::vec3 edge = vertices[b].pos - vertices[a].pos;
+					float length = glm::length(edge);
+					if (length == 0.0f) {
+						continue;
+					}
+					glm::vec3 bn = glm::normalize(glm::cross(edge, n));
+					Quadric bq = quadricFromPlane(
+					    bn, -glm::dot(bn, vertices[a].pos), length * length * 10.0f);
+					quadricAdd(quadrics[a], bq);
+					quadricAdd(quadrics[b], bq);
+				}
+			}
+		}
+
+		void buildAdjacency(const std::vector<uint32_t>& indices) {
+			size_t vertexCount = vertices.size();
+			triCounts.assign(vertexCount, 0);
+			triOffsets.assign(vertexCount, 0);
+			for (uint32_t index : indices) {
+				triCounts[index]++;
+			}
+			uint32_t offset = 0;
+			for (size_t i = 0; i < vertexCount; i++) {
+				triOffsets[i] = offset;
+				offset += triCounts[i];
+			}
+			triList.resize(indices.size());
+			std::vector<uint32_t> fill = triOffsets;
+			for (size_t i = 0; i < indices.size(); i++) {
+				triList[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		bool canCollapse(uint32_t from, uint32_t to) const {
+			if (kind[from] == kManifold) {
+				return true;
+			}
+			if (kind[from] == kBorder) {
+				return kind[to] == kBorder && isBorderEdge(from, to);
+			}
+			return false;
+		}
+
+		bool flipsTriangle(const std::vector<uint32_t>& indices, uint32_t from,
+		                   uint32_t to) const {
+			glm::vec3 target = vertices[to].pos;
+			for (uint32_t t = 0; t < triCounts[from]; t++) {
+				uint32_t tri = triList[triOffsets[from] + t];
+				uint32_t a = indices[tri * 3 + 0];
+				uint32_t b = indices[tri * 3 + 1];
+				uint32_t c = indices[tri * 3 + 2];
+				if (a == to || b == to || c == to) {
+					continue;
+				}
+				// Rotate so that a is the vertex being moved
+				while (a != from) {
+					uint32_t tmp = a;
+					a = b;
+					b = c;
+					c = tmp;
+				}
+				glm::vec3 pb = vertices[b].pos;
+				glm::vec3 pc = vertices[c].pos;
+				glm::vec3 before = glm::cross(pb - vertices[a].pos, pc - vertices[a].pos);
+				glm::vec3 after = glm::cross(pb - target, pc - target);
+				if (glm::dot(before, after) <= 0.0f) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Performs one round of non-overlapping collapses; returns how many
+		size_t pass(std::vector<uint32_t>& indices, size_t targetIndexCount,
+		            float maxErrorSq, float& resultErrorSq) {
+			buildAdjacency(indices);
+			std::vector<Collapse> collapses;
+			collapses.reserve(indices.size());
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				for (int e = 0; e < 3; e++) {
+					uint32_t a = indices[i + e];
+					uint32_t b = indices[i + (e + 1) % 3];
+					for (int dir = 0; dir < 2; dir++) {
+						uint32_t from = dir ? b : a;
+						uint32_t to = dir ? a : b;
+						if (!canCollapse(from, to)) {
+							continue;
+						}
+						Quadric q = quadrics[from];
+						quadricAdd(q, quadrics[to]);
+						collapses.push_back(
+						    {from, to, quadricError(q, vertices[to].pos)});
+					}
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(),
+			          [](const Collapse& l, const Collapse& r) {
+				          return l.error < r.error;
+			          });
+			// Each collapse removes roughly two triangles
+			size_t goal = (indices.size() - targetIndexCount) / 6 + 1;
+			std::vector<uint32_t> remap(vertices.size());
+			for (uint32_t i = 0; i < remap.size(); i++) {
+				remap[i] = i;
+			}
+			std::vector<uint8_t> locked(vertices.size(), 0);
+			size_t performed = 0;
+			for (const Collapse& collapse : collapses) {
+				if (collapse.error > maxErrorSq || performed >= goal) {
+					break;
+				}
+				if (locked[collapse.from] || locked[collapse.to] ||
+				    flipsTriangle(indices, collapse.from, collapse.to)) {
+					continue;
+				}
+				remap[collapse.from] = collapse.to;
+				quadricAdd(quadrics[collapse.to], quadrics[collapse.from]);
+				// Freeze the one-ring so later collapses in this pass see the
+				// geometry their flip test was run against
+				for (uint32_t t = 0; t < triCounts[collapse.from]; t++) {
+					uint32_t tri = triList[triOffsets[collapse.from] + t];
+					locked[indices[tri * 3 + 0]] = 1;
+					locked[indices[tri * 3 + 1]] = 1;
+					locked[indices[tri * 3 + 2]] = 1;
+				}
+				resultErrorSq = std::max(resultErrorSq, collapse.error);
+				performed++;
+			}
+			size_t write = 0;
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				uint32_t a = remap[indices[i + 0]];
+				uint32_t b = remap[indices[i + 1]];
+				uint32_t c = remap[indices[i + 2]];
+				if (a == b || b == c || a == c) {
+					continue;
+				}
+				indices[write++] = a;
+				indices[write++] = b;
+				indices[write++] = c;
+			}
+			indices.resize(write);
+			return performed;
+		}
+	};
+} // namespace
+
+void buildLods(const std::vector<Vertex>& vertices,
+               std::vector<uint32_t>& indices, std::vector<LodLevel>& lods,
+               float radius) {
+	lods.clear();
+	lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f, 0, 0});
+	if (indices.empty() || radius <= 0.0f) {
+		return;
+	}
+	Simplifier simplifier(vertices);
+	simplifier.classify(indices);
+	simplifier.computeQuadrics(indices);
+	std::vector<uint32_t> current = indices;
+	float maxErrorSq = (LOD_MAX_ERROR * radius) * (LOD_MAX_ERROR * radius);
+	float resultErrorSq = 0.0f;
+	while (lods.size() < MAX_LOD_LEVELS) {
+		size_t previousCount = current.size();
+		size_t target =
+		    static_cast<size_t>(previousCount * LOD_REDUCTION) / 3 * 3;
+		while (current.size() > target &&
+		       simplifier.pass(current, target, maxErrorSq, resultErrorSq) >
+		           0) {
+		}
+		// Not worth a level if the error bound stopped us early
+		if (current.size() > previousCount * (LOD_REDUCTION + 1.0f) / 2.0f ||
+		    current.empty()) {
+			break;
+		}
+		lods.push_back({static_cast<uint32_t>(indices.size()),
+		                static_cast<uint32_t>(current.size()),
+		                std::sqrt(resultErrorSq) / radius, 0, 0});
+		indices.insert(indices.end(), current.begin(), current.end());
+	}
+}
+
+float projectedRadius(const glm::mat4& modelView, float projScale,
+                      float viewportHeight, glm::vec3 center, float radius) {
+	glm::vec4 viewCenter = modelView * glm::vec4(center, 1.0f);
+	float distance = glm::length(glm::vec3(viewCenter));
+	if (distance <= radius) {
+		return std::numeric_limits<float>::max();
+	}
+	return radius / distance * std::fabs(projScale) * viewportHeight * 0.5f;
+}
+
+uint32_t selectLod(const std::vector<LodLevel>& lods, uint32_t currentLod,
+                   float screenRadius) {
+	if (lods.empty()) {
+		return 0;
+	}
+	uint32_t lod = std::min(currentLod, static_cast<uint32_t>(lods.size() - 1));
+	while (lod > 0 && lods[lod].error * screenRadius >
+	                      LOD_PIXEL_ERROR * (1.0f + LOD_HYSTERESIS)) {
+		lod--;
+	}
+	while (lod + 1 < lods.size() &&
+	       lods[lod + 1].error * screenRadius <
+	           LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS)) {
+		lod++;
+	}
+	return lod;
+}
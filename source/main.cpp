@@ -1,13 +1,18 @@
+#include "batch.h"
 #include "commander.h"
 #include "descriptor.h"
 #include "device.h"
 #include "include.h"
 #include "instance.h"
 #include "model.h"
+#include "overdraw.h"
+#include "pipelinestats.h"
 #include "renderer.h"
 #include "surface.h"
 #include "sync.h"
 #include "texture.h"
+#include "texturestream.h"
+#include "trace.h"
 #include "util.h"
 
 //#define NDEBUG
@@ -25,12 +30,56 @@ void run(Instance* instance) {
 	instance->waitIdle();
 }
 
-int main() {
+// Renders every job in the manifest offscreen, then exits
+int runBatch(Instance* instance, const std::string& manifestPath) {
+	BatchManifest manifest = readBatchManifest(manifestPath);
+	// Device selection still goes through a surface, but nothing is shown
+	instance->surface->visible = false;
+	instance->createCore(enableValidationLayers);
+	BatchRenderer batch;
+	batch.create(instance, manifest);
+	size_t failed = batch.run(instance);
+	batch.destroy(instance);
+	instance->destroyCore();
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char** argv) {
 	Instance instance = Instance();
+	std::string batchManifest;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+			instance.deviceSelector = argv[++i];
+		} else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+			batchManifest = argv[++i];
+		} else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			instance.captureDirectory = argv[++i];
+		} else if (strcmp(argv[i], "--capture-raw") == 0) {
+			instance.captureRaw = true;
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			instance.statistics->enabled = true;
+		} else if (strcmp(argv[i], "--overdraw") == 0) {
+			instance.overdraw->enabled = true;
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			startTrace(argv[++i]);
+		} else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+			instance.streamer->limit =
+			    std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+		}
+	}
+	if (!batchManifest.empty()) {
+		try {
+			return runBatch(&instance, batchManifest);
+		} catch (const std::exception& e) {
+			std::cerr << e.what() << '\n';
+			return EXIT_FAILURE;
+		}
+	}
 	instance.create(enableValidationLayers);
 	std::cout << "Instance created" << std::endl;
 	try {
 		run(&instance);
+		instance.destroy();
 	} catch (const std::exception& e) {
 		std::cerr << e.what() << '\n';
 		return EXIT_FAILURE;
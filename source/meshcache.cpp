@@ -0,0 +1,254 @@
+#include "meshcache.h"
+#include "include.h"
+#include "lod.h"
+#include "meshcodec.h"
+#include "meshlet.h"
+#include "model.h"
+#include "staging.h"
+#include "util.h"
+#include "vertexlayout.h"
+
+namespace {
+	constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+	uint64_t alignSection(uint64_t offset) {
+		return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+	}
+
+	bool sectionFits(const MappedFile& file, uint64_t offset, uint64_t size) {
+		return offset % SECTION_ALIGNMENT == 0 && offset <= file.size &&
+		       size <= file.size - offset;
+	}
+
+	bool rangeFits(uint32_t first, uint32_t count, uint64_t end) {
+		return uint64_t(first) + count <= end;
+	}
+
+	// Every draw the cache describes has to stay inside its buffers
+	bool rangesFit(const MeshCacheHeader& header, const LodLevel* lods,
+	               const Meshlet* meshlets) {
+		for (uint32_t i = 0; i < header.meshletCount; i++) {
+			if (!rangeFits(meshlets[i].firstIndex, meshlets[i].indexCount,
+			               header.indexCount)) {
+				return false;
+			}
+		}
+		for (uint32_t i = 0; i < header.lodCount; i++) {
+			const LodLevel& lod = lods[i];
+			if (!rangeFits(lod.firstIndex, lod.indexCount, header.indexCount) ||
+			    !rangeFits(lod.firstMeshlet, lod.meshletCount,
+			               header.meshletCount)) {
+				return false;
+			}
+			uint64_t lodEnd = uint64_t(lod.firstIndex) + lod.indexCount;
+			for (uint32_t j = 0; j < lod.meshletCount; j++) {
+				const Meshlet& meshlet = meshlets[lod.firstMeshlet + j];
+				if (meshlet.firstIndex < lod.firstIndex ||
+				    !rangeFits(meshlet.firstIndex, meshlet.indexCount,
+				               lodEnd)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool indicesFit(const uint32_t* indices, uint32_t indexCount,
+	                uint32_t vertexCount) {
+		for (uint32_t i = 0; i < indexCount; i++) {
+			if (indices[i] >= vertexCount) {
+				return false;
+			}
+		}
+		return true;
+	}
+} // namespace
+
+std::string getMeshCachePath(const std::string& sourcePath) {
+	return sourcePath + ".meshcache";
+}
+
+bool readMeshCache(const std::string& sourcePath, Model& model) {
+	MappedFile file;
+	try {
+		file.map(getMeshCachePath(sourcePath));
+	} catch (const std::exception&) {
+		return false;
+	}
+	MeshCacheHeader header;
+	bool valid = file.size >= sizeof(header);
+	if (valid) {
+		memcpy(&header, file.data, sizeof(header));
+		VertexLayout layout = model.layout;
+		layout.normals = header.normals != 0;
+		uint64_t vertexBytes =
+		    header.compressed
+		        ? header.vertexBytes
+		        : uint64_t(header.vertexCount) * header.vertexStride;
+		uint64_t indexBytes =
+		    header.compressed ? header.indexBytes
+		                      : sizeof(uint32_t) * uint64_t(header.indexCount);
+		valid =
+		    header.magic == MESH_CACHE_MAGIC &&
+		    header.version == MESH_CACHE_VERSION &&
+		    header.positionFormat ==
+		        static_cast<uint32_t>(layout.position) &&
+		    header.texCoordFormat ==
+		        static_cast<uint32_t>(layout.texCoord) &&
+		    header.requestedNormals == model.layout.normals &&
+		    header.colour == layout.colour &&
+		    header.vertexStride == layout.getStride() &&
+		    sectionFits(file, header.vertexOffset, vertexBytes) &&
+		    sectionFits(file, header.indexOffset, indexBytes) &&
+		    sectionFits(file, header.lodOffset,
+		                sizeof(LodLevel) * uint64_t(header.lodCount)) &&
+		    sectionFits(file, header.meshletOffset,
+		                sizeof(Meshlet) * uint64_t(header.meshletCount)) &&
+		    header.lodCount > 0 && sourceMatches(sourcePath, header.source);
+	}
+	if (!valid) {
+		file.unmap();
+		return false;
+	}
+	const LodLevel* lods =
+	    reinterpret_cast<const LodLevel*>(file.data + header.lodOffset);
+	const Meshlet* meshlets =
+	    reinterpret_cast<const Meshlet*>(file.data + header.meshletOffset);
+	// A torn or stale cache can pass the header checks, so a bad range is
+	// a miss rather than an out of bounds draw
+	if (!rangesFit(header, lods, meshlets)) {
+		file.unmap();
+		return false;
+	}
+	bool requestedNormals = model.layout.normals;
+	model.layout.normals = header.normals != 0;
+	model.allocateStaging(header.vertexCount, header.indexCount);
+	const uint8_t* vertexSection = file.data + header.vertexOffset;
+	const uint8_t* indexSection = file.data + header.indexOffset;
+	bool decoded = true;
+	if (!header.compressed) {
+		const uint32_t* indices =
+		    reinterpret_cast<const uint32_t*>(indexSection);
+		decoded = indicesFit(indices, header.indexCount, header.vertexCount);
+		if (decoded) {
+			memcpy(model.vertexStaging.data, vertexSection,
+			       model.vertexStaging.size);
+			model.writeIndices(indices);
+		}
+	} else if (model.indexType == VK_INDEX_TYPE_UINT32) {
+		uint32_t* indices =
+		    reinterpret_cast<uint32_t*>(model.indexStaging.data);
+		decoded =
+		    decodeVertexBuffer(vertexSection, header.vertexBytes,
+		                       header.vertexCount, header.vertexStride,
+		                       model.vertexStaging.data) &&
+		    decodeIndexBuffer(indexSection, header.indexBytes,
+		                      header.indexCount, indices) &&
+		    indicesFit(indices, header.indexCount, header.vertexCount);
+	} else {
+		// Small enough that narrowing through a temporary costs nothing
+		std::vector<uint32_t> indices(header.indexCount);
+		decoded = decodeVertexBuffer(vertexSection, header.vertexBytes,
+		                             header.vertexCount, header.vertexStride,
+		                             model.vertexStaging.data) &&
+		          decodeIndexBuffer(indexSection, header.indexBytes,
+		                            header.indexCount, indices.data()) &&
+		          indicesFit(indices.data(), header.indexCount,
+		                     header.vertexCount);
+		if (decoded) {
+			model.writeIndices(indices.data());
+		}
+	}
+	if (!decoded) {
+		model.releaseMeshStaging();
+		model.layout.normals = requestedNormals;
+		file.unmap();
+		return false;
+	}
+	model.lods.assign(lods, lods + header.lodCount);
+	model.meshlets.assign(meshlets, meshlets + header.meshletCount);
+	model.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1],
+	                            header.boundsMin[2]);
+	model.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1],
+	                            header.boundsMax[2]);
+	model.center =
+	    glm::vec3(header.center[0], header.center[1], header.center[2]);
+	model.radius = header.radius;
+	file.unmap();
+	return true;
+}
+
+void writeMeshCache(const std::string& sourcePath, const Model& model,
+                    const VertexLayout& requested) {
+	MeshCacheHeader header = {};
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	if (!stampSource(sourcePath, header.source)) {
+		return;
+	}
+	header.positionFormat = static_cast<uint32_t>(requested.position);
+	header.texCoordFormat = static_cast<uint32_t>(requested.texCoord);
+	header.requestedNormals = requested.normals;
+	header.colour = requested.colour;
+	header.normals = model.layout.normals;
+	header.vertexCount = model.vertexCount;
+	header.vertexStride = model.layout.getStride();
+	header.indexCount = model.indexCount;
+	header.lodCount = static_cast<uint32_t>(model.lods.size());
+	header.meshletCount = static_cast<uint32_t>(model.meshlets.size());
+	for (int i = 0; i < 3; i++) {
+		header.boundsMin[i] = model.boundsMin[i];
+		header.boundsMax[i] = model.boundsMax[i];
+		header.center[i] = model.center[i];
+	}
+	header.radius = model.radius;
+	// The staged vertices are already in their GPU format
+	const void* vertexSection = model.vertexStaging.data;
+	const void* indexSection = model.indices.data();
+	header.vertexBytes = model.vertexStaging.size;
+	header.indexBytes = sizeof(uint32_t) * model.indices.size();
+	std::vector<uint8_t> encodedVertices;
+	std::vector<uint8_t> encodedIndices;
+	if (MESH_CACHE_COMPRESSION) {
+		encodeVertexBuffer(model.vertexStaging.data, model.vertexCount,
+		                   header.vertexStride, encodedVertices);
+		encodeIndexBuffer(model.indices.data(), model.indices.size(),
+		                  encodedIndices);
+		header.compressed = 1;
+		vertexSection = encodedVertices.data();
+		indexSection = encodedIndices.data();
+		header.vertexBytes = encodedVertices.size();
+		header.indexBytes = encodedIndices.size();
+	}
+	header.vertexOffset = alignSection(sizeof(header));
+	header.indexOffset = alignSection(header.vertexOffset + header.vertexBytes);
+	header.lodOffset = alignSection(header.indexOffset + header.indexBytes);
+	header.meshletOffset =
+	    alignSection(header.lodOffset + sizeof(LodLevel) * model.lods.size());
+
+	// Written under a temporary name so a crash never leaves a torn cache
+	std::string cachePath = getMeshCachePath(sourcePath);
+	std::string tempPath = cachePath + ".tmp";
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "failed to write mesh cache " << cachePath << std::endl;
+		return;
+	}
+	auto writeSection = [&](uint64_t offset, const void* data, size_t bytes) {
+		static const char zeros[SECTION_ALIGNMENT] = {};
+		file.write(zeros, offset - static_cast<uint64_t>(file.tellp()));
+		file.write(static_cast<const char*>(data), bytes);
+	};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	writeSection(header.vertexOffset, vertexSection, header.vertexBytes);
+	writeSection(header.indexOffset, indexSection, header.indexBytes);
+	writeSection(header.lodOffset, model.lods.data(),
+	             sizeof(LodLevel) * model.lods.size());
+	writeSection(header.meshletOffset, model.meshlets.data(),
+	             sizeof(Meshlet) * model.meshlets.size());
+	file.close();
+	if (!file || std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+		std::remove(tempPath.c_str());
+		std::cerr << "failed to write mesh cache " << cachePath << std::endl;
+	}
+}
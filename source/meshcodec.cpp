@@ -0,0 +1,602 @@
+#include "meshcodec.h"
+#include "include.h"
+#include "threadpool.h"
+#include "trace.h"
+
+#include <atomic>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Elements transposed per SSE2 step
+	constexpr size_t GROUP_SIZE = 16;
+
+	// rANS with frequencies summing to RANS_TOTAL and a 32-bit state kept
+	// at RANS_LOW or above by shifting in 16-bit words. Any symbol leaves
+	// the state above RANS_LOW >> 16, so one word always refills it.
+	constexpr uint32_t RANS_PROB_BITS = 12;
+	constexpr uint32_t RANS_TOTAL = 1u << RANS_PROB_BITS;
+	constexpr uint32_t RANS_LOW = 1u << 16;
+	// Independent states, so decoding one symbol needn't wait for the last
+	constexpr size_t RANS_STATES = 4;
+	// The most a symbol can take to renormalise
+	constexpr size_t RANS_MAX_SYMBOL_BYTES = 2;
+
+	// Constant planes hold one symbol throughout, which rANS would spend
+	// no bits on but still step through
+	enum PlaneMode : uint8_t { Raw = 0, Rans = 1, Constant = 2 };
+
+	// One entry per slot of the state's low bits: the symbol in the low
+	// byte, then the slot's offset into the symbol's range and its frequency
+	// in 12 bits each. Single symbol planes are Constant, so no frequency
+	// needs all 13 bits.
+	typedef std::array<uint32_t, RANS_TOTAL> RansTable;
+
+	// How a plane is coded, shared by all its chunks
+	struct Plane {
+		uint8_t mode;
+		// Constant planes keep their symbol in the first entry
+		RansTable table;
+	};
+
+	// One plane of one chunk, decoded a block at a time
+	struct PlaneCursor {
+		const uint8_t* p;
+		const uint8_t* end;
+		uint32_t state[RANS_STATES];
+	};
+
+	uint8_t zigzag8(uint8_t value) {
+		return static_cast<uint8_t>((value << 1) ^ -(value >> 7));
+	}
+
+	uint8_t unzigzag8(uint8_t value) {
+		return static_cast<uint8_t>((value >> 1) ^ -(value & 1));
+	}
+
+	uint32_t zigzag32(uint32_t value) {
+		return (value << 1) ^ (0u - (value >> 31));
+	}
+
+	uint32_t unzigzag32(uint32_t value) {
+		return (value >> 1) ^ (0u - (value & 1));
+	}
+
+	// Scales symbol counts to frequencies summing to RANS_TOTAL, keeping
+	// every symbol that occurs at 1 or more
+	void normaliseFrequencies(const size_t counts[256], size_t total,
+	                          uint32_t freq[256]) {
+		uint32_t sum = 0;
+		int largest = 0;
+		for (int s = 0; s < 256; s++) {
+			freq[s] = 0;
+			if (counts[s] > 0) {
+				freq[s] = std::max<uint32_t>(
+				    1, static_cast<uint32_t>(counts[s] * RANS_TOTAL / total));
+				sum += freq[s];
+			}
+			if (freq[s] > freq[largest]) {
+				largest = s;
+			}
+		}
+		if (sum <= RANS_TOTAL) {
+			freq[largest] += RANS_TOTAL - sum;
+			return;
+		}
+		// Rounding rare symbols up overshot; take it back from common ones
+		while (sum > RANS_TOTAL) {
+			for (int s = 0; s < 256 && sum > RANS_TOTAL; s++) {
+				if (freq[s] > 1 && freq[s] * 2 > freq[largest]) {
+					freq[s]--;
+					sum--;
+				}
+			}
+			largest = static_cast<int>(
+			    std::max_element(freq, freq + 256) - freq);
+		}
+	}
+
+	// Codes one plane after its header: the symbols are encoded last to
+	// first so they decode first to last, and the bytes come out reversed
+	void encodeRans(const uint8_t* symbols, size_t count,
+	                const uint32_t freq[256], std::vector<uint8_t>& out) {
+		uint32_t start[256];
+		uint32_t next = 0;
+		for (int s = 0; s < 256; s++) {
+			start[s] = next;
+			next += freq[s];
+		}
+		std::vector<uint8_t> reversed;
+		reversed.reserve(count + RANS_STATES * 4);
+		uint32_t state[RANS_STATES];
+		std::fill(state, state + RANS_STATES, RANS_LOW);
+		for (size_t i = count; i-- > 0;) {
+			uint32_t& x = state[i % RANS_STATES];
+			uint8_t s = symbols[i];
+			uint32_t limit = ((RANS_LOW >> RANS_PROB_BITS) << 16) * freq[s];
+			if (x >= limit) {
+				// Little endian once the bytes are reversed
+				reversed.push_back(static_cast<uint8_t>(x >> 8));
+				reversed.push_back(static_cast<uint8_t>(x));
+				x >>= 16;
+			}
+			x = ((x / freq[s]) << RANS_PROB_BITS) + x % freq[s] + start[s];
+		}
+		// Read back first, as little endian words
+		for (size_t j = RANS_STATES; j-- > 0;) {
+			for (int shift = 24; shift >= 0; shift -= 8) {
+				reversed.push_back(static_cast<uint8_t>(state[j] >> shift));
+			}
+		}
+		out.insert(out.end(), reversed.rbegin(), reversed.rend());
+	}
+
+	uint8_t decodeSymbol(uint32_t& x, const RansTable& table,
+	                     const uint8_t*& p) {
+		uint32_t entry = table[x & (RANS_TOTAL - 1)];
+		x = (entry >> 20) * (x >> RANS_PROB_BITS) + (entry >> 8 & 0xfff);
+		// Whether a word is needed is close to random, so it's shifted in
+		// with arithmetic rather than behind a branch
+		uint16_t word;
+		memcpy(&word, p, sizeof(word));
+		uint32_t refill = x < RANS_LOW;
+		x = x << (refill * 16) | (word & (0u - refill));
+		p += refill * sizeof(word);
+		return static_cast<uint8_t>(entry);
+	}
+
+	// Checks every read against end, for the last bytes of a plane
+	bool decodeSymbolChecked(uint32_t& x, const RansTable& table,
+	                         const uint8_t*& p, const uint8_t* end,
+	                         uint8_t& s) {
+		uint32_t entry = table[x & (RANS_TOTAL - 1)];
+		s = static_cast<uint8_t>(entry);
+		x = (entry >> 20) * (x >> RANS_PROB_BITS) + (entry >> 8 & 0xfff);
+		if (x < RANS_LOW) {
+			if (end - p < 2) {
+				return false;
+			}
+			x = x << 16 | p[0] | p[1] << 8;
+			p += 2;
+		}
+		return true;
+	}
+
+	// Decodes the next count symbols of a plane's chunk. first is the index
+	// of the first of them within the chunk, which picks the state.
+	bool decodePlane(const Plane& plane, PlaneCursor& cursor, size_t first,
+	                 size_t count, uint8_t* out) {
+		if (plane.mode == Constant) {
+			memset(out, plane.table[0], count);
+			return true;
+		}
+		if (plane.mode == Raw) {
+			if (static_cast<size_t>(cursor.end - cursor.p) < count) {
+				return false;
+			}
+			memcpy(out, cursor.p, count);
+			cursor.p += count;
+			return true;
+		}
+		const RansTable& table = plane.table;
+		const uint8_t* p = cursor.p;
+		size_t i = 0;
+		if (first % RANS_STATES == 0 &&
+		    static_cast<size_t>(cursor.end - p) >=
+		        count * RANS_MAX_SYMBOL_BYTES) {
+			// Plenty left, so no symbol can read past the end
+			uint32_t x0 = cursor.state[0];
+			uint32_t x1 = cursor.state[1];
+			uint32_t x2 = cursor.state[2];
+			uint32_t x3 = cursor.state[3];
+			for (; i + RANS_STATES <= count; i += RANS_STATES) {
+				out[i + 0] = decodeSymbol(x0, table, p);
+				out[i + 1] = decodeSymbol(x1, table, p);
+				out[i + 2] = decodeSymbol(x2, table, p);
+				out[i + 3] = decodeSymbol(x3, table, p);
+			}
+			cursor.state[0] = x0;
+			cursor.state[1] = x1;
+			cursor.state[2] = x2;
+			cursor.state[3] = x3;
+		}
+		for (; i < count; i++) {
+			uint32_t& x = cursor.state[(first + i) % RANS_STATES];
+			if (!decodeSymbolChecked(x, table, p, cursor.end, out[i])) {
+				return false;
+			}
+		}
+		cursor.p = p;
+		return true;
+	}
+
+	// Reads a plane's mode, and for rANS planes the frequency table
+	bool readPlaneHeader(const uint8_t*& p, const uint8_t* end,
+	                     Plane& plane) {
+		if (p == end) {
+			return false;
+		}
+		plane.mode = *p++;
+		if (plane.mode == Raw) {
+			return true;
+		}
+		if (plane.mode == Constant) {
+			if (p == end) {
+				return false;
+			}
+			plane.table[0] = *p++;
+			return true;
+		}
+		if (plane.mode != Rans || p == end) {
+			return false;
+		}
+		size_t symbols = size_t(*p++) + 1;
+		if (static_cast<size_t>(end - p) < symbols * 3) {
+			return false;
+		}
+		RansTable& table = plane.table;
+		uint32_t next = 0;
+		for (size_t j = 0; j < symbols; j++, p += 3) {
+			uint32_t freq = p[1] | p[2] << 8;
+			// Symbols are stored in order, so none can repeat
+			if (freq == 0 || freq == RANS_TOTAL ||
+			    freq > RANS_TOTAL - next || (j > 0 && p[0] <= p[-3])) {
+				return false;
+			}
+			for (uint32_t slot = 0; slot < freq; slot++) {
+				table[next + slot] = p[0] | slot << 8 | freq << 20;
+			}
+			next += freq;
+		}
+		return next == RANS_TOTAL;
+	}
+
+	// Points the cursor at its plane's data for one chunk, which starts at p
+	bool startPlane(const uint8_t*& p, const uint8_t* end, size_t size,
+	                const Plane& plane, PlaneCursor& cursor) {
+		if (static_cast<size_t>(end - p) < size) {
+			return false;
+		}
+		cursor.p = p;
+		cursor.end = p + size;
+		p += size;
+		if (plane.mode == Rans) {
+			if (size < sizeof(cursor.state)) {
+				return false;
+			}
+			memcpy(cursor.state, cursor.p, sizeof(cursor.state));
+			cursor.p += sizeof(cursor.state);
+			for (uint32_t x : cursor.state) {
+				if (x < RANS_LOW) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+#ifdef __SSE2__
+	__m128i load16(const uint8_t* data) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+	}
+
+	// Undoes zigzag8 on every byte
+	__m128i unzigzag8(__m128i v) {
+		__m128i half =
+		    _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x7f));
+		__m128i sign = _mm_sub_epi8(_mm_setzero_si128(),
+		                            _mm_and_si128(v, _mm_set1_epi8(1)));
+		return _mm_xor_si128(half, sign);
+	}
+#endif
+
+	// Interleaves the planes of a block back into elements. With delta the
+	// planes hold zigzag coded differences from the previous element, and
+	// last carries each byte of the previous element across blocks.
+	void transposeBlock(const uint8_t* planes, size_t count, size_t stride,
+	                    bool delta, uint8_t* last, uint8_t* out) {
+		size_t k = 0;
+#ifdef __SSE2__
+		for (; k + 4 <= stride; k += 4) {
+			const uint8_t* a = planes + (k + 0) * MESH_CODEC_BLOCK_SIZE;
+			const uint8_t* b = planes + (k + 1) * MESH_CODEC_BLOCK_SIZE;
+			const uint8_t* c = planes + (k + 2) * MESH_CODEC_BLOCK_SIZE;
+			const uint8_t* d = planes + (k + 3) * MESH_CODEC_BLOCK_SIZE;
+			int32_t previous;
+			memcpy(&previous, last + k, sizeof(previous));
+			__m128i carry = _mm_set1_epi32(previous);
+			size_t i = 0;
+			for (; i + GROUP_SIZE <= count; i += GROUP_SIZE) {
+				__m128i abLo = _mm_unpacklo_epi8(load16(a + i), load16(b + i));
+				__m128i abHi = _mm_unpackhi_epi8(load16(a + i), load16(b + i));
+				__m128i cdLo = _mm_unpacklo_epi8(load16(c + i), load16(d + i));
+				__m128i cdHi = _mm_unpackhi_epi8(load16(c + i), load16(d + i));
+				// Each row holds four consecutive elements' four bytes
+				__m128i rows[4] = {_mm_unpacklo_epi16(abLo, cdLo),
+				                   _mm_unpackhi_epi16(abLo, cdLo),
+				                   _mm_unpacklo_epi16(abHi, cdHi),
+				                   _mm_unpackhi_epi16(abHi, cdHi)};
+				uint8_t* dst = out + i * stride + k;
+				for (int r = 0; r < 4; r++) {
+					__m128i row = rows[r];
+					if (delta) {
+						row = unzigzag8(row);
+						row = _mm_add_epi8(row, _mm_slli_si128(row, 4));
+						row = _mm_add_epi8(row, _mm_slli_si128(row, 8));
+						row = _mm_add_epi8(row, carry);
+						carry = _mm_shuffle_epi32(row, 0xff);
+					}
+					for (int j = 0; j < 4; j++) {
+						int32_t element = _mm_cvtsi128_si32(row);
+						memcpy(dst + (r * 4 + j) * stride, &element, 4);
+						row = _mm_srli_si128(row, 4);
+					}
+				}
+			}
+			previous = _mm_cvtsi128_si32(carry);
+			memcpy(last + k, &previous, sizeof(previous));
+			for (; i < count; i++) {
+				for (size_t j = 0; j < 4; j++) {
+					uint8_t value = planes[(k + j) * MESH_CODEC_BLOCK_SIZE + i];
+					if (delta) {
+						last[k + j] += unzigzag8(value);
+						value = last[k + j];
+					}
+					out[i * stride + k + j] = value;
+				}
+			}
+		}
+#endif
+		for (; k < stride; k++) {
+			const uint8_t* plane = planes + k * MESH_CODEC_BLOCK_SIZE;
+			for (size_t i = 0; i < count; i++) {
+				uint8_t value = plane[i];
+				if (delta) {
+					last[k] += unzigzag8(value);
+					value = last[k];
+				}
+				out[i * stride + k] = value;
+			}
+		}
+	}
+
+	// Each byte of the stride becomes a plane of its own, coded with its
+	// own frequency table and stored raw when that doesn't shrink it. Planes
+	// are cut into chunks that code, and so decode, on their own: deltas
+	// restart and rANS planes start fresh states at each chunk. The plane
+	// headers come first, then each chunk's rANS plane sizes, then the
+	// chunks' planes.
+	void encodeElements(const uint8_t* elements, size_t count, size_t stride,
+	                    bool delta, std::vector<uint8_t>& out) {
+		size_t chunkCount =
+		    (count + MESH_CODEC_CHUNK_SIZE - 1) / MESH_CODEC_CHUNK_SIZE;
+		std::vector<uint8_t> symbols(count);
+		// Per plane, each chunk's coded bytes one after another
+		std::vector<std::vector<uint8_t>> planes(stride);
+		std::vector<std::vector<uint32_t>> chunkSizes(stride);
+		std::vector<uint8_t> modes(stride);
+		for (size_t k = 0; k < stride; k++) {
+			uint8_t last = 0;
+			size_t counts[256] = {};
+			for (size_t i = 0; i < count; i++) {
+				if (i % MESH_CODEC_CHUNK_SIZE == 0) {
+					last = 0;
+				}
+				uint8_t value = elements[i * stride + k];
+				symbols[i] = delta ? zigzag8(value - last) : value;
+				last = value;
+				counts[symbols[i]]++;
+			}
+			if (count > 0 && counts[symbols[0]] == count) {
+				modes[k] = Constant;
+				out.push_back(Constant);
+				out.push_back(symbols[0]);
+				continue;
+			}
+			if (count > 0) {
+				uint32_t freq[256];
+				normaliseFrequencies(counts, count, freq);
+				for (size_t c = 0; c < chunkCount; c++) {
+					size_t first = c * MESH_CODEC_CHUNK_SIZE;
+					size_t chunkStart = planes[k].size();
+					encodeRans(&symbols[first],
+					           std::min(MESH_CODEC_CHUNK_SIZE, count - first),
+					           freq, planes[k]);
+					chunkSizes[k].push_back(
+					    static_cast<uint32_t>(planes[k].size() - chunkStart));
+				}
+				size_t used = 256 - std::count(freq, freq + 256, 0u);
+				size_t overhead = 2 + used * 3 + chunkCount * 4;
+				if (planes[k].size() + overhead < count) {
+					modes[k] = Rans;
+					out.push_back(Rans);
+					out.push_back(static_cast<uint8_t>(used - 1));
+					for (int s = 0; s < 256; s++) {
+						if (freq[s] > 0) {
+							out.push_back(static_cast<uint8_t>(s));
+							out.push_back(static_cast<uint8_t>(freq[s]));
+							out.push_back(static_cast<uint8_t>(freq[s] >> 8));
+						}
+					}
+					continue;
+				}
+			}
+			modes[k] = Raw;
+			out.push_back(Raw);
+			planes[k].assign(symbols.begin(), symbols.end());
+		}
+		for (size_t c = 0; c < chunkCount; c++) {
+			for (size_t k = 0; k < stride; k++) {
+				if (modes[k] == Rans) {
+					const uint8_t* bytes =
+					    reinterpret_cast<const uint8_t*>(&chunkSizes[k][c]);
+					out.insert(out.end(), bytes, bytes + sizeof(uint32_t));
+				}
+			}
+		}
+		std::vector<size_t> offsets(stride, 0);
+		for (size_t c = 0; c < chunkCount; c++) {
+			size_t chunkElements = std::min(MESH_CODEC_CHUNK_SIZE,
+			                                count - c * MESH_CODEC_CHUNK_SIZE);
+			for (size_t k = 0; k < stride; k++) {
+				size_t size = modes[k] == Rans ? chunkSizes[k][c]
+				              : modes[k] == Raw ? chunkElements
+				                                : 0;
+				const uint8_t* bytes = planes[k].data() + offsets[k];
+				out.insert(out.end(), bytes, bytes + size);
+				offsets[k] += size;
+			}
+		}
+	}
+
+	// Decodes one chunk, whose planes' cursors are given in plane order
+	bool decodeChunk(const Plane* planes, PlaneCursor* cursors, size_t count,
+	                 size_t stride, bool delta, uint8_t* elements) {
+		std::vector<uint8_t> last(stride, 0);
+		std::vector<uint8_t> block(stride * MESH_CODEC_BLOCK_SIZE);
+		for (size_t first = 0; first < count;
+		     first += MESH_CODEC_BLOCK_SIZE) {
+			size_t blockCount =
+			    std::min(MESH_CODEC_BLOCK_SIZE, count - first);
+			for (size_t k = 0; k < stride; k++) {
+				if (!decodePlane(planes[k], cursors[k], first, blockCount,
+				                 &block[k * MESH_CODEC_BLOCK_SIZE])) {
+					return false;
+				}
+			}
+			transposeBlock(block.data(), blockCount, stride, delta,
+			               last.data(), elements + first * stride);
+		}
+		// A plane that decoded to the wrong symbols would be unlikely to
+		// finish exactly on its last byte with its starting states
+		for (size_t k = 0; k < stride; k++) {
+			if (cursors[k].p != cursors[k].end) {
+				return false;
+			}
+			if (planes[k].mode == Rans) {
+				for (uint32_t x : cursors[k].state) {
+					if (x != RANS_LOW) {
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	bool decodeElements(const uint8_t* data, size_t size, size_t count,
+	                    size_t stride, bool delta, uint8_t* elements) {
+		const uint8_t* p = data;
+		const uint8_t* end = data + size;
+		std::vector<Plane> planes(stride);
+		size_t ransPlanes = 0;
+		for (size_t k = 0; k < stride; k++) {
+			if (!readPlaneHeader(p, end, planes[k])) {
+				return false;
+			}
+			ransPlanes += planes[k].mode == Rans;
+		}
+		size_t chunkCount =
+		    (count + MESH_CODEC_CHUNK_SIZE - 1) / MESH_CODEC_CHUNK_SIZE;
+		size_t sizesBytes = chunkCount * ransPlanes * sizeof(uint32_t);
+		if (static_cast<size_t>(end - p) < sizesBytes) {
+			return false;
+		}
+		const uint8_t* sizes = p;
+		p += sizesBytes;
+		// Every chunk's planes are found up front, so chunks can decode in
+		// any order
+		std::vector<PlaneCursor> cursors(chunkCount * stride);
+		for (size_t c = 0; c < chunkCount; c++) {
+			size_t chunkElements = std::min(MESH_CODEC_CHUNK_SIZE,
+			                                count - c * MESH_CODEC_CHUNK_SIZE);
+			for (size_t k = 0; k < stride; k++) {
+				uint32_t size = 0;
+				if (planes[k].mode == Rans) {
+					memcpy(&size, sizes, sizeof(size));
+					sizes += sizeof(size);
+				} else if (planes[k].mode == Raw) {
+					size = static_cast<uint32_t>(chunkElements);
+				}
+				if (!startPlane(p, end, size, planes[k],
+				                cursors[c * stride + k])) {
+					return false;
+				}
+			}
+		}
+		if (p != end) {
+			return false;
+		}
+		std::atomic<bool> failed{false};
+		parallelFor(chunkCount, chunkCount, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end && !failed; c++) {
+				size_t first = c * MESH_CODEC_CHUNK_SIZE;
+				if (!decodeChunk(planes.data(), &cursors[c * stride],
+				                 std::min(MESH_CODEC_CHUNK_SIZE, count - first),
+				                 stride, delta, elements + first * stride)) {
+					failed = true;
+				}
+			}
+		});
+		return !failed;
+	}
+} // namespace
+
+void encodeVertexBuffer(const uint8_t* vertices, size_t vertexCount,
+                        size_t stride, std::vector<uint8_t>& out) {
+	out.clear();
+	encodeElements(vertices, vertexCount, stride, true, out);
+}
+
+bool decodeVertexBuffer(const uint8_t* data, size_t size, size_t vertexCount,
+                        size_t stride, uint8_t* vertices) {
+	TRACE_ZONE("Decode vertices");
+	return decodeElements(data, size, vertexCount, stride, true, vertices);
+}
+
+void encodeIndexBuffer(const uint32_t* indices, size_t indexCount,
+                       std::vector<uint8_t>& out) {
+	std::vector<uint32_t> deltas(indexCount);
+	uint32_t previous = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		deltas[i] = zigzag32(indices[i] - previous);
+		previous = indices[i];
+	}
+	out.clear();
+	encodeElements(reinterpret_cast<const uint8_t*>(deltas.data()),
+	               indexCount, sizeof(uint32_t), false, out);
+}
+
+bool decodeIndexBuffer(const uint8_t* data, size_t size, size_t indexCount,
+                       uint32_t* indices) {
+	TRACE_ZONE("Decode indices");
+	if (!decodeElements(data, size, indexCount, sizeof(uint32_t), false,
+	                    reinterpret_cast<uint8_t*>(indices))) {
+		return false;
+	}
+	size_t i = 0;
+	uint32_t previous = 0;
+#ifdef __SSE2__
+	__m128i carry = _mm_setzero_si128();
+	for (; i + 4 <= indexCount; i += 4) {
+		__m128i* lane = reinterpret_cast<__m128i*>(indices + i);
+		__m128i v = _mm_loadu_si128(lane);
+		v = _mm_xor_si128(_mm_srli_epi32(v, 1),
+		                  _mm_sub_epi32(_mm_setzero_si128(),
+		                                _mm_and_si128(v, _mm_set1_epi32(1))));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi32(v, carry);
+		carry = _mm_shuffle_epi32(v, 0xff);
+		_mm_storeu_si128(lane, v);
+	}
+	previous = static_cast<uint32_t>(_mm_cvtsi128_si32(carry));
+#endif
+	for (; i < indexCount; i++) {
+		previous += unzigzag32(indices[i]);
+		indices[i] = previous;
+	}
+	return true;
+}
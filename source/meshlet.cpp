@@ -0,0 +1,162 @@
+#include "meshlet.h"
+#include "include.h"
+#include "util.h"
+
+namespace {
+	void computeBounds(const std::vector<Vertex>& vertices,
+	                   const uint32_t* indices, uint32_t indexCount,
+	                   Meshlet& meshlet) {
+		glm::vec3 minPos = vertices[indices[0]].pos;
+		glm::vec3 maxPos = minPos;
+		for (uint32_t i = 0; i < indexCount; i++) {
+			minPos = glm::min(minPos, vertices[indices[i]].pos);
+			maxPos = glm::max(maxPos, vertices[indices[i]].pos);
+		}
+		meshlet.center = (minPos + maxPos) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (uint32_t i = 0; i < indexCount; i++) {
+			meshlet.radius =
+			    std::max(meshlet.radius,
+			             glm::length(vertices[indices[i]].pos - meshlet.center));
+		}
+		std::vector<glm::vec3> normals;
+		normals.reserve(indexCount / 3);
+		glm::vec3 axis(0.0f);
+		for (uint32_t i = 0; i < indexCount; i += 3) {
+			glm::vec3 p0 = vertices[indices[i + 0]].pos;
+			glm::vec3 p1 = vertices[indices[i + 1]].pos;
+			glm::vec3 p2 = vertices[indices[i + 2]].pos;
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(n);
+			normals.push_back(area > 0.0f ? n / area : glm::vec3(0.0f));
+			axis += normals.back();
+		}
+		// A cutoff of 1 makes coneBackfacing() reject nothing
+		meshlet.coneApex = meshlet.center;
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 1.0f;
+		float axisLength = glm::length(axis);
+		if (axisLength == 0.0f) {
+			return;
+		}
+		axis = axis / axisLength;
+		float minDot = 1.0f;
+		for (const auto& n : normals) {
+			minDot = std::min(minDot, glm::dot(n, axis));
+		}
+		if (minDot <= 0.1f) {
+			return;
+		}
+		// Move the apex back until every triangle plane is in front of it
+		float maxT = 0.0f;
+		for (uint32_t i = 0; i < indexCount; i += 3) {
+			const glm::vec3& n = normals[i / 3];
+			float dn = glm::dot(axis, n);
+			if (dn <= 0.0f) {
+				continue;
+			}
+			float t =
+			    glm::dot(meshlet.center - vertices[indices[i]].pos, n) / dn;
+			maxT = std::max(maxT, t);
+		}
+		meshlet.coneApex = meshlet.center - axis * maxT;
+		meshlet.coneAxis = axis;
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+} // namespace
+
+void buildMeshlets(const std::vector<Vertex>& vertices,
+                   std::vector<uint32_t>& indices, uint32_t firstIndex,
+                   uint32_t indexCount, std::vector<Meshlet>& meshlets) {
+	const uint32_t* source = indices.data() + firstIndex;
+	uint32_t triangleCount = indexCount / 3;
+	size_t vertexCount = vertices.size();
+	std::vector<uint32_t> triOffsets(vertexCount + 1, 0);
+	for (uint32_t i = 0; i < indexCount; i++) {
+		triOffsets[source[i] + 1]++;
+	}
+	for (size_t i = 0; i < vertexCount; i++) {
+		triOffsets[i + 1] += triOffsets[i];
+	}
+	std::vector<uint32_t> triList(indexCount);
+	std::vector<uint32_t> fill(triOffsets.begin(), triOffsets.end() - 1);
+	for (uint32_t i = 0; i < indexCount; i++) {
+		triList[fill[source[i]]++] = i / 3;
+	}
+
+	std::vector<uint32_t> ordered;
+	ordered.reserve(indexCount);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	// Stamped with the meshlet number a vertex was last added to
+	std::vector<uint32_t> vertexStamp(vertexCount, ~0u);
+	std::vector<uint32_t> candidates;
+	uint32_t seed = 0;
+	uint32_t stamp = 0;
+	while (true) {
+		while (seed < triangleCount && emitted[seed]) {
+			seed++;
+		}
+		if (seed == triangleCount) {
+			break;
+		}
+		uint32_t meshletStart = static_cast<uint32_t>(ordered.size());
+		uint32_t meshletVertices = 0;
+		uint32_t meshletTriangles = 0;
+		candidates.clear();
+		candidates.push_back(seed);
+		while (meshletTriangles < MESHLET_MAX_TRIANGLES) {
+			// Prefer the triangle that adds the fewest new vertices
+			int best = -1;
+			uint32_t bestNew = 4;
+			for (size_t c = 0; c < candidates.size();) {
+				uint32_t tri = candidates[c];
+				if (emitted[tri]) {
+					candidates[c] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				uint32_t newVertices = 0;
+				for (int k = 0; k < 3; k++) {
+					newVertices += vertexStamp[source[tri * 3 + k]] != stamp;
+				}
+				if (newVertices < bestNew) {
+					bestNew = newVertices;
+					best = static_cast<int>(c);
+					if (newVertices == 0) {
+						break;
+					}
+				}
+				c++;
+			}
+			if (best < 0 ||
+			    meshletVertices + bestNew > MESHLET_MAX_VERTICES) {
+				break;
+			}
+			uint32_t tri = candidates[best];
+			emitted[tri] = 1;
+			meshletTriangles++;
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = source[tri * 3 + k];
+				ordered.push_back(v);
+				if (vertexStamp[v] == stamp) {
+					continue;
+				}
+				vertexStamp[v] = stamp;
+				meshletVertices++;
+				for (uint32_t t = triOffsets[v]; t < triOffsets[v + 1]; t++) {
+					if (!emitted[triList[t]]) {
+						candidates.push_back(triList[t]);
+					}
+				}
+			}
+		}
+		Meshlet meshlet = {};
+		meshlet.firstIndex = firstIndex + meshletStart;
+		meshlet.indexCount = static_cast<uint32_t>(ordered.size()) - meshletStart;
+		computeBounds(vertices, ordered.data() + meshletStart,
+		              meshlet.indexCount, meshlet);
+		meshlets.push_back(meshlet);
+		stamp++;
+	}
+	std::copy(ordered.begin(), ordered.end(), indices.begin() + firstIndex);
+}
@@ -0,0 +1,141 @@
+#include "mipgen.h"
+#include "include.h"
+#include "threadpool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Linear values are quantized to 16 bits on the way back, which keeps
+	// even the darkest sRGB steps exact
+	constexpr uint32_t LINEAR_STEPS = 65535;
+
+	struct Tables {
+		float srgbToLinear[256];
+		float unormToFloat[256];
+		uint8_t linearToSrgb[LINEAR_STEPS + 1];
+
+		Tables() {
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				srgbToLinear[i] = c <= 0.04045f
+				                      ? c / 12.92f
+				                      : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				unormToFloat[i] = c;
+			}
+			for (uint32_t i = 0; i <= LINEAR_STEPS; i++) {
+				float l = static_cast<float>(i) / LINEAR_STEPS;
+				float c = l <= 0.0031308f
+				              ? l * 12.92f
+				              : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				linearToSrgb[i] = static_cast<uint8_t>(c * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	const Tables& getTables() {
+		static const Tables tables;
+		return tables;
+	}
+
+	// Filters one output row from the two source rows under it
+#ifdef __SSE2__
+	void filterRow(const uint8_t* row0, const uint8_t* row1, uint32_t width,
+	               uint32_t nextWidth, bool srgb, uint8_t* out) {
+		const Tables& tables = getTables();
+		const float* colour =
+		    srgb ? tables.srgbToLinear : tables.unormToFloat;
+		const float* alpha = tables.unormToFloat;
+		float colourScale = srgb ? float(LINEAR_STEPS) : 255.0f;
+		const __m128 scale = _mm_setr_ps(colourScale * 0.25f,
+		                                 colourScale * 0.25f,
+		                                 colourScale * 0.25f, 255.0f * 0.25f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		auto load = [&](const uint8_t* p) {
+			return _mm_setr_ps(colour[p[0]], colour[p[1]], colour[p[2]],
+			                   alpha[p[3]]);
+		};
+		for (uint32_t x = 0; x < nextWidth; x++) {
+			size_t x0 = std::min(2 * x, width - 1) * 4;
+			size_t x1 = std::min(2 * x + 1, width - 1) * 4;
+			__m128 sum = _mm_add_ps(
+			    _mm_add_ps(load(row0 + x0), load(row0 + x1)),
+			    _mm_add_ps(load(row1 + x0), load(row1 + x1)));
+			alignas(16) int32_t values[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(values),
+			                _mm_cvttps_epi32(_mm_add_ps(
+			                    _mm_mul_ps(sum, scale), half)));
+			for (int c = 0; c < 3; c++) {
+				out[x * 4 + c] = srgb ? tables.linearToSrgb[values[c]]
+				                      : static_cast<uint8_t>(values[c]);
+			}
+			out[x * 4 + 3] = static_cast<uint8_t>(values[3]);
+		}
+	}
+#else
+	void filterRow(const uint8_t* row0, const uint8_t* row1, uint32_t width,
+	               uint32_t nextWidth, bool srgb, uint8_t* out) {
+		const Tables& tables = getTables();
+		const float* colour =
+		    srgb ? tables.srgbToLinear : tables.unormToFloat;
+		float colourScale = srgb ? float(LINEAR_STEPS) : 255.0f;
+		for (uint32_t x = 0; x < nextWidth; x++) {
+			size_t x0 = std::min(2 * x, width - 1) * 4;
+			size_t x1 = std::min(2 * x + 1, width - 1) * 4;
+			for (int c = 0; c < 4; c++) {
+				const float* table = c < 3 ? colour : tables.unormToFloat;
+				float sum = table[row0[x0 + c]] + table[row0[x1 + c]] +
+				            table[row1[x0 + c]] + table[row1[x1 + c]];
+				float scale = c < 3 ? colourScale : 255.0f;
+				uint32_t value =
+				    static_cast<uint32_t>(sum * 0.25f * scale + 0.5f);
+				out[x * 4 + c] = srgb && c < 3
+				                     ? tables.linearToSrgb[value]
+				                     : static_cast<uint8_t>(value);
+			}
+		}
+	}
+#endif
+} // namespace
+
+void downsampleRGBA8(const uint8_t* source, uint32_t width, uint32_t height,
+                     bool srgb, uint8_t* dest) {
+	uint32_t nextWidth = std::max(1u, width / 2);
+	uint32_t nextHeight = std::max(1u, height / 2);
+	size_t threadCount = 1;
+	if (size_t(nextWidth) * nextHeight >= MIP_PARALLEL_THRESHOLD) {
+		threadCount = getParallelism();
+	}
+	size_t stride = size_t(width) * 4;
+	parallelFor(nextHeight, threadCount, [&](size_t begin, size_t end) {
+		for (size_t y = begin; y < end; y++) {
+			size_t y0 = std::min<size_t>(2 * y, height - 1);
+			size_t y1 = std::min<size_t>(2 * y + 1, height - 1);
+			filterRow(source + y0 * stride, source + y1 * stride, width,
+			          nextWidth, srgb, dest + y * nextWidth * 4);
+		}
+	});
+}
+
+size_t getMipChainLayout(uint32_t width, uint32_t height, uint32_t levelCount,
+                         std::vector<size_t>& levelOffsets) {
+	levelOffsets.resize(levelCount);
+	size_t total = 0;
+	for (uint32_t i = 0; i < levelCount; i++) {
+		levelOffsets[i] = total;
+		total += size_t(std::max(1u, width >> i)) * std::max(1u, height >> i) *
+		         4;
+	}
+	return total;
+}
+
+void generateMipChain(uint8_t* pixels, uint32_t width, uint32_t height,
+                      const std::vector<size_t>& levelOffsets, bool srgb) {
+	for (size_t i = 1; i < levelOffsets.size(); i++) {
+		downsampleRGBA8(pixels + levelOffsets[i - 1], width, height, srgb,
+		                pixels + levelOffsets[i]);
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+	}
+}
@@ -1,51 +1,204 @@
 #include "model.h"
 #include "commander.h"
+#include "dedup.h"
 #include "descriptor.h"
 #include "device.h"
+#include "gltf.h"
 #include "include.h"
 #include "instance.h"
+#include "lod.h"
+#include "meshcache.h"
+#include "meshlet.h"
+#include "objloader.h"
+#include "optimize.h"
 #include "renderer.h"
+#include "staging.h"
 #include "surface.h"
 #include "sync.h"
 #include "texture.h"
+#include "threadpool.h"
+#include "trace.h"
 #include "util.h"
+#include "vertexlayout.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-
-Model::Model() { texture = new Texture(); }
+Model::Model() {
+	texture = new Texture();
+	currentLod = 0;
+	screenRadius = 0.0f;
+	vertexCount = 0;
+	indexCount = 0;
+	indexType = VK_INDEX_TYPE_UINT32;
+	device = nullptr;
+	positionDecode = glm::mat4(1.0f);
+	meshResident = false;
+	textureResident = false;
+}
 
 void Model::create(Instance* instance, std::string modelPath,
                    std::string texPath) {
-	load(modelPath);
-	texture->create(instance, texPath);
+	device = instance->device;
+	texture->stagingPool = instance->stagingPool;
+	texture->compression = device->enabledFeatures.textureCompressionBC
+	                           ? TEXTURE_COMPRESSION
+	                           : TextureCompression::None;
+	meshLoad = instance->threadPool->submit(
+	    [this, modelPath]() { loadMesh(modelPath); });
+	textureLoad = instance->threadPool->submit([this, modelPath, texPath]() {
+		// glTF files name their own texture
+		if (!isGltfPath(modelPath) || !loadGltfTexture(modelPath, *texture)) {
+			texture->load(texPath);
+		}
+	});
+}
+
+void Model::loadMesh(std::string modelPath) {
+	TRACE_ZONE("Load mesh");
+	VertexLayout requested = layout;
+	if (readMeshCache(modelPath, *this)) {
+		std::cout << "Loaded " << lods.size() << " LOD levels, "
+		          << meshlets.size() << " meshlets from mesh cache"
+		          << std::endl;
+	} else {
+		load(modelPath);
+		process();
+		writeMeshCache(modelPath, *this, requested);
+		// Everything the GPU needs is staged now
+		vertices = std::vector<Vertex>();
+		indices = std::vector<uint32_t>();
+	}
+	positionDecode = layout.getPositionDecode(boundsMin, boundsMax);
+}
+
+void Model::allocateStaging(uint32_t vertexCount, uint32_t indexCount) {
+	this->vertexCount = vertexCount;
+	this->indexCount = indexCount;
+	// Halve the index buffer when every vertex fits in 16 bits
+	indexType = vertexCount <= std::numeric_limits<uint16_t>::max()
+	                ? VK_INDEX_TYPE_UINT16
+	                : VK_INDEX_TYPE_UINT32;
+	size_t indexSize =
+	    indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	vertexStaging.create(device,
+	                     static_cast<VkDeviceSize>(vertexCount) *
+	                         layout.getStride());
+	indexStaging.create(device,
+	                    static_cast<VkDeviceSize>(indexCount) * indexSize);
+}
+
+void Model::writeIndices(const uint32_t* source) {
+	if (indexType == VK_INDEX_TYPE_UINT32) {
+		memcpy(indexStaging.data, source, sizeof(uint32_t) * indexCount);
+		return;
+	}
+	uint16_t* out = reinterpret_cast<uint16_t*>(indexStaging.data);
+	for (uint32_t i = 0; i < indexCount; i++) {
+		out[i] = static_cast<uint16_t>(source[i]);
+	}
+}
+
+void Model::releaseMeshStaging() {
+	vertexStaging.destroy(device);
+	indexStaging.destroy(device);
+}
+
+void Model::releaseStaging() {
+	releaseMeshStaging();
+	texture->releaseStaging();
+}
+
+const LodLevel& Model::selectLod(const glm::mat4& modelView, float projScale,
+                                 float viewportHeight) {
+	screenRadius =
+	    projectedRadius(modelView, projScale, viewportHeight, center, radius);
+	currentLod = ::selectLod(lods, currentLod, screenRadius);
+	return lods[currentLod];
+}
+
+void Model::process() {
+	TRACE_ZONE("Process mesh");
+	float acmrBefore =
+	    computeAcmr(indices.data(), indices.size(), VERTEX_CACHE_SIZE);
+	computeBounds();
+	buildLods(vertices, indices, lods, radius);
+	for (auto& lod : lods) {
+		lod.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+		buildMeshlets(vertices, indices, lod.firstIndex, lod.indexCount,
+		              meshlets);
+		lod.meshletCount =
+		    static_cast<uint32_t>(meshlets.size()) - lod.firstMeshlet;
+	}
+	optimizeMeshlets(vertices, indices, lods, meshlets);
+	optimizeVertexFetch(vertices, indices);
+	std::cout << "Generated " << lods.size() << " LOD levels, "
+	          << meshlets.size() << " meshlets" << std::endl;
+	std::cout << "ACMR " << acmrBefore << " -> "
+	          << computeAcmr(indices.data(), lods[0].indexCount,
+	                         VERTEX_CACHE_SIZE)
+	          << std::endl;
+	allocateStaging(static_cast<uint32_t>(vertices.size()),
+	                static_cast<uint32_t>(indices.size()));
+	layout.pack(vertices, boundsMin, boundsMax, vertexStaging.data);
+	writeIndices(indices.data());
+	std::cout << "Packed vertices at " << layout.getStride() << " bytes (was "
+	          << sizeof(Vertex) << ")" << std::endl;
+}
+
+void Model::computeBounds() {
+	if (vertices.empty()) {
+		boundsMin = boundsMax = center = glm::vec3(0.0f);
+		radius = 0.0f;
+		return;
+	}
+	boundsMin = vertices[0].pos;
+	boundsMax = vertices[0].pos;
+	for (const auto& vertex : vertices) {
+		boundsMin = glm::min(boundsMin, vertex.pos);
+		boundsMax = glm::max(boundsMax, vertex.pos);
+	}
+	center = (boundsMin + boundsMax) * 0.5f;
+	radius = 0.0f;
+	for (const auto& vertex : vertices) {
+		radius = std::max(radius, glm::length(vertex.pos - center));
+	}
 }
 
 void Model::load(std::string modelPath) {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-	                      modelPath.c_str())) {
-		throw std::runtime_error(warn + err);
-	}
-	std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
-	for (const auto& shape : shapes) {
-		for (const auto& index : shape.mesh.indices) {
-			Vertex vertex = {};
-			vertex.pos = {attrib.vertices[3 * index.vertex_index + 0],
-			              attrib.vertices[3 * index.vertex_index + 1],
-			              attrib.vertices[3 * index.vertex_index + 2]};
-			vertex.texCoord = {
-			    attrib.texcoords[2 * index.texcoord_index + 0],
-			    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
-			vertex.colour = {1.0f, 1.0f, 1.0f};
-			if (uniqueVertices.count(vertex) == 0) {
-				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-				vertices.push_back(vertex);
-			}
-			indices.push_back(uniqueVertices[vertex]);
+	TRACE_ZONE("Parse mesh");
+	if (isGltfPath(modelPath)) {
+		bool hasNormals;
+		loadGltf(modelPath, vertices, indices, hasNormals);
+		if (!hasNormals) {
+			layout.normals = false;
 		}
+		return;
 	}
-}
\ No newline at end of file
+	ObjData obj;
+	parseObj(modelPath, obj);
+	if (obj.normals.empty()) {
+		layout.normals = false;
+	}
+	std::vector<Vertex> corners;
+	corners.reserve(obj.corners.size());
+	for (const auto& corner : obj.corners) {
+		Vertex vertex = {};
+		vertex.pos = {obj.positions[3 * corner.position + 0],
+		              obj.positions[3 * corner.position + 1],
+		              obj.positions[3 * corner.position + 2]};
+		if (corner.texCoord >= 0) {
+			vertex.texCoord = {obj.texCoords[2 * corner.texCoord + 0],
+			                   1.0f - obj.texCoords[2 * corner.texCoord + 1]};
+		} else {
+			// (0, 0) in the file, flipped like the rest
+			vertex.texCoord = {0.0f, 1.0f};
+		}
+		vertex.colour = {1.0f, 1.0f, 1.0f};
+		if (layout.normals && corner.normal >= 0) {
+			vertex.normal = {obj.normals[3 * corner.normal + 0],
+			                 obj.normals[3 * corner.normal + 1],
+			                 obj.normals[3 * corner.normal + 2]};
+		}
+		corners.push_back(vertex);
+	}
+	obj = ObjData();
+	deduplicateVertices(corners, vertices, indices);
+}
@@ -0,0 +1,335 @@
+#include "objloader.h"
+#include "include.h"
+#include "util.h"
+
+#include <thread>
+
+namespace {
+	// Chunks smaller than this are not worth a thread
+	constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+	struct Fixup {
+		size_t corner;
+		// Bit per ObjCorner field holding a chunk relative index
+		uint32_t mask;
+	};
+
+	struct Chunk {
+		const char* begin;
+		const char* end;
+		std::vector<float> positions;
+		std::vector<float> texCoords;
+		std::vector<float> normals;
+		std::vector<ObjCorner> corners;
+		// Corners holding negative (relative) indices, resolved on merge
+		std::vector<Fixup> fixups;
+		std::string error;
+	};
+
+	const double powersOf10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+	                             1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+	                             1e18, 1e19, 1e20, 1e21, 1e22};
+
+	bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+	void skipSpace(const char*& p, const char* end) {
+		while (p < end && (*p == ' ' || *p == '\t')) {
+			p++;
+		}
+	}
+
+	void skipLine(const char*& p, const char* end) {
+		while (p < end && *p != '\n') {
+			p++;
+		}
+		if (p < end) {
+			p++;
+		}
+	}
+
+	bool atLineEnd(const char* p, const char* end) {
+		return p >= end || *p == '\n' || *p == '\r' || *p == '#';
+	}
+
+	// Exact whenever the digits fit a double and the power of ten is exact,
+	// strtod otherwise
+	bool parseFloat(const char*& p, const char* end, float& value) {
+		const char* start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool any = false;
+		while (p < end && isDigit(*p)) {
+			any = true;
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+			} else {
+				exponent++;
+			}
+			p++;
+		}
+		if (p < end && *p == '.') {
+			p++;
+			while (p < end && isDigit(*p)) {
+				any = true;
+				if (digits < 19) {
+					mantissa = mantissa * 10 + (*p - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+				p++;
+			}
+		}
+		if (!any) {
+			p = start;
+			return false;
+		}
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			p++;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+')) {
+				negativeExponent = *p == '-';
+				p++;
+			}
+			int e = 0;
+			while (p < end && isDigit(*p)) {
+				e = std::min(e * 10 + (*p - '0'), 100000);
+				p++;
+			}
+			exponent += negativeExponent ? -e : e;
+		}
+		double result;
+		if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+			result = exponent < 0 ? mantissa / powersOf10[-exponent]
+			                      : mantissa * powersOf10[exponent];
+			result = negative ? -result : result;
+		} else {
+			std::string token(start, p);
+			result = std::strtod(token.c_str(), nullptr);
+		}
+		value = static_cast<float>(result);
+		return true;
+	}
+
+	bool parseInt(const char*& p, const char* end, int64_t& value) {
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+		if (p >= end || !isDigit(*p)) {
+			return false;
+		}
+		value = 0;
+		while (p < end && isDigit(*p)) {
+			value = value * 10 + (*p - '0');
+			p++;
+		}
+		value = negative ? -value : value;
+		return true;
+	}
+
+	void parseFloats(const char*& p, const char* end, std::vector<float>& out,
+	                 int count) {
+		for (int i = 0; i < count; i++) {
+			skipSpace(p, end);
+			float value = 0.0f;
+			parseFloat(p, end, value);
+			out.push_back(value);
+		}
+	}
+
+	// Resolves a one based OBJ index against the chunk so far; negative
+	// indices are relative and need the earlier chunks' counts on merge
+	int32_t resolveIndex(int64_t raw, size_t localCount, uint32_t& mask,
+	                     int component) {
+		if (raw > 0) {
+			return static_cast<int32_t>(raw - 1);
+		}
+		if (raw == 0) {
+			throw std::runtime_error("invalid OBJ index 0!");
+		}
+		mask |= 1u << component;
+		return static_cast<int32_t>(static_cast<int64_t>(localCount) + raw);
+	}
+
+	void pushCorner(Chunk& chunk, const ObjCorner& corner, uint32_t mask) {
+		if (mask) {
+			chunk.fixups.push_back({chunk.corners.size(), mask});
+		}
+		chunk.corners.push_back(corner);
+	}
+
+	void parseFace(const char*& p, const char* end, Chunk& chunk) {
+		ObjCorner first, previous;
+		uint32_t firstMask = 0, previousMask = 0;
+		size_t count = 0;
+		while (true) {
+			skipSpace(p, end);
+			if (atLineEnd(p, end)) {
+				break;
+			}
+			ObjCorner corner = {-1, -1, -1};
+			uint32_t mask = 0;
+			int64_t raw;
+			if (!parseInt(p, end, raw)) {
+				throw std::runtime_error("failed to parse OBJ face!");
+			}
+			corner.position =
+			    resolveIndex(raw, chunk.positions.size() / 3, mask, 0);
+			if (p < end && *p == '/') {
+				p++;
+				if (parseInt(p, end, raw)) {
+					corner.texCoord =
+					    resolveIndex(raw, chunk.texCoords.size() / 2, mask, 1);
+				}
+				if (p < end && *p == '/') {
+					p++;
+					if (parseInt(p, end, raw)) {
+						corner.normal = resolveIndex(
+						    raw, chunk.normals.size() / 3, mask, 2);
+					}
+				}
+			}
+			// Fan triangulation: (0, n - 1, n) for every corner after the second
+			if (count == 0) {
+				first = corner;
+				firstMask = mask;
+			} else if (count >= 2) {
+				pushCorner(chunk, first, firstMask);
+				pushCorner(chunk, previous, previousMask);
+				pushCorner(chunk, corner, mask);
+			}
+			previous = corner;
+			previousMask = mask;
+			count++;
+		}
+	}
+
+	void parseChunk(Chunk& chunk) {
+		const char* p = chunk.begin;
+		const char* end = chunk.end;
+		try {
+			while (p < end) {
+				skipSpace(p, end);
+				if (p + 1 < end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+					p += 2;
+					parseFloats(p, end, chunk.positions, 3);
+				} else if (p + 2 < end && p[0] == 'v' && p[1] == 't' &&
+				           (p[2] == ' ' || p[2] == '\t')) {
+					p += 3;
+					parseFloats(p, end, chunk.texCoords, 2);
+				} else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' &&
+				           (p[2] == ' ' || p[2] == '\t')) {
+					p += 3;
+					parseFloats(p, end, chunk.normals, 3);
+				} else if (p + 1 < end && p[0] == 'f' &&
+				           (p[1] == ' ' || p[1] == '\t')) {
+					p += 2;
+					parseFace(p, end, chunk);
+				}
+				skipLine(p, end);
+			}
+		} catch (const std::exception& e) {
+			chunk.error = e.what();
+		}
+	}
+} // namespace
+
+void parseObj(const std::string& path, ObjData& data) {
+	MappedFile mapped;
+	mapped.map(path);
+	const char* file = reinterpret_cast<const char*>(mapped.data);
+	size_t size = mapped.size;
+
+	size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	size_t chunkCount =
+	    std::max<size_t>(1, std::min(threadCount, size / MIN_CHUNK_SIZE));
+	std::vector<Chunk> chunks(chunkCount);
+	const char* begin = file;
+	const char* end = file + size;
+	for (size_t i = 0; i < chunkCount; i++) {
+		const char* split =
+		    i + 1 == chunkCount ? end : file + size * (i + 1) / chunkCount;
+		split = std::max(split, begin);
+		while (split < end && split[-1] != '\n') {
+			split++;
+		}
+		chunks[i].begin = begin;
+		chunks[i].end = split;
+		begin = split;
+	}
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < chunkCount; i++) {
+		threads.emplace_back(parseChunk, std::ref(chunks[i]));
+	}
+	parseChunk(chunks[0]);
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	mapped.unmap();
+
+	size_t positions = 0, texCoords = 0, normals = 0, corners = 0;
+	for (const auto& chunk : chunks) {
+		if (!chunk.error.empty()) {
+			throw std::runtime_error(chunk.error);
+		}
+		positions += chunk.positions.size();
+		texCoords += chunk.texCoords.size();
+		normals += chunk.normals.size();
+		corners += chunk.corners.size();
+	}
+	data.positions.clear();
+	data.texCoords.clear();
+	data.normals.clear();
+	data.corners.clear();
+	data.positions.reserve(positions);
+	data.texCoords.reserve(texCoords);
+	data.normals.reserve(normals);
+	data.corners.reserve(corners);
+	for (auto& chunk : chunks) {
+		int32_t offsets[3] = {
+		    static_cast<int32_t>(data.positions.size() / 3),
+		    static_cast<int32_t>(data.texCoords.size() / 2),
+		    static_cast<int32_t>(data.normals.size() / 3)};
+		for (const auto& fixup : chunk.fixups) {
+			ObjCorner& corner = chunk.corners[fixup.corner];
+			int32_t* fields[3] = {&corner.position, &corner.texCoord,
+			                      &corner.normal};
+			for (int i = 0; i < 3; i++) {
+				if (fixup.mask & (1u << i)) {
+					*fields[i] += offsets[i];
+				}
+			}
+		}
+		data.positions.insert(data.positions.end(), chunk.positions.begin(),
+		                      chunk.positions.end());
+		data.texCoords.insert(data.texCoords.end(), chunk.texCoords.begin(),
+		                      chunk.texCoords.end());
+		data.normals.insert(data.normals.end(), chunk.normals.begin(),
+		                    chunk.normals.end());
+		data.corners.insert(data.corners.end(), chunk.corners.begin(),
+		                    chunk.corners.end());
+		std::vector<float>().swap(chunk.positions);
+		std::vector<float>().swap(chunk.texCoords);
+		std::vector<float>().swap(chunk.normals);
+		std::vector<ObjCorner>().swap(chunk.corners);
+	}
+	int32_t positionCount = static_cast<int32_t>(data.positions.size() / 3);
+	int32_t texCoordCount = static_cast<int32_t>(data.texCoords.size() / 2);
+	int32_t normalCount = static_cast<int32_t>(data.normals.size() / 3);
+	for (const auto& corner : data.corners) {
+		if (corner.position < 0 || corner.position >= positionCount ||
+		    corner.texCoord < -1 || corner.texCoord >= texCoordCount ||
+		    corner.normal < -1 || corner.normal >= normalCount) {
+			throw std::runtime_error("OBJ index out of range!");
+		}
+	}
+}
@@ -0,0 +1,508 @@
+#include "occlusion.h"
+#include "commander.h"
+#include "culling.h"
+#include "descriptor.h"
+#include "descriptorallocator.h"
+#include "device.h"
+#include "include.h"
+#include "instance.h"
+#include "meshlet.h"
+#include "model.h"
+#include "overdraw.h"
+#include "renderer.h"
+#include "surface.h"
+#include "util.h"
+
+namespace {
+	struct ReduceConstants {
+		glm::ivec2 srcSize;
+		glm::ivec2 dstSize;
+		int32_t samples;
+	};
+
+	struct CullConstants {
+		uint32_t pass;
+		uint32_t drawOffset;
+	};
+
+	uint32_t previousPow2(uint32_t v) {
+		uint32_t result = 1;
+		while (result * 2 <= v) {
+			result *= 2;
+		}
+		return result;
+	}
+
+	VkImageView createLevelView(Device* device, VkImage image,
+	                            uint32_t level) {
+		VkImageViewCreateInfo viewInfo = {};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+		VkImageView imageView;
+		if (vkCreateImageView(device->logical, &viewInfo, nullptr,
+		                      &imageView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create texture image view!");
+		}
+		return imageView;
+	}
+
+	VkDescriptorSetLayout
+	createSetLayout(Device* device,
+	                const std::vector<VkDescriptorType>& types) {
+		std::vector<VkDescriptorSetLayoutBinding> bindings(types.size());
+		for (size_t i = 0; i < types.size(); i++) {
+			bindings[i].binding = static_cast<uint32_t>(i);
+			bindings[i].descriptorCount = 1;
+			bindings[i].descriptorType = types[i];
+			bindings[i].pImmutableSamplers = nullptr;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+		VkDescriptorSetLayout setLayout;
+		if (vkCreateDescriptorSetLayout(device->logical, &layoutInfo, nullptr,
+		                                &setLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create descriptor set layout!");
+		}
+		return setLayout;
+	}
+
+	VkPipelineLayout createLayout(Device* device,
+	                              VkDescriptorSetLayout setLayout,
+	                              uint32_t pushConstantSize) {
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = pushConstantSize;
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+		pipelineLayoutInfo.sType =
+		    VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &setLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		VkPipelineLayout pipelineLayout;
+		if (vkCreatePipelineLayout(device->logical, &pipelineLayoutInfo,
+		                           nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+		return pipelineLayout;
+	}
+
+	void computeBarrier(VkCommandBuffer commandBuffer,
+	                    VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+	                    VkPipelineStageFlags dstStage,
+	                    VkAccessFlags dstAccess) {
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier,
+		                     0, nullptr, 0, nullptr);
+	}
+} // namespace
+
+void Occlusion::checkSupport(Instance* instance) {
+	Device* device = instance->device;
+	VkFormatProperties depthProperties;
+	vkGetPhysicalDeviceFormatProperties(
+	    device->physical, findDepthFormat(device), &depthProperties);
+	VkFormatProperties pyramidProperties;
+	vkGetPhysicalDeviceFormatProperties(device->physical, VK_FORMAT_R32_SFLOAT,
+	                                    &pyramidProperties);
+	// The overdraw view writes no depth to build the pyramid from
+	enabled = !instance->overdraw->enabled &&
+	          device->enabledFeatures.multiDrawIndirect &&
+	          (depthProperties.optimalTilingFeatures &
+	           VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) &&
+	          (pyramidProperties.optimalTilingFeatures &
+	           VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+	compactDraws = enabled && device->capabilities.drawIndirectCount;
+	std::cout << "Occlusion culling " << (enabled ? "enabled" : "disabled")
+	          << (compactDraws ? " with compacted draws" : "") << std::endl;
+}
+
+void Occlusion::createBuffers(Instance* instance, const Model& model) {
+	maxMeshlets = 0;
+	for (const auto& lod : model.lods) {
+		maxMeshlets = std::max(maxMeshlets, lod.meshletCount);
+	}
+	std::vector<GpuMeshlet> gpuMeshlets(model.meshlets.size());
+	for (size_t i = 0; i < model.meshlets.size(); i++) {
+		const Meshlet& meshlet = model.meshlets[i];
+		gpuMeshlets[i].centerRadius = glm::vec4(meshlet.center, meshlet.radius);
+		gpuMeshlets[i].coneApexCutoff =
+		    glm::vec4(meshlet.coneApex, meshlet.coneCutoff);
+		gpuMeshlets[i].coneAxis = glm::vec4(meshlet.coneAxis, 0.0f);
+		gpuMeshlets[i].firstIndex = meshlet.firstIndex;
+		gpuMeshlets[i].indexCount = meshlet.indexCount;
+	}
+	VkDeviceSize bufferSize = sizeof(GpuMeshlet) * gpuMeshlets.size();
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(instance->device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	             stagingBuffer, stagingBufferMemory);
+	void* data;
+	vkMapMemory(instance->device->logical, stagingBufferMemory, 0, bufferSize,
+	            0, &data);
+	memcpy(data, gpuMeshlets.data(), (size_t)bufferSize);
+	vkUnmapMemory(instance->device->logical, stagingBufferMemory);
+	createBuffer(
+	    instance->device, bufferSize,
+	    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletBuffer, meshletBufferMemory);
+	instance->commander->copyBuffer(instance->device, stagingBuffer,
+	                                meshletBuffer, bufferSize);
+	vkDestroyBuffer(instance->device->logical, stagingBuffer, nullptr);
+	vkFreeMemory(instance->device->logical, stagingBufferMemory, nullptr);
+	// One block of draw commands per culling pass
+	createBuffer(instance->device, getDrawOffset(2),
+	             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+	                 VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+	             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawBuffer,
+	             drawBufferMemory);
+	createBuffer(instance->device, sizeof(uint32_t) * maxMeshlets,
+	             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, visibilityBuffer,
+	             visibilityBufferMemory);
+	createBuffer(instance->device, getCountOffset(2),
+	             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+	                 VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+	                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, countBuffer,
+	             countBufferMemory);
+}
+
+void Occlusion::createResources(Instance* instance) {
+	createPyramid(instance);
+	createPipelines(instance);
+	uint32_t swapChainSize = instance->surface->getSwapChainSize();
+	cullBuffers.resize(swapChainSize);
+	cullBuffersMemory.resize(swapChainSize);
+	cullBuffersMapped.resize(swapChainSize);
+	for (size_t i = 0; i < swapChainSize; i++) {
+		createBuffer(instance->device, sizeof(CullData),
+		             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		             cullBuffers[i], cullBuffersMemory[i]);
+		vkMapMemory(instance->device->logical, cullBuffersMemory[i], 0,
+		            sizeof(CullData), 0, &cullBuffersMapped[i]);
+	}
+	createDescriptorSets(instance);
+	pyramidValid = false;
+}
+
+void Occlusion::createPyramid(Instance* instance) {
+	const VkExtent2D extent = instance->surface->getExtents();
+	// Power of two levels keep every reduction an exact 2x2 footprint
+	pyramidWidth = previousPow2(extent.width);
+	pyramidHeight = previousPow2(extent.height);
+	pyramidLevels =
+	    static_cast<uint32_t>(
+	        std::floor(std::log2(std::max(pyramidWidth, pyramidHeight)))) +
+	    1;
+	createImage(instance->device, pyramidWidth, pyramidHeight, pyramidLevels,
+	            VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32_SFLOAT,
+	            VK_IMAGE_TILING_OPTIMAL,
+	            VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pyramidImage,
+	            pyramidImageMemory);
+	pyramidImageView =
+	    createImageView(instance->device, pyramidImage, VK_FORMAT_R32_SFLOAT,
+	                    VK_IMAGE_ASPECT_COLOR_BIT, pyramidLevels);
+	pyramidLevelViews.resize(pyramidLevels);
+	for (uint32_t i = 0; i < pyramidLevels; i++) {
+		pyramidLevelViews[i] =
+		    createLevelView(instance->device, pyramidImage, i);
+	}
+	instance->commander->transitionImageLayout(
+	    instance->device, pyramidImage, VK_FORMAT_R32_SFLOAT,
+	    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, pyramidLevels);
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	sampler = instance->device->samplers.acquire(samplerInfo);
+}
+
+VkPipeline Occlusion::createComputePipeline(Device* device,
+                                            const std::string& path,
+                                            VkPipelineLayout layout) {
+	VkShaderModule shaderModule = createShaderModule(device, readFile(path));
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType =
+	    VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = layout;
+	VkPipeline pipeline;
+	if (vkCreateComputePipelines(device->logical, VK_NULL_HANDLE, 1,
+	                             &pipelineInfo, nullptr,
+	                             &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create compute pipeline!");
+	}
+	vkDestroyShaderModule(device->logical, shaderModule, nullptr);
+	return pipeline;
+}
+
+void Occlusion::createPipelines(Instance* instance) {
+	Device* device = instance->device;
+	reduceSetLayout =
+	    createSetLayout(device, {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+	                             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER});
+	cullSetLayout =
+	    createSetLayout(device, {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+	                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	                             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+	                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER});
+	reducePipelineLayout =
+	    createLayout(device, reduceSetLayout, sizeof(ReduceConstants));
+	cullPipelineLayout =
+	    createLayout(device, cullSetLayout, sizeof(CullConstants));
+	// The depth attachment is only multisampled when MSAA is on
+	depthCopyPipeline = createComputePipeline(
+	    device,
+	    instance->renderer->msaaSamples == VK_SAMPLE_COUNT_1_BIT
+	        ? "shaders/depthcopy.comp.spv"
+	        : "shaders/depthcopy_ms.comp.spv",
+	    reducePipelineLayout);
+	depthReducePipeline = createComputePipeline(
+	    device, "shaders/depthreduce.comp.spv", reducePipelineLayout);
+	cullPipeline = createComputePipeline(
+	    device,
+	    compactDraws ? "shaders/cull_count.comp.spv" : "shaders/cull.comp.spv",
+	    cullPipelineLayout);
+}
+
+void Occlusion::createDescriptorSets(Instance* instance) {
+	DescriptorAllocator* allocator = instance->descriptorAllocator;
+	reduceSets.resize(pyramidLevels);
+	for (uint32_t i = 0; i < pyramidLevels; i++) {
+		DescriptorBinding source =
+		    i == 0 ? imageBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		                          sampler,
+		                          instance->renderer->depthImageView,
+		                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		           : imageBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		                          sampler, pyramidLevelViews[i - 1],
+		                          VK_IMAGE_LAYOUT_GENERAL);
+		reduceSets[i] = allocator->getSet(
+		    reduceSetLayout,
+		    {imageBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_NULL_HANDLE,
+		                  pyramidLevelViews[i], VK_IMAGE_LAYOUT_GENERAL),
+		     source});
+	}
+
+	uint32_t swapChainSize = instance->surface->getSwapChainSize();
+	cullSets.resize(swapChainSize);
+	for (size_t i = 0; i < swapChainSize; i++) {
+		cullSets[i] = allocator->getSet(
+		    cullSetLayout,
+		    {bufferBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		                   cullBuffers[i], 0, sizeof(CullData)),
+		     bufferBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		                   meshletBuffer, 0, VK_WHOLE_SIZE),
+		     bufferBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawBuffer, 0,
+		                   VK_WHOLE_SIZE),
+		     bufferBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		                   visibilityBuffer, 0, VK_WHOLE_SIZE),
+		     imageBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		                  sampler, pyramidImageView, VK_IMAGE_LAYOUT_GENERAL),
+		     bufferBinding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, countBuffer,
+		                   0, VK_WHOLE_SIZE)});
+	}
+}
+
+void Occlusion::destroyBuffers(Device* device) {
+	vkDestroyBuffer(device->logical, meshletBuffer, nullptr);
+	vkFreeMemory(device->logical, meshletBufferMemory, nullptr);
+	vkDestroyBuffer(device->logical, drawBuffer, nullptr);
+	vkFreeMemory(device->logical, drawBufferMemory, nullptr);
+	vkDestroyBuffer(device->logical, visibilityBuffer, nullptr);
+	vkFreeMemory(device->logical, visibilityBufferMemory, nullptr);
+	vkDestroyBuffer(device->logical, countBuffer, nullptr);
+	vkFreeMemory(device->logical, countBufferMemory, nullptr);
+}
+
+void Occlusion::destroyResources(Device* device) {
+	VkDevice logical = device->logical;
+	for (size_t i = 0; i < cullBuffers.size(); i++) {
+		vkUnmapMemory(logical, cullBuffersMemory[i]);
+		vkDestroyBuffer(logical, cullBuffers[i], nullptr);
+		vkFreeMemory(logical, cullBuffersMemory[i], nullptr);
+	}
+	vkDestroyPipeline(logical, cullPipeline, nullptr);
+	vkDestroyPipeline(logical, depthReducePipeline, nullptr);
+	vkDestroyPipeline(logical, depthCopyPipeline, nullptr);
+	vkDestroyPipelineLayout(logical, cullPipelineLayout, nullptr);
+	vkDestroyPipelineLayout(logical, reducePipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logical, cullSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logical, reduceSetLayout, nullptr);
+	device->samplers.release(sampler);
+	for (auto view : pyramidLevelViews) {
+		vkDestroyImageView(logical, view, nullptr);
+	}
+	vkDestroyImageView(logical, pyramidImageView, nullptr);
+	vkDestroyImage(logical, pyramidImage, nullptr);
+	vkFreeMemory(logical, pyramidImageMemory, nullptr);
+}
+
+void Occlusion::updateCullData(Instance* instance, uint32_t imageIndex,
+                               const LodLevel& lod, const Frustum& frustum,
+                               glm::vec3 cameraPos) {
+	CullData data = {};
+	data.mvp = instance->descriptor->mvp;
+	data.previousMvp = previousMvp;
+	for (int i = 0; i < 6; i++) {
+		data.frustum[i] = frustum.planes[i];
+	}
+	data.cameraPos = glm::vec4(cameraPos, 1.0f);
+	data.pyramidSize = glm::vec2(pyramidWidth, pyramidHeight);
+	data.firstMeshlet = lod.firstMeshlet;
+	data.meshletCount = lod.meshletCount;
+	data.pyramidValid = pyramidValid ? 1 : 0;
+	memcpy(cullBuffersMapped[imageIndex], &data, sizeof(data));
+}
+
+void Occlusion::cull(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                     uint32_t pass, const LodLevel& lod) {
+	// The previous pass (or frame) may still be reading the draw commands
+	computeBarrier(
+	    commandBuffer,
+	    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+	        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	if (compactDraws && pass == 0) {
+		// Both passes count from zero; last frame's draws may still be
+		// reading the counts
+		computeBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		               VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+		               VK_PIPELINE_STAGE_TRANSFER_BIT,
+		               VK_ACCESS_TRANSFER_WRITE_BIT);
+		vkCmdFillBuffer(commandBuffer, countBuffer, 0, getCountOffset(2), 0);
+		computeBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		               VK_ACCESS_TRANSFER_WRITE_BIT,
+		               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		               VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	}
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+	                  cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+	                        cullPipelineLayout, 0, 1, &cullSets[imageIndex], 0,
+	                        nullptr);
+	CullConstants constants = {pass, pass * maxMeshlets};
+	vkCmdPushConstants(commandBuffer, cullPipelineLayout,
+	                   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+	                   &constants);
+	vkCmdDispatch(commandBuffer, (lod.meshletCount + 63) / 64, 1, 1);
+	computeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	               VK_ACCESS_SHADER_WRITE_BIT,
+	               VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+	                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	               VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+	                   VK_ACCESS_SHADER_READ_BIT);
+}
+
+void Occlusion::buildPyramid(Instance* instance,
+                             VkCommandBuffer commandBuffer) {
+	VkFormat depthFormat = findDepthFormat(instance->device);
+	VkImageMemoryBarrier depthBarrier = {};
+	depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = instance->renderer->depthImage;
+	depthBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (hasStencilComponent(depthFormat)) {
+		depthBarrier.subresourceRange.aspectMask |=
+		    VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	depthBarrier.subresourceRange.baseMipLevel = 0;
+	depthBarrier.subresourceRange.levelCount = 1;
+	depthBarrier.subresourceRange.baseArrayLayer = 0;
+	depthBarrier.subresourceRange.layerCount = 1;
+	depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+	                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+	                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+	                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+	                     0, nullptr, 1, &depthBarrier);
+
+	const VkExtent2D extent = instance->surface->getExtents();
+	glm::ivec2 srcSize(extent.width, extent.height);
+	glm::ivec2 dstSize(pyramidWidth, pyramidHeight);
+	for (uint32_t i = 0; i < pyramidLevels; i++) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+		                  i == 0 ? depthCopyPipeline : depthReducePipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+		                        reducePipelineLayout, 0, 1, &reduceSets[i], 0,
+		                        nullptr);
+		ReduceConstants constants = {
+		    srcSize, dstSize,
+		    static_cast<int32_t>(instance->renderer->msaaSamples)};
+		vkCmdPushConstants(commandBuffer, reducePipelineLayout,
+		                   VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+		                   &constants);
+		vkCmdDispatch(commandBuffer, (dstSize.x + 7) / 8, (dstSize.y + 7) / 8,
+		              1);
+		computeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		               VK_ACCESS_SHADER_WRITE_BIT,
+		               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		               VK_ACCESS_SHADER_READ_BIT);
+		srcSize = dstSize;
+		dstSize = glm::max(dstSize / 2, glm::ivec2(1));
+	}
+
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+	                             VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+	                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+	                     0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+	previousMvp = instance->descriptor->mvp;
+	pyramidValid = true;
+}
+
+VkDeviceSize Occlusion::getDrawOffset(uint32_t pass) const {
+	return sizeof(VkDrawIndexedIndirectCommand) * maxMeshlets * pass;
+}
+
+VkDeviceSize Occlusion::getCountOffset(uint32_t pass) const {
+	return sizeof(uint32_t) * pass;
+}
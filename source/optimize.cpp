@@ -0,0 +1,206 @@
+#include "optimize.h"
+#include "include.h"
+#include "lod.h"
+#include "meshlet.h"
+#include "util.h"
+
+float computeAcmr(const uint32_t* indices, size_t indexCount,
+                  uint32_t cacheSize) {
+	if (indexCount < 3) {
+		return 0.0f;
+	}
+	std::vector<uint32_t> cache;
+	cache.reserve(cacheSize);
+	size_t head = 0;
+	size_t misses = 0;
+	for (size_t i = 0; i < indexCount; i++) {
+		if (std::find(cache.begin(), cache.end(), indices[i]) != cache.end()) {
+			continue;
+		}
+		misses++;
+		if (cache.size() < cacheSize) {
+			cache.push_back(indices[i]);
+		} else {
+			cache[head] = indices[i];
+			head = (head + 1) % cacheSize;
+		}
+	}
+	return static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount,
+                         uint32_t cacheSize) {
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+	// Work on range-local vertex ids
+	std::vector<uint32_t> unique(indices, indices + indexCount);
+	std::sort(unique.begin(), unique.end());
+	unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+	size_t vertexCount = unique.size();
+	std::vector<uint32_t> local(indexCount);
+	for (size_t i = 0; i < indexCount; i++) {
+		local[i] = static_cast<uint32_t>(
+		    std::lower_bound(unique.begin(), unique.end(), indices[i]) -
+		    unique.begin());
+	}
+
+	std::vector<uint32_t> triOffsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < indexCount; i++) {
+		triOffsets[local[i] + 1]++;
+	}
+	for (size_t i = 0; i < vertexCount; i++) {
+		triOffsets[i + 1] += triOffsets[i];
+	}
+	std::vector<uint32_t> triList(indexCount);
+	std::vector<uint32_t> fill(triOffsets.begin(), triOffsets.end() - 1);
+	for (size_t i = 0; i < indexCount; i++) {
+		triList[fill[local[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+	std::vector<uint32_t> liveTriangles(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++) {
+		liveTriangles[i] = triOffsets[i + 1] - triOffsets[i];
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indexCount);
+	uint32_t timestamp = cacheSize + 1;
+	uint32_t cursor = 0;
+	int64_t fanning = 0;
+	while (fanning >= 0) {
+		uint32_t v = static_cast<uint32_t>(fanning);
+		candidates.clear();
+		for (uint32_t t = triOffsets[v]; t < triOffsets[v + 1]; t++) {
+			uint32_t tri = triList[t];
+			if (emitted[tri]) {
+				continue;
+			}
+			emitted[tri] = 1;
+			for (int k = 0; k < 3; k++) {
+				uint32_t w = local[tri * 3 + k];
+				output.push_back(w);
+				deadEnd.push_back(w);
+				candidates.push_back(w);
+				liveTriangles[w]--;
+				if (timestamp - cacheTime[w] > cacheSize) {
+					cacheTime[w] = timestamp++;
+				}
+			}
+		}
+		// Prefer the candidate still in cache with the most work left
+		fanning = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t w : candidates) {
+			if (liveTriangles[w] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			if (timestamp - cacheTime[w] + 2 * liveTriangles[w] <= cacheSize) {
+				priority = timestamp - cacheTime[w];
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fanning = w;
+			}
+		}
+		if (fanning >= 0) {
+			continue;
+		}
+		while (!deadEnd.empty()) {
+			uint32_t w = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[w] > 0) {
+				fanning = w;
+				break;
+			}
+		}
+		if (fanning >= 0) {
+			continue;
+		}
+		while (cursor < vertexCount && liveTriangles[cursor] == 0) {
+			cursor++;
+		}
+		if (cursor < vertexCount) {
+			fanning = cursor;
+		}
+	}
+	for (size_t i = 0; i < indexCount; i++) {
+		indices[i] = unique[output[i]];
+	}
+}
+
+void optimizeMeshlets(const std::vector<Vertex>& vertices,
+                      std::vector<uint32_t>& indices,
+                      std::vector<LodLevel>& lods,
+                      std::vector<Meshlet>& meshlets) {
+	std::vector<uint32_t> ordered;
+	for (const auto& lod : lods) {
+		auto first = meshlets.begin() + lod.firstMeshlet;
+		auto last = first + lod.meshletCount;
+		glm::vec3 meshCenter(0.0f);
+		for (auto it = first; it != last; it++) {
+			meshCenter += it->center;
+		}
+		meshCenter /= static_cast<float>(std::max(lod.meshletCount, 1u));
+		// Clusters facing away from the middle rarely hide behind others
+		std::vector<std::pair<float, Meshlet>> keyed;
+		keyed.reserve(lod.meshletCount);
+		for (auto it = first; it != last; it++) {
+			glm::vec3 normal(0.0f);
+			for (uint32_t i = it->firstIndex;
+			     i < it->firstIndex + it->indexCount; i += 3) {
+				glm::vec3 p0 = vertices[indices[i + 0]].pos;
+				glm::vec3 p1 = vertices[indices[i + 1]].pos;
+				glm::vec3 p2 = vertices[indices[i + 2]].pos;
+				normal += glm::cross(p1 - p0, p2 - p0);
+			}
+			float length = glm::length(normal);
+			float key = length > 0.0f ? glm::dot(it->center - meshCenter,
+			                                     normal / length)
+			                          : 0.0f;
+			keyed.push_back({key, *it});
+		}
+		std::stable_sort(keyed.begin(), keyed.end(),
+		                 [](const std::pair<float, Meshlet>& a,
+		                    const std::pair<float, Meshlet>& b) {
+			                 return a.first > b.first;
+		                 });
+		ordered.clear();
+		uint32_t next = lod.firstIndex;
+		for (size_t i = 0; i < keyed.size(); i++) {
+			Meshlet meshlet = keyed[i].second;
+			ordered.insert(ordered.end(), indices.begin() + meshlet.firstIndex,
+			               indices.begin() + meshlet.firstIndex +
+			                   meshlet.indexCount);
+			meshlet.firstIndex = next;
+			next += meshlet.indexCount;
+			first[i] = meshlet;
+		}
+		std::copy(ordered.begin(), ordered.end(),
+		          indices.begin() + lod.firstIndex);
+		for (auto it = first; it != last; it++) {
+			optimizeVertexCache(indices.data() + it->firstIndex,
+			                    it->indexCount, VERTEX_CACHE_SIZE);
+		}
+	}
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices,
+                         std::vector<uint32_t>& indices) {
+	std::vector<uint32_t> remap(vertices.size(), ~0u);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (auto& index : indices) {
+		if (remap[index] == ~0u) {
+			remap[index] = static_cast<uint32_t>(ordered.size());
+			ordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(ordered);
+}
@@ -0,0 +1,241 @@
+#include "overdraw.h"
+#include "descriptorallocator.h"
+#include "device.h"
+#include "include.h"
+#include "instance.h"
+#include "renderer.h"
+#include "surface.h"
+#include "util.h"
+
+void OverdrawView::createResources(Instance* instance) {
+	Device* device = instance->device;
+	const VkExtent2D extent = instance->surface->getExtents();
+	createImage(device, extent.width, extent.height, 1, VK_SAMPLE_COUNT_1_BIT,
+	            OVERDRAW_COUNT_FORMAT, VK_IMAGE_TILING_OPTIMAL,
+	            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+	                VK_IMAGE_USAGE_SAMPLED_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, countImage,
+	            countImageMemory);
+	countImageView = createImageView(device, countImage, OVERDRAW_COUNT_FORMAT,
+	                                 VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	createCountPass(instance);
+	VkFramebufferCreateInfo framebufferInfo = {};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = countPass;
+	framebufferInfo.attachmentCount = 1;
+	framebufferInfo.pAttachments = &countImageView;
+	framebufferInfo.width = extent.width;
+	framebufferInfo.height = extent.height;
+	framebufferInfo.layers = 1;
+	if (vkCreateFramebuffer(device->logical, &framebufferInfo, nullptr,
+	                        &countFramebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create framebuffer!");
+	}
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxAnisotropy = 1;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler = device->samplers.acquire(samplerInfo);
+
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorCount = 1;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+	if (vkCreateDescriptorSetLayout(device->logical, &layoutInfo, nullptr,
+	                                &setLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &setLayout;
+	if (vkCreatePipelineLayout(device->logical, &pipelineLayoutInfo, nullptr,
+	                           &pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+	createDisplayPipeline(instance);
+	set = instance->descriptorAllocator->getSet(
+	    setLayout,
+	    {imageBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sampler,
+	                  countImageView,
+	                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)});
+}
+
+void OverdrawView::createCountPass(Instance* instance) {
+	VkAttachmentDescription countAttachment = {};
+	countAttachment.format = OVERDRAW_COUNT_FORMAT;
+	countAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	countAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	countAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	countAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	countAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	countAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	countAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	VkAttachmentReference countAttachmentRef = {};
+	countAttachmentRef.attachment = 0;
+	countAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &countAttachmentRef;
+	// The previous frame's display pass may still be reading the counts,
+	// and this frame's reads them once they're written
+	std::array<VkSubpassDependency, 2> dependencies = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask =
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+	    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstStageMask =
+	    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+	                                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask =
+	    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &countAttachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount =
+	    static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
+	if (vkCreateRenderPass(instance->device->logical, &renderPassInfo, nullptr,
+	                       &countPass) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create render pass!");
+	}
+}
+
+void OverdrawView::createDisplayPipeline(Instance* instance) {
+	Device* device = instance->device;
+	VkShaderModule vertShaderModule = createShaderModule(
+	    device, readFile("shaders/fullscreen.vert.spv"));
+	VkShaderModule fragShaderModule = createShaderModule(
+	    device, readFile("shaders/overdrawview.frag.spv"));
+	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = vertShaderModule;
+	shaderStages[0].pName = "main";
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = fragShaderModule;
+	shaderStages[1].pName = "main";
+	// The triangle comes from gl_VertexIndex
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType =
+	    VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType =
+	    VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	const VkExtent2D extent = instance->surface->getExtents();
+	VkViewport viewport = {};
+	viewport.width = (float)extent.width;
+	viewport.height = (float)extent.height;
+	viewport.maxDepth = 1.0f;
+	VkRect2D scissor = {};
+	scissor.extent = extent;
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = &viewport;
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = &scissor;
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType =
+	    VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType =
+	    VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = instance->renderer->msaaSamples;
+	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+	depthStencil.sType =
+	    VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask =
+	    VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+	    VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType =
+	    VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+	pipelineInfo.pStages = shaderStages.data();
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.layout = pipelineLayout;
+	pipelineInfo.renderPass = instance->renderer->renderPass;
+	pipelineInfo.subpass = 0;
+	if (vkCreateGraphicsPipelines(device->logical, VK_NULL_HANDLE, 1,
+	                              &pipelineInfo, nullptr,
+	                              &displayPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+	vkDestroyShaderModule(device->logical, fragShaderModule, nullptr);
+	vkDestroyShaderModule(device->logical, vertShaderModule, nullptr);
+}
+
+void OverdrawView::display(Instance* instance, VkCommandBuffer commandBuffer,
+                           uint32_t imageIndex) {
+	VkRenderPassBeginInfo renderPassInfo =
+	    instance->renderer->getRenderPassInfo(instance, imageIndex);
+	std::array<VkClearValue, 2> clearValues = {};
+	clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+	clearValues[1].depthStencil = {1.0f, 0};
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+	                     VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	                  displayPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+	                        pipelineLayout, 0, 1, &set, 0, nullptr);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void OverdrawView::destroyResources(Device* device) {
+	VkDevice logical = device->logical;
+	vkDestroyPipeline(logical, displayPipeline, nullptr);
+	vkDestroyPipelineLayout(logical, pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(logical, setLayout, nullptr);
+	device->samplers.release(sampler);
+	vkDestroyFramebuffer(logical, countFramebuffer, nullptr);
+	vkDestroyRenderPass(logical, countPass, nullptr);
+	vkDestroyImageView(logical, countImageView, nullptr);
+	vkDestroyImage(logical, countImage, nullptr);
+	vkFreeMemory(logical, countImageMemory, nullptr);
+}
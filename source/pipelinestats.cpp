@@ -0,0 +1,103 @@
+#include "pipelinestats.h"
+#include "device.h"
+#include "include.h"
+#include "instance.h"
+#include "sync.h"
+#include "util.h"
+
+namespace {
+	// Results come back in bit order, which is the order of
+	// FrameStatistics
+	constexpr VkQueryPipelineStatisticFlags STATISTICS_FLAGS =
+	    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+	constexpr uint32_t STATISTICS_COUNT = 3;
+} // namespace
+
+void PipelineStatistics::checkSupport(Instance* instance) {
+	if (!enabled) {
+		return;
+	}
+	enabled = instance->device->enabledFeatures.pipelineStatisticsQuery;
+	std::cout << "Pipeline statistics " << (enabled ? "enabled" : "disabled")
+	          << std::endl;
+}
+
+void PipelineStatistics::create(Instance* instance) {
+	device = instance->device;
+	VkQueryPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	poolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * PIPELINE_STATISTICS_PASSES;
+	poolInfo.pipelineStatistics = STATISTICS_FLAGS;
+	if (vkCreateQueryPool(device->logical, &poolInfo, nullptr, &pool) !=
+	    VK_SUCCESS) {
+		throw std::runtime_error("failed to create query pool!");
+	}
+	passCounts.assign(MAX_FRAMES_IN_FLIGHT, 0);
+}
+
+void PipelineStatistics::beginFrame(VkCommandBuffer commandBuffer,
+                                    uint32_t frame) {
+	vkCmdResetQueryPool(commandBuffer, pool,
+	                    frame * PIPELINE_STATISTICS_PASSES,
+	                    PIPELINE_STATISTICS_PASSES);
+	passCounts[frame] = 0;
+}
+
+void PipelineStatistics::beginPass(VkCommandBuffer commandBuffer,
+                                   uint32_t frame) {
+	if (passCounts[frame] == PIPELINE_STATISTICS_PASSES) {
+		throw std::runtime_error("failed to find a free statistics query!");
+	}
+	uint32_t query = frame * PIPELINE_STATISTICS_PASSES + passCounts[frame];
+	vkCmdBeginQuery(commandBuffer, pool, query, 0);
+}
+
+void PipelineStatistics::endPass(VkCommandBuffer commandBuffer,
+                                 uint32_t frame) {
+	uint32_t query = frame * PIPELINE_STATISTICS_PASSES + passCounts[frame];
+	vkCmdEndQuery(commandBuffer, pool, query);
+	passCounts[frame]++;
+}
+
+void PipelineStatistics::collect(uint32_t frame, VkExtent2D extent) {
+	uint32_t passCount = passCounts[frame];
+	if (passCount == 0) {
+		return;
+	}
+	passCounts[frame] = 0;
+	std::array<uint64_t, STATISTICS_COUNT * PIPELINE_STATISTICS_PASSES>
+	    results = {};
+	// The fence has signalled, so the results are available
+	if (vkGetQueryPoolResults(device->logical, pool,
+	                          frame * PIPELINE_STATISTICS_PASSES, passCount,
+	                          sizeof(results), results.data(),
+	                          STATISTICS_COUNT * sizeof(uint64_t),
+	                          VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+		return;
+	}
+	last = FrameStatistics();
+	for (uint32_t pass = 0; pass < passCount; pass++) {
+		const uint64_t* passResults = &results[pass * STATISTICS_COUNT];
+		last.vertexInvocations += passResults[0];
+		last.clippingPrimitives += passResults[1];
+		last.fragmentInvocations += passResults[2];
+	}
+	last.overdraw = last.fragmentInvocations /
+	                std::max(1.0, double(extent.width) * extent.height);
+	if (frameCount++ % PIPELINE_STATISTICS_INTERVAL == 0) {
+		std::cout << "Frame " << frameCount << ": "
+		          << last.vertexInvocations << " vertex invocations, "
+		          << last.clippingPrimitives << " clipping primitives, "
+		          << last.fragmentInvocations << " fragment invocations, "
+		          << last.overdraw << "x overdraw" << std::endl;
+	}
+}
+
+void PipelineStatistics::destroy(Device* device) {
+	if (enabled) {
+		vkDestroyQueryPool(device->logical, pool, nullptr);
+	}
+}
@@ -0,0 +1,198 @@
+#include "readback.h"
+#include "device.h"
+#include "include.h"
+#include "instance.h"
+#include "threadpool.h"
+#include "trace.h"
+#include "util.h"
+
+#include <fstream>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+namespace {
+	bool isBgra(VkFormat format) {
+		return format == VK_FORMAT_B8G8R8A8_SRGB ||
+		       format == VK_FORMAT_B8G8R8A8_UNORM;
+	}
+
+	bool isPngPath(const std::string& path) {
+		return path.size() >= 4 &&
+		       path.compare(path.size() - 4, 4, ".png") == 0;
+	}
+
+	// Runs on the thread pool. Swaps BGRA in place, which the slot's cached
+	// memory makes cheap.
+	void writeImage(const std::string& path, uint8_t* pixels, uint32_t width,
+	                uint32_t height, bool bgra) {
+		size_t size = size_t(width) * height * 4;
+		if (bgra) {
+			for (size_t i = 0; i < size; i += 4) {
+				std::swap(pixels[i], pixels[i + 2]);
+			}
+		}
+		bool written;
+		if (isPngPath(path)) {
+			written = stbi_write_png(path.c_str(), static_cast<int>(width),
+			                         static_cast<int>(height), 4, pixels,
+			                         static_cast<int>(width * 4)) != 0;
+		} else {
+			std::ofstream file(path, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(pixels), size);
+			written = file.good();
+		}
+		if (!written) {
+			throw std::runtime_error("failed to write " + path + "!");
+		}
+	}
+} // namespace
+
+void ReadbackRing::create(Instance* instance, uint32_t imageWidth,
+                          uint32_t imageHeight, VkFormat imageFormat,
+                          uint32_t slotCount) {
+	if (!isBgra(imageFormat) && imageFormat != VK_FORMAT_R8G8B8A8_SRGB &&
+	    imageFormat != VK_FORMAT_R8G8B8A8_UNORM) {
+		throw std::runtime_error("failed to find supported readback format!");
+	}
+	device = instance->device;
+	threadPool = instance->threadPool;
+	width = imageWidth;
+	height = imageHeight;
+	format = imageFormat;
+	slots = std::vector<Slot>(slotCount);
+	allocate();
+}
+
+void ReadbackRing::allocate() {
+	for (Slot& slot : slots) {
+		slot.buffer.create(device, VkDeviceSize(width) * height * 4,
+		                   VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	}
+	next = 0;
+}
+
+void ReadbackRing::resize(uint32_t imageWidth, uint32_t imageHeight) {
+	flush();
+	for (Slot& slot : slots) {
+		slot.buffer.destroy(device);
+	}
+	width = imageWidth;
+	height = imageHeight;
+	allocate();
+}
+
+void ReadbackRing::capture(VkCommandBuffer commandBuffer, VkImage image,
+                           VkImageLayout layout, uint32_t fence,
+                           const std::string& path) {
+	Slot& slot = slots[next];
+	if (slot.state == SlotState::Copying) {
+		throw std::runtime_error("failed to find a free readback slot!");
+	}
+	if (slot.state == SlotState::Encoding) {
+		reclaim(slot);
+	}
+	next = (next + 1) % slots.size();
+	slot.state = SlotState::Copying;
+	slot.fence = fence;
+	slot.path = path;
+	captures++;
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.oldLayout = layout;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(commandBuffer,
+	                     VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+	                     nullptr, 1, &barrier);
+	VkBufferImageCopy region = {};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = {width, height, 1};
+	vkCmdCopyImageToBuffer(commandBuffer, image,
+	                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	                       slot.buffer.buffer, 1, &region);
+	// Back to where the image was, for presentation or whatever follows
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = layout;
+	VkBufferMemoryBarrier bufferBarrier = {};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = slot.buffer.buffer;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_HOST_BIT |
+	                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+	                     0, 0, nullptr, 1, &bufferBarrier, 1, &barrier);
+}
+
+void ReadbackRing::collect(uint32_t fence) {
+	for (Slot& slot : slots) {
+		if (slot.state == SlotState::Copying && slot.fence == fence) {
+			encode(slot);
+		}
+	}
+}
+
+void ReadbackRing::encode(Slot& slot) {
+	uint8_t* pixels = slot.buffer.data;
+	uint32_t imageWidth = width;
+	uint32_t imageHeight = height;
+	bool bgra = isBgra(format);
+	std::string path = slot.path;
+	slot.encoded = threadPool->submit([=]() {
+		TRACE_ZONE("Encode image");
+		writeImage(path, pixels, imageWidth, imageHeight, bgra);
+	});
+	slot.state = SlotState::Encoding;
+}
+
+void ReadbackRing::reclaim(Slot& slot) {
+	try {
+		// Rethrows anything the encoding thread threw
+		slot.encoded.get();
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		failures++;
+	}
+	slot.state = SlotState::Free;
+}
+
+void ReadbackRing::flush() {
+	for (Slot& slot : slots) {
+		if (slot.state == SlotState::Copying) {
+			encode(slot);
+		}
+	}
+	for (Slot& slot : slots) {
+		if (slot.state == SlotState::Encoding) {
+			reclaim(slot);
+		}
+	}
+}
+
+void ReadbackRing::destroy() {
+	flush();
+	for (Slot& slot : slots) {
+		slot.buffer.destroy(device);
+	}
+	slots.clear();
+}
+
+size_t ReadbackRing::getCaptureCount() const { return captures; }
+
+size_t ReadbackRing::getFailureCount() const { return failures; }
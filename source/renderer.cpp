@@ -5,41 +5,66 @@
 #include "include.h"
 #include "instance.h"
 #include "model.h"
+#include "occlusion.h"
+#include "overdraw.h"
 #include "surface.h"
 #include "sync.h"
 #include "texture.h"
+#include "trace.h"
 #include "util.h"
 
 void Renderer::createRenderPass(Instance* instance) {
 	msaaSamples = getMaxUsableSampleCount(instance->device);
+	VkFormat format = instance->surface->getFormat();
+	renderPass =
+	    buildRenderPass(instance, VK_ATTACHMENT_LOAD_OP_CLEAR, format,
+	                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	renderPassLoad =
+	    buildRenderPass(instance, VK_ATTACHMENT_LOAD_OP_LOAD, format,
+	                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+}
+
+VkRenderPass Renderer::buildRenderPass(Instance* instance,
+                                       VkAttachmentLoadOp loadOp,
+                                       VkFormat format,
+                                       VkImageLayout resolveLayout) {
+	// A loading pass continues where a previous pass left the attachments
+	bool load = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
 	VkAttachmentDescription colorAttachment = {};
-	colorAttachment.format = instance->surface->getFormat();
+	colorAttachment.format = format;
 	colorAttachment.samples = msaaSamples;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.loadOp = loadOp;
 	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.initialLayout =
+	    load ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	         : VK_IMAGE_LAYOUT_UNDEFINED;
 	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	VkAttachmentDescription depthAttachment = {};
 	depthAttachment.format = findDepthFormat(instance->device);
 	depthAttachment.samples = msaaSamples;
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.loadOp = loadOp;
+	// The Hi-Z pyramid and the second occlusion pass read the stored depth
+	depthAttachment.storeOp = instance->occlusion->enabled
+	                              ? VK_ATTACHMENT_STORE_OP_STORE
+	                              : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.initialLayout =
+	    load ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+	         : VK_IMAGE_LAYOUT_UNDEFINED;
 	depthAttachment.finalLayout =
 	    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	VkAttachmentDescription colourAttachmentResolve = {};
-	colourAttachmentResolve.format = instance->surface->getFormat();
+	colourAttachmentResolve.format = format;
 	colourAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
 	colourAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colourAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	colourAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colourAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colourAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colourAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colourAttachmentResolve.finalLayout = resolveLayout;
 
 	VkAttachmentReference colorAttachmentRef = {};
 	colorAttachmentRef.attachment = 0;
@@ -62,11 +87,16 @@ void Renderer::createRenderPass(Instance* instance) {
 	VkSubpassDependency dependency = {};
 	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
 	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+	                          VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+	                          VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-	                           VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	                           VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+	                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	std::array<VkAttachmentDescription, 3> attachments = {
 	    colorAttachment, depthAttachment, colourAttachmentResolve};
 	VkRenderPassCreateInfo renderPassInfo = {};
@@ -77,15 +107,53 @@ void Renderer::createRenderPass(Instance* instance) {
 	renderPassInfo.pSubpasses = &subpass;
 	renderPassInfo.dependencyCount = 1;
 	renderPassInfo.pDependencies = &dependency;
+	VkRenderPass pass;
 	if (vkCreateRenderPass(instance->device->logical, &renderPassInfo, nullptr,
-	                       &renderPass) != VK_SUCCESS) {
+	                       &pass) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create render pass!");
 	}
+	return pass;
 }
 
 void Renderer::createGraphicsPipeline(Instance* instance) {
-	auto vertShaderCode = readFile("shaders/shader.vert.spv");
-	auto fragShaderCode = readFile("shaders/shader.frag.spv");
+	pipelineLayout = buildPipelineLayout(instance);
+	// The overdraw view draws the geometry into its count attachment
+	OverdrawView* overdraw = instance->overdraw;
+	graphicsPipeline = buildPipeline(
+	    instance, instance->models[0].layout, pipelineLayout,
+	    overdraw->enabled ? overdraw->countPass : renderPass,
+	    instance->surface->getExtents(), overdraw->enabled);
+}
+
+VkPipelineLayout Renderer::buildPipelineLayout(Instance* instance) {
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.pSetLayouts = &instance->descriptor->descriptorSetLayout;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(UniformBufferObject);
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+	VkPipelineLayout layout;
+	if (vkCreatePipelineLayout(instance->device->logical, &pipelineLayoutInfo,
+	                           nullptr, &layout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+	return layout;
+}
+
+VkPipeline Renderer::buildPipeline(Instance* instance,
+                                   const VertexLayout& layout,
+                                   VkPipelineLayout pipelineLayout,
+                                   VkRenderPass renderPass,
+                                   VkExtent2D extent, bool countOverdraw) {
+	TRACE_ZONE("Build pipeline");
+	auto vertShaderCode = readFile(layout.getShaderPath());
+	auto fragShaderCode = readFile(countOverdraw
+	                                   ? "shaders/overdraw.frag.spv"
+	                                   : "shaders/shader.frag.spv");
 	VkShaderModule vertShaderModule =
 	    createShaderModule(instance->device, vertShaderCode);
 	VkShaderModule fragShaderModule =
@@ -107,8 +175,8 @@ void Renderer::createGraphicsPipeline(Instance* instance) {
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType =
 	    VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attributeDescriptions = Vertex::getAttributeDescriptions();
+	auto bindingDescription = layout.getBindingDescription();
+	auto attributeDescriptions = layout.getAttributeDescriptions();
 	vertexInputInfo.vertexBindingDescriptionCount = 1;
 	vertexInputInfo.vertexAttributeDescriptionCount =
 	    static_cast<uint32_t>(attributeDescriptions.size());
@@ -122,14 +190,13 @@ void Renderer::createGraphicsPipeline(Instance* instance) {
 	VkViewport viewport = {};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
-	const VkExtent2D swapChainExtent = instance->surface->getExtents();
-	viewport.width = (float)swapChainExtent.width;
-	viewport.height = (float)swapChainExtent.height;
+	viewport.width = (float)extent.width;
+	viewport.height = (float)extent.height;
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
 	VkRect2D scissor = {};
 	scissor.offset = {0, 0};
-	scissor.extent = swapChainExtent;
+	scissor.extent = extent;
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
@@ -153,7 +220,9 @@ void Renderer::createGraphicsPipeline(Instance* instance) {
 	multisampling.sType =
 	    VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = msaaSamples;
+	// Counts are kept per pixel
+	multisampling.rasterizationSamples =
+	    countOverdraw ? VK_SAMPLE_COUNT_1_BIT : msaaSamples;
 	multisampling.minSampleShading = 1.0f;          // Optional
 	multisampling.pSampleMask = nullptr;            // Optional
 	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
@@ -161,8 +230,9 @@ void Renderer::createGraphicsPipeline(Instance* instance) {
 	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
 	depthStencil.sType =
 	    VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
+	// Hidden layers count as overdraw too
+	depthStencil.depthTestEnable = countOverdraw ? VK_FALSE : VK_TRUE;
+	depthStencil.depthWriteEnable = countOverdraw ? VK_FALSE : VK_TRUE;
 	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
 	depthStencil.depthBoundsTestEnable = VK_FALSE;
 	depthStencil.minDepthBounds = 0.0f; // Optional
@@ -172,15 +242,16 @@ void Renderer::createGraphicsPipeline(Instance* instance) {
 	depthStencil.back = {};  // Optional
 	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
 	colorBlendAttachment.colorWriteMask =
-	    VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-	    VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	/*colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;*/
+	    countOverdraw ? VK_COLOR_COMPONENT_R_BIT
+	                  : VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+	                        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = countOverdraw ? VK_TRUE : VK_FALSE;
+	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
 	VkPipelineColorBlendStateCreateInfo colorBlending = {};
 	colorBlending.sType =
 	    VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -192,20 +263,6 @@ void Renderer::createGraphicsPipeline(Instance* instance) {
 	colorBlending.blendConstants[1] = 0.0f; // Optional
 	colorBlending.blendConstants[2] = 0.0f; // Optional
 	colorBlending.blendConstants[3] = 0.0f; // Optional
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.pSetLayouts = &instance->descriptor->descriptorSetLayout;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	VkPushConstantRange pushConstantRange = {};
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	pushConstantRange.offset = 0;
-	pushConstantRange.size = sizeof(UniformBufferObject);
-	pipelineLayoutInfo.pushConstantRangeCount = 1;
-	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-	if (vkCreatePipelineLayout(instance->device->logical, &pipelineLayoutInfo,
-	                           nullptr, &pipelineLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
 	VkGraphicsPipelineCreateInfo pipelineInfo = {};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipelineInfo.stageCount = 2;
@@ -223,13 +280,15 @@ void Renderer::createGraphicsPipeline(Instance* instance) {
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1;              // Optional
+	VkPipeline pipeline;
 	if (vkCreateGraphicsPipelines(instance->device->logical, VK_NULL_HANDLE, 1,
 	                              &pipelineInfo, nullptr,
-	                              &graphicsPipeline) != VK_SUCCESS) {
+	                              &pipeline) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create graphics pipeline!");
 	}
 	vkDestroyShaderModule(instance->device->logical, fragShaderModule, nullptr);
 	vkDestroyShaderModule(instance->device->logical, vertShaderModule, nullptr);
+	return pipeline;
 }
 
 void Renderer::createFramebuffers(Instance* instance) {
@@ -260,10 +319,13 @@ void Renderer::createFramebuffers(Instance* instance) {
 void Renderer::createColourResources(Instance* instance) {
 	VkFormat colourFormat = instance->surface->getFormat();
 	const VkExtent2D swapChainExtent = instance->surface->getExtents();
+	// Occlusion culling draws in two passes, so the colour must survive
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	if (!instance->occlusion->enabled) {
+		usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	}
 	createImage(instance->device, swapChainExtent.width, swapChainExtent.height,
-	            1, msaaSamples, colourFormat, VK_IMAGE_TILING_OPTIMAL,
-	            VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
-	                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+	            1, msaaSamples, colourFormat, VK_IMAGE_TILING_OPTIMAL, usage,
 	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colourImage,
 	            colourImageMemory);
 	colourImageView =
@@ -278,9 +340,13 @@ void Renderer::createDepthResources(Instance* instance) {
 	    std::floor(std::log2(
 	        std::max(swapChainExtent.width, swapChainExtent.height))) +
 	    1;
+	// The Hi-Z pyramid is built from the stored depth
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (instance->occlusion->enabled) {
+		usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
 	createImage(instance->device, swapChainExtent.width, swapChainExtent.height,
-	            1, msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-	            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+	            1, msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, usage,
 	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage,
 	            depthImageMemory);
 	depthImageView = createImageView(instance->device, depthImage, depthFormat,
@@ -319,6 +385,7 @@ VkSampleCountFlagBits Renderer::getMaxUsableSampleCount(Device* device) {
 
 void Renderer::destroyRenderPass(Device* device) {
 	vkDestroyRenderPass(device->logical, renderPass, nullptr);
+	vkDestroyRenderPass(device->logical, renderPassLoad, nullptr);
 }
 
 void Renderer::destroyGraphicsPipeline(Device* device) {
@@ -0,0 +1,67 @@
+#include "sampler.h"
+#include "device.h"
+#include "include.h"
+#include "util.h"
+
+namespace {
+	bool sameState(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b) {
+		return a.flags == b.flags && a.magFilter == b.magFilter &&
+		       a.minFilter == b.minFilter && a.mipmapMode == b.mipmapMode &&
+		       a.addressModeU == b.addressModeU &&
+		       a.addressModeV == b.addressModeV &&
+		       a.addressModeW == b.addressModeW &&
+		       a.mipLodBias == b.mipLodBias &&
+		       a.anisotropyEnable == b.anisotropyEnable &&
+		       a.maxAnisotropy == b.maxAnisotropy &&
+		       a.compareEnable == b.compareEnable &&
+		       a.compareOp == b.compareOp && a.minLod == b.minLod &&
+		       a.maxLod == b.maxLod && a.borderColor == b.borderColor &&
+		       a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+	}
+} // namespace
+
+void SamplerCache::create(Device* device) {
+	this->device = device;
+	entries.clear();
+}
+
+VkSampler SamplerCache::acquire(const VkSamplerCreateInfo& samplerInfo) {
+	if (samplerInfo.pNext) {
+		throw std::runtime_error("failed to cache sampler with extensions!");
+	}
+	for (Entry& entry : entries) {
+		if (sameState(entry.info, samplerInfo)) {
+			entry.references++;
+			return entry.sampler;
+		}
+	}
+	Entry entry;
+	entry.info = samplerInfo;
+	entry.references = 1;
+	if (vkCreateSampler(device->logical, &samplerInfo, nullptr,
+	                    &entry.sampler) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create texture sampler!");
+	}
+	entries.push_back(entry);
+	return entry.sampler;
+}
+
+void SamplerCache::release(VkSampler sampler) {
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].sampler != sampler) {
+			continue;
+		}
+		if (--entries[i].references == 0) {
+			vkDestroySampler(device->logical, sampler, nullptr);
+			entries.erase(entries.begin() + i);
+		}
+		return;
+	}
+}
+
+void SamplerCache::destroy() {
+	for (const Entry& entry : entries) {
+		vkDestroySampler(device->logical, entry.sampler, nullptr);
+	}
+	entries.clear();
+}
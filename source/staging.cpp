@@ -0,0 +1,156 @@
+#include "staging.h"
+#include "device.h"
+#include "include.h"
+#include "util.h"
+
+namespace {
+	// Cached memory keeps reading the data back on the CPU cheap, which
+	// write-combined memory does not
+	uint32_t findStagingMemoryType(Device* device, uint32_t typeFilter) {
+		VkMemoryPropertyFlags required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+		                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(device->physical, &memProperties);
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			VkMemoryPropertyFlags flags =
+			    memProperties.memoryTypes[i].propertyFlags;
+			if ((typeFilter & (1 << i)) && (flags & required) == required &&
+			    (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+				return i;
+			}
+		}
+		return findMemoryType(device, typeFilter, required);
+	}
+} // namespace
+
+void StagingBuffer::create(Device* device, VkDeviceSize bufferSize,
+                           VkBufferUsageFlags usage) {
+	size = bufferSize;
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (vkCreateBuffer(device->logical, &bufferInfo, nullptr, &buffer) !=
+	    VK_SUCCESS) {
+		throw std::runtime_error("failed to create staging buffer!");
+	}
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device->logical, buffer, &memRequirements);
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = memRequirements.size;
+	allocInfo.memoryTypeIndex =
+	    findStagingMemoryType(device, memRequirements.memoryTypeBits);
+	if (vkAllocateMemory(device->logical, &allocInfo, nullptr, &memory) !=
+	    VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate staging buffer memory!");
+	}
+	vkBindBufferMemory(device->logical, buffer, memory, 0);
+	void* mapped;
+	if (vkMapMemory(device->logical, memory, 0, size, 0, &mapped) !=
+	    VK_SUCCESS) {
+		throw std::runtime_error("failed to map staging buffer memory!");
+	}
+	data = static_cast<uint8_t*>(mapped);
+}
+
+void StagingBuffer::destroy(Device* device) {
+	if (buffer == VK_NULL_HANDLE) {
+		return;
+	}
+	vkUnmapMemory(device->logical, memory);
+	vkDestroyBuffer(device->logical, buffer, nullptr);
+	vkFreeMemory(device->logical, memory, nullptr);
+	buffer = VK_NULL_HANDLE;
+	memory = VK_NULL_HANDLE;
+	data = nullptr;
+	size = 0;
+}
+
+void StagingPool::create(Device* device) {
+	this->device = device;
+	blocks.clear();
+}
+
+StagingSpan StagingPool::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+	std::lock_guard<std::mutex> lock(mutex);
+	uint32_t index = static_cast<uint32_t>(blocks.size());
+	VkDeviceSize offset = 0;
+	if (size > STAGING_POOL_BLOCK_SIZE) {
+		index = createBlock(size);
+	} else {
+		for (uint32_t i = 0; i < blocks.size(); i++) {
+			const StagingBuffer& buffer = blocks[i].buffer;
+			if (buffer.size != STAGING_POOL_BLOCK_SIZE) {
+				continue;
+			}
+			offset = (blocks[i].used + alignment - 1) / alignment * alignment;
+			if (offset + size <= buffer.size) {
+				index = i;
+				break;
+			}
+		}
+		if (index == blocks.size()) {
+			index = createBlock(STAGING_POOL_BLOCK_SIZE);
+			offset = 0;
+		}
+	}
+	Block& block = blocks[index];
+	block.used = offset + size;
+	block.live++;
+	StagingSpan span;
+	span.buffer = block.buffer.buffer;
+	span.offset = offset;
+	span.data = block.buffer.data + offset;
+	span.size = size;
+	span.block = index;
+	return span;
+}
+
+void StagingPool::free(StagingSpan& span) {
+	if (span.buffer == VK_NULL_HANDLE) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	Block& block = blocks[span.block];
+	span = StagingSpan();
+	if (--block.live > 0) {
+		return;
+	}
+	block.used = 0;
+	// Keep one empty block around for the next burst of uploads, give the
+	// rest back
+	bool spare = false;
+	for (const Block& other : blocks) {
+		if (&other != &block && other.live == 0 &&
+		    other.buffer.size == STAGING_POOL_BLOCK_SIZE) {
+			spare = true;
+		}
+	}
+	if (spare || block.buffer.size != STAGING_POOL_BLOCK_SIZE) {
+		block.buffer.destroy(device);
+	}
+}
+
+void StagingPool::destroy() {
+	for (Block& block : blocks) {
+		block.buffer.destroy(device);
+	}
+	blocks.clear();
+}
+
+uint32_t StagingPool::createBlock(VkDeviceSize size) {
+	uint32_t index = 0;
+	while (index < blocks.size() &&
+	       blocks[index].buffer.buffer != VK_NULL_HANDLE) {
+		index++;
+	}
+	if (index == blocks.size()) {
+		blocks.push_back(Block());
+	}
+	blocks[index].buffer.create(device, size);
+	blocks[index].used = 0;
+	blocks[index].live = 0;
+	return index;
+}
@@ -29,6 +29,7 @@ void Surface::createWindow(Instance* instance) {
 	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 	window = glfwCreateWindow(width, height, "Vulkan", nullptr, nullptr);
 	glfwSetWindowUserPointer(window, instance);
 	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
@@ -42,17 +43,20 @@ void Surface::createSurface(Instance* instance) {
 }
 
 void Surface::createSwapChain(Instance* instance) {
-	SwapChainSupportDetails swapChainSupport =
-	    querySwapChainSupport(instance, instance->device->physical);
+	const DeviceCapabilities& deviceCapabilities =
+	    instance->device->capabilities;
+	VkSurfaceCapabilitiesKHR capabilities;
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(instance->device->physical,
+	                                          surface, &capabilities);
 	VkSurfaceFormatKHR surfaceFormat =
-	    chooseSwapSurfaceFormat(swapChainSupport.formats);
+	    chooseSwapSurfaceFormat(deviceCapabilities.surfaceFormats);
 	VkPresentModeKHR presentMode =
-	    chooseSwapPresentMode(swapChainSupport.presentModes);
-	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
-	uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-	if (swapChainSupport.capabilities.maxImageCount > 0 &&
-	    imageCount > swapChainSupport.capabilities.maxImageCount) {
-		imageCount = swapChainSupport.capabilities.maxImageCount;
+	    chooseSwapPresentMode(deviceCapabilities.presentModes);
+	VkExtent2D extent = chooseSwapExtent(capabilities);
+	uint32_t imageCount = capabilities.minImageCount + 1;
+	if (capabilities.maxImageCount > 0 &&
+	    imageCount > capabilities.maxImageCount) {
+		imageCount = capabilities.maxImageCount;
 	}
 	VkSwapchainCreateInfoKHR createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -63,8 +67,16 @@ void Surface::createSwapChain(Instance* instance) {
 	createInfo.imageExtent = extent;
 	createInfo.imageArrayLayers = 1;
 	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-	QueueFamilyIndices indices =
-	    findQueueFamilies(instance, instance->device->physical);
+	// Captured frames are copied straight out of the swap chain
+	if (!instance->captureDirectory.empty()) {
+		if (!(capabilities.supportedUsageFlags &
+		      VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+			throw std::runtime_error(
+			    "failed to find swap chain support for capture!");
+		}
+		createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+	const QueueFamilyIndices& indices = deviceCapabilities.queueFamilies;
 	uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(),
 	                                 indices.presentFamily.value()};
 	if (indices.graphicsFamily != indices.presentFamily) {
@@ -74,7 +86,7 @@ void Surface::createSwapChain(Instance* instance) {
 	} else {
 		createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	}
-	createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+	createInfo.preTransform = capabilities.currentTransform;
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
@@ -1,78 +1,229 @@
 #include "texture.h"
+#include "bcencode.h"
 #include "commander.h"
 #include "descriptor.h"
 #include "device.h"
 #include "include.h"
 #include "instance.h"
+#include "ktx2.h"
+#include "mipgen.h"
 #include "model.h"
 #include "renderer.h"
 #include "surface.h"
 #include "sync.h"
+#include "texturecache.h"
+#include "trace.h"
 #include "util.h"
 
+#include <memory>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+namespace {
+	typedef std::unique_ptr<stbi_uc, void (*)(void*)> DecodedImage;
+} // namespace
+
 void Texture::create(Instance* instance, std::string imgPath) {
-	createTextureImage(instance, imgPath);
-	createTextureImageView(instance->device);
-	createTextureSampler(instance->device);
+	load(imgPath);
+	upload(instance);
 }
 
-void Texture::destroy(Device* device) {
-	vkDestroySampler(device->logical, sampler, nullptr);
-	vkDestroyImageView(device->logical, view, nullptr);
-	vkDestroyImage(device->logical, image, nullptr);
-	vkFreeMemory(device->logical, memory, nullptr);
+void Texture::createPlaceholder(Instance* instance) {
+	stagingPool = instance->stagingPool;
+	memset(allocatePixels(4), 255, 4);
+	levelOffsets = {0};
+	format = VK_FORMAT_R8G8B8A8_SRGB;
+	width = 1;
+	height = 1;
+	mipLevels = 1;
+	upload(instance);
+}
+
+void Texture::load(std::string imgPath) {
+	TRACE_ZONE("Load texture");
+	if (isKtx2Path(imgPath)) {
+		readKtx2(imgPath, *this, nullptr);
+		if (levelOffsets.size() < mipLevels) {
+			buildMipChain(staging.data,
+			              format == VK_FORMAT_R8G8B8A8_SRGB);
+		} else {
+			chainPath = imgPath;
+		}
+		return;
+	}
+	if (readTextureCache(imgPath, *this)) {
+		return;
+	}
+	int texWidth, texHeight, texChannels;
+	DecodedImage data(stbi_load(imgPath.c_str(), &texWidth, &texHeight,
+	                            &texChannels, STBI_rgb_alpha),
+	                  stbi_image_free);
+	setPixels(data.get(), texWidth, texHeight, imgPath);
 }
 
-void Texture::createTextureImage(Instance* instance, std::string imgPath) {
+void Texture::loadFromMemory(const uint8_t* data, size_t size,
+                             const std::string& cacheSource) {
+	if (!cacheSource.empty() && readTextureCache(cacheSource, *this)) {
+		return;
+	}
 	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(imgPath.c_str(), &texWidth, &texHeight,
-	                            &texChannels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-	if (!pixels) {
+	DecodedImage pixelData(
+	    stbi_load_from_memory(data, static_cast<int>(size), &texWidth,
+	                          &texHeight, &texChannels, STBI_rgb_alpha),
+	    stbi_image_free);
+	setPixels(pixelData.get(), texWidth, texHeight, cacheSource);
+}
+
+uint8_t* Texture::allocatePixels(size_t size) {
+	releaseStaging();
+	staging = stagingPool->allocate(size, TEXTURE_STAGING_ALIGNMENT);
+	return staging.data;
+}
+
+void Texture::releaseStaging() {
+	if (stagingPool) {
+		stagingPool->free(staging);
+	}
+}
+
+void Texture::setPixels(const uint8_t* data, int texWidth, int texHeight,
+                        const std::string& cacheSource) {
+	if (!data) {
 		throw std::runtime_error("failed to load texture image!");
 	}
+	width = static_cast<uint32_t>(texWidth);
+	height = static_cast<uint32_t>(texHeight);
 	mipLevels = static_cast<uint32_t>(
 	                std::floor(std::log2(std::max(texWidth, texHeight)))) +
 	            1;
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(instance->device, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-	                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-	             stagingBuffer, stagingBufferMemory);
-	void* data;
-	vkMapMemory(instance->device->logical, stagingBufferMemory, 0, imageSize, 0,
-	            &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(instance->device->logical, stagingBufferMemory);
-	stbi_image_free(pixels);
-	createImage(
-	    instance->device, texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT,
-	    VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
-	    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
-	        VK_IMAGE_USAGE_SAMPLED_BIT,
-	    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+	if (compression == TextureCompression::None) {
+		format = VK_FORMAT_R8G8B8A8_SRGB;
+		buildMipChain(data, true);
+	} else {
+		compress(data);
+	}
+	if (!cacheSource.empty() && writeTextureCache(cacheSource, *this)) {
+		chainPath = getTextureCachePath(cacheSource);
+	}
+}
+
+void Texture::buildMipChain(const uint8_t* data, bool srgb) {
+	TRACE_ZONE("Build mip chain");
+	// data may live in the span being replaced
+	StagingSpan previous = staging;
+	staging = StagingSpan();
+	size_t size = getMipChainLayout(width, height, mipLevels, levelOffsets);
+	uint8_t* pixels = allocatePixels(size);
+	memcpy(pixels, data, size_t(width) * height * 4);
+	stagingPool->free(previous);
+	generateMipChain(pixels, width, height, levelOffsets, srgb);
+}
+
+void Texture::compress(const uint8_t* data) {
+	TRACE_ZONE("Compress texture");
+	bool opaque = true;
+	size_t size = size_t(width) * height * 4;
+	for (size_t i = 3; i < size && opaque; i += 4) {
+		opaque = data[i] == 255;
+	}
+	bool bc7 = compression == TextureCompression::BC7 || !opaque;
+	size_t blockSize = bc7 ? BC7_BLOCK_SIZE : BC1_BLOCK_SIZE;
+	// Each level is filtered from the one before and encoded straight into
+	// staging memory
+	levelOffsets.resize(mipLevels);
+	size_t total = 0;
+	for (uint32_t i = 0; i < mipLevels; i++) {
+		levelOffsets[i] = total;
+		total += getBlockCompressedSize(std::max(1u, width >> i),
+		                                std::max(1u, height >> i), blockSize);
+	}
+	uint8_t* blocks = allocatePixels(total);
+	const uint8_t* level = data;
+	std::vector<uint8_t> current, next;
+	uint32_t levelWidth = width;
+	uint32_t levelHeight = height;
+	for (uint32_t i = 0; i < mipLevels; i++) {
+		if (i > 0) {
+			next.resize(size_t(std::max(1u, levelWidth / 2)) *
+			            std::max(1u, levelHeight / 2) * 4);
+			downsampleRGBA8(level, levelWidth, levelHeight, true, next.data());
+			std::swap(current, next);
+			level = current.data();
+			levelWidth = std::max(1u, levelWidth / 2);
+			levelHeight = std::max(1u, levelHeight / 2);
+		}
+		uint8_t* out = blocks + levelOffsets[i];
+		if (bc7) {
+			encodeBC7(level, levelWidth, levelHeight, out);
+		} else {
+			encodeBC1(level, levelWidth, levelHeight, out);
+		}
+	}
+	format = bc7 ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+}
+
+void Texture::upload(Instance* instance) {
+	uploadTextures(instance, {this});
+}
+
+void Texture::destroy(Device* device) {
+	device->samplers.release(sampler);
+	destroyImage(device);
+}
+
+void Texture::destroyImage(Device* device) {
+	vkDestroyImageView(device->logical, view, nullptr);
+	vkDestroyImage(device->logical, image, nullptr);
+	vkFreeMemory(device->logical, memory, nullptr);
+}
+
+void Texture::allocateImage(Device* device) {
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(device->physical, format,
+	                                    &formatProperties);
+	if (!(formatProperties.optimalTilingFeatures &
+	      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+		throw std::runtime_error("failed to find supported texture format!");
+	}
+	// The streamer copies the levels an image keeps into its replacement
+	createImage(device, std::max(1u, width >> baseLevel),
+	            std::max(1u, height >> baseLevel), mipLevels - baseLevel,
+	            VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL,
+	            VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+	                VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+	                VK_IMAGE_USAGE_SAMPLED_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+}
+
+void Texture::createTextureImage(Instance* instance,
+                                 VkCommandBuffer commandBuffer) {
+	uint32_t levelCount = mipLevels - baseLevel;
+	std::vector<VkBufferImageCopy> regions(levelCount);
+	for (uint32_t i = 0; i < levelCount; i++) {
+		uint32_t level = baseLevel + i;
+		regions[i] = {};
+		regions[i].bufferOffset = staging.offset + levelOffsets[level];
+		regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].imageSubresource.mipLevel = i;
+		regions[i].imageSubresource.layerCount = 1;
+		regions[i].imageExtent = {std::max(1u, width >> level),
+		                          std::max(1u, height >> level), 1};
+	}
+	allocateImage(instance->device);
 	instance->commander->transitionImageLayout(
-	    instance->device, image, VK_FORMAT_R8G8B8A8_SRGB,
-	    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-	    mipLevels);
-	instance->commander->copyBufferToImage(
-	    instance->device, stagingBuffer, image, static_cast<uint32_t>(texWidth),
-	    static_cast<uint32_t>(texHeight));
-	//transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
-	instance->commander->generateMipmaps(instance->device, image,
-	                                     VK_FORMAT_R8G8B8A8_SRGB, texWidth,
-	                                     texHeight, mipLevels);
-	vkDestroyBuffer(instance->device->logical, stagingBuffer, nullptr);
-	vkFreeMemory(instance->device->logical, stagingBufferMemory, nullptr);
+	    commandBuffer, image, format, VK_IMAGE_LAYOUT_UNDEFINED,
+	    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount);
+	instance->commander->copyBufferToImage(commandBuffer, staging.buffer,
+	                                       image, regions);
+	instance->commander->transitionImageLayout(
+	    commandBuffer, image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, levelCount);
 }
 
 void Texture::createTextureImageView(Device* device) {
-	view = createImageView(device, image, VK_FORMAT_R8G8B8A8_SRGB,
-	                       VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+	view = createImageView(device, image, format, VK_IMAGE_ASPECT_COLOR_BIT,
+	                       mipLevels - baseLevel);
 }
 
 void Texture::createTextureSampler(Device* device) {
@@ -92,9 +243,34 @@ void Texture::createTextureSampler(Device* device) {
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = static_cast<float>(mipLevels);
-	if (vkCreateSampler(device->logical, &samplerInfo, nullptr, &sampler) !=
-	    VK_SUCCESS) {
-		throw std::runtime_error("failed to create texture sampler!");
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+	sampler = device->samplers.acquire(samplerInfo);
+}
+
+void uploadTextures(Instance* instance, const std::vector<Texture*>& textures) {
+	if (textures.empty()) {
+		return;
+	}
+	TRACE_ZONE("Upload textures");
+	VkCommandBuffer commandBuffer =
+	    instance->commander->beginSingleTimeCommands(instance->device);
+	recordTextureUploads(instance, commandBuffer, textures);
+	instance->commander->endSingleTimeCommands(instance->device,
+	                                           commandBuffer);
+	finishTextureUploads(textures);
+}
+
+void recordTextureUploads(Instance* instance, VkCommandBuffer commandBuffer,
+                          const std::vector<Texture*>& textures) {
+	for (Texture* texture : textures) {
+		texture->createTextureImage(instance, commandBuffer);
+		texture->createTextureImageView(instance->device);
+		texture->createTextureSampler(instance->device);
+	}
+}
+
+void finishTextureUploads(const std::vector<Texture*>& textures) {
+	for (Texture* texture : textures) {
+		texture->releaseStaging();
 	}
 }
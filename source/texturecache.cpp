@@ -0,0 +1,82 @@
+#include "texturecache.h"
+#include "include.h"
+#include "ktx2.h"
+#include "texture.h"
+#include "util.h"
+
+namespace {
+	const char* const STAMP_KEY = "TextureCacheSource";
+
+	struct TextureCacheStamp {
+		uint32_t version;
+		uint32_t compression;
+		SourceStamp source;
+	};
+} // namespace
+
+std::string getTextureCachePath(const std::string& sourcePath) {
+	return sourcePath + ".texcache.ktx2";
+}
+
+bool readTextureCache(const std::string& sourcePath, Texture& texture) {
+	std::string cachePath = getTextureCachePath(sourcePath);
+	size_t size;
+	int64_t mtime;
+	if (!statFile(cachePath, size, mtime)) {
+		return false;
+	}
+	Texture cached;
+	cached.stagingPool = texture.stagingPool;
+	Ktx2KeyValues keyValues;
+	try {
+		readKtx2(cachePath, cached, &keyValues);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+	for (const auto& keyValue : keyValues) {
+		TextureCacheStamp stamp;
+		if (keyValue.first != STAMP_KEY ||
+		    keyValue.second.size() != sizeof(stamp)) {
+			continue;
+		}
+		memcpy(&stamp, keyValue.second.data(), sizeof(stamp));
+		if (stamp.version != TEXTURE_CACHE_VERSION ||
+		    stamp.compression !=
+		        static_cast<uint32_t>(texture.compression) ||
+		    !sourceMatches(sourcePath, stamp.source)) {
+			break;
+		}
+		texture.releaseStaging();
+		texture.format = cached.format;
+		texture.width = cached.width;
+		texture.height = cached.height;
+		texture.mipLevels = cached.mipLevels;
+		texture.staging = cached.staging;
+		texture.levelOffsets = std::move(cached.levelOffsets);
+		texture.chainPath = cachePath;
+		return true;
+	}
+	cached.releaseStaging();
+	return false;
+}
+
+bool writeTextureCache(const std::string& sourcePath, const Texture& texture) {
+	TextureCacheStamp stamp = {};
+	stamp.version = TEXTURE_CACHE_VERSION;
+	stamp.compression = static_cast<uint32_t>(texture.compression);
+	if (!stampSource(sourcePath, stamp.source)) {
+		return false;
+	}
+	Ktx2KeyValues keyValues = {
+	    {STAMP_KEY,
+	     std::string(reinterpret_cast<const char*>(&stamp), sizeof(stamp))},
+	};
+	try {
+		writeKtx2(getTextureCachePath(sourcePath), texture, keyValues);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,250 @@
+#include "texturestream.h"
+#include "commander.h"
+#include "device.h"
+#include "include.h"
+#include "instance.h"
+#include "ktx2.h"
+#include "staging.h"
+#include "texture.h"
+#include "trace.h"
+#include "util.h"
+
+uint32_t estimateMipLevel(const Texture& texture, float screenRadius) {
+	uint32_t coarsest = texture.mipLevels - 1;
+	float pixels = 2.0f * screenRadius;
+	if (pixels < 1.0f) {
+		return coarsest;
+	}
+	float level = std::floor(
+	    std::log2(std::max(texture.width, texture.height) / pixels));
+	return std::min(coarsest, static_cast<uint32_t>(std::max(0.0f, level)));
+}
+
+void TextureStreamer::add(Texture* texture) {
+	Entry entry;
+	if (texture->chainPath.empty() ||
+	    !mapKtx2Levels(texture->chainPath, *texture, entry.file,
+	                   entry.levels)) {
+		return;
+	}
+	entry.texture = texture;
+	entry.tailLevel = 0;
+	while (entry.tailLevel + 1 < texture->mipLevels &&
+	       std::max(texture->width, texture->height) >> entry.tailLevel >
+	           TEXTURE_STREAMING_TAIL_SIZE) {
+		entry.tailLevel++;
+	}
+	entry.requested = entry.tailLevel;
+	entry.lastNeeded.assign(texture->mipLevels, 0);
+	texture->baseLevel = entry.tailLevel;
+	for (uint32_t i = entry.tailLevel; i < texture->mipLevels; i++) {
+		residentBytes += entry.levels[i].size;
+	}
+	entries.push_back(entry);
+}
+
+void TextureStreamer::request(Texture* texture, uint32_t level) {
+	for (Entry& entry : entries) {
+		if (entry.texture != texture) {
+			continue;
+		}
+		entry.requested = std::min(level, entry.tailLevel);
+		for (uint32_t i = entry.requested; i < entry.lastNeeded.size(); i++) {
+			entry.lastNeeded[i] = frame;
+		}
+	}
+}
+
+std::vector<Texture*> TextureStreamer::update(Instance* instance) {
+	if (!pending.empty()) {
+		// The frame they were made for was never recorded
+		return {};
+	}
+	Device* device = instance->device;
+	budget = limit;
+	if (device->capabilities.memoryBudget) {
+		// Half of what's left goes to streaming, so other allocations and
+		// other processes keep some room
+		budget = std::min(limit,
+		                  residentBytes + device->getAvailableMemory() / 2);
+	}
+	std::vector<uint32_t> levels(entries.size());
+	for (size_t i = 0; i < entries.size(); i++) {
+		levels[i] = entries[i].texture->baseLevel;
+	}
+	// The textures furthest from their request go first
+	std::vector<size_t> order;
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].requested < levels[i]) {
+			order.push_back(i);
+		}
+	}
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return levels[a] - entries[a].requested >
+		       levels[b] - entries[b].requested;
+	});
+	for (size_t i : order) {
+		uint32_t next = levels[i] - 1;
+		VkDeviceSize size = entries[i].levels[next].size;
+		while (residentBytes + size > budget && evict(levels, i)) {
+		}
+		if (residentBytes + size <= budget) {
+			levels[i] = next;
+			residentBytes += size;
+		}
+	}
+	while (residentBytes > budget && evict(levels, entries.size())) {
+	}
+	frame++;
+
+	// Both images of each texture exist until the frames using the old one
+	// are done, which the budget doesn't account for
+	std::vector<Texture*> changed;
+	for (size_t i = 0; i < entries.size(); i++) {
+		Entry& entry = entries[i];
+		Texture* texture = entry.texture;
+		if (levels[i] == texture->baseLevel) {
+			continue;
+		}
+		TRACE_ZONE("Replace texture image");
+		Replacement replacement;
+		replacement.texture = texture;
+		replacement.previous.image = texture->image;
+		replacement.previous.memory = texture->memory;
+		replacement.previous.view = texture->view;
+		replacement.previousLevel = texture->baseLevel;
+		// Levels finer than the old image's come from the file
+		uint32_t end = texture->baseLevel;
+		size_t size = 0;
+		for (uint32_t level = levels[i]; level < end; level++) {
+			size += entry.levels[level].size;
+		}
+		if (size > 0) {
+			replacement.staging = texture->stagingPool->allocate(
+			    size, TEXTURE_STAGING_ALIGNMENT);
+		}
+		size_t offset = 0;
+		for (uint32_t level = levels[i]; level < end; level++) {
+			const Ktx2LevelRange& range = entry.levels[level];
+			memcpy(replacement.staging.data + offset,
+			       entry.file.data + range.offset, range.size);
+			VkBufferImageCopy region = {};
+			region.bufferOffset = replacement.staging.offset + offset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = level - levels[i];
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = {std::max(1u, texture->width >> level),
+			                      std::max(1u, texture->height >> level), 1};
+			replacement.uploads.push_back(region);
+			offset += range.size;
+		}
+		texture->baseLevel = levels[i];
+		texture->allocateImage(device);
+		texture->createTextureImageView(device);
+		pending.push_back(std::move(replacement));
+		changed.push_back(texture);
+	}
+	return changed;
+}
+
+void TextureStreamer::record(Instance* instance,
+                             VkCommandBuffer commandBuffer) {
+	Commander* commander = instance->commander;
+	for (Replacement& replacement : pending) {
+		Texture* texture = replacement.texture;
+		Texture& previous = replacement.previous;
+		uint32_t base = texture->baseLevel;
+		commander->transitionImageLayout(
+		    commandBuffer, texture->image, texture->format,
+		    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		    texture->mipLevels - base);
+		if (!replacement.uploads.empty()) {
+			commander->copyBufferToImage(commandBuffer,
+			                             replacement.staging.buffer,
+			                             texture->image, replacement.uploads);
+		}
+		// The barrier also waits for earlier frames sampling the old image
+		uint32_t kept = std::max(base, replacement.previousLevel);
+		commander->transitionImageLayout(
+		    commandBuffer, previous.image, texture->format,
+		    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		    texture->mipLevels - replacement.previousLevel);
+		std::vector<VkImageCopy> copies;
+		for (uint32_t level = kept; level < texture->mipLevels; level++) {
+			VkImageCopy copy = {};
+			copy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			copy.srcSubresource.mipLevel = level - replacement.previousLevel;
+			copy.srcSubresource.layerCount = 1;
+			copy.dstSubresource = copy.srcSubresource;
+			copy.dstSubresource.mipLevel = level - base;
+			copy.extent = {std::max(1u, texture->width >> level),
+			               std::max(1u, texture->height >> level), 1};
+			copies.push_back(copy);
+		}
+		vkCmdCopyImage(commandBuffer, previous.image,
+		               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture->image,
+		               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		               static_cast<uint32_t>(copies.size()), copies.data());
+		commander->transitionImageLayout(
+		    commandBuffer, texture->image, texture->format,
+		    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		    texture->mipLevels - base);
+		replacement.fence = instance->currentFrame;
+		retired.push_back(std::move(replacement));
+	}
+	pending.clear();
+}
+
+void TextureStreamer::collect(Device* device, uint32_t fence) {
+	size_t kept = 0;
+	for (Replacement& replacement : retired) {
+		if (replacement.fence == fence) {
+			replacement.previous.destroyImage(device);
+			replacement.texture->stagingPool->free(replacement.staging);
+		} else {
+			retired[kept++] = std::move(replacement);
+		}
+	}
+	retired.resize(kept);
+}
+
+void TextureStreamer::destroy(Device* device) {
+	for (Replacement& replacement : pending) {
+		replacement.previous.destroyImage(device);
+		replacement.texture->stagingPool->free(replacement.staging);
+	}
+	pending.clear();
+	for (Replacement& replacement : retired) {
+		replacement.previous.destroyImage(device);
+		replacement.texture->stagingPool->free(replacement.staging);
+	}
+	retired.clear();
+	for (Entry& entry : entries) {
+		entry.file.unmap();
+	}
+	entries.clear();
+}
+
+bool TextureStreamer::evict(std::vector<uint32_t>& levels, size_t keep) {
+	size_t victim = entries.size();
+	uint64_t oldest = frame;
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry& entry = entries[i];
+		if (i == keep || levels[i] >= entry.tailLevel) {
+			continue;
+		}
+		uint64_t lastNeeded = entry.lastNeeded[levels[i]];
+		if (lastNeeded < oldest) {
+			victim = i;
+			oldest = lastNeeded;
+		}
+	}
+	if (victim == entries.size()) {
+		return false;
+	}
+	residentBytes -= entries[victim].levels[levels[victim]].size;
+	levels[victim]++;
+	return true;
+}
@@ -0,0 +1,137 @@
+#include "threadpool.h"
+#include "include.h"
+#include "trace.h"
+
+#include <atomic>
+#include <memory>
+
+namespace {
+	thread_local ThreadPool* currentPool = nullptr;
+
+	// Shared with the helper jobs, which can start after parallelFor has
+	// returned; by then every range is claimed and body is never touched
+	struct ParallelRanges {
+		const std::function<void(size_t, size_t)>* body;
+		size_t count;
+		size_t step;
+		size_t rangeCount;
+		std::atomic<size_t> next{0};
+		std::atomic<size_t> finished{0};
+		std::mutex mutex;
+		std::condition_variable done;
+		std::exception_ptr error;
+
+		// Claims and runs ranges until none are left
+		void run() {
+			for (size_t i = next++; i < rangeCount; i = next++) {
+				size_t begin = i * step;
+				try {
+					(*body)(begin, std::min(count, begin + step));
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!error) {
+						error = std::current_exception();
+					}
+				}
+				if (++finished == rangeCount) {
+					std::lock_guard<std::mutex> lock(mutex);
+					done.notify_all();
+				}
+			}
+		}
+	};
+} // namespace
+
+void ThreadPool::create(uint32_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	stopping = false;
+	for (uint32_t i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::work, this);
+	}
+}
+
+void ThreadPool::destroy() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		jobs.clear();
+	}
+	available.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> job) {
+	std::packaged_task<void()> task(std::move(job));
+	std::future<void> future = task.get_future();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(task));
+	}
+	available.notify_one();
+	return future;
+}
+
+uint32_t ThreadPool::getThreadCount() const {
+	return static_cast<uint32_t>(workers.size());
+}
+
+void ThreadPool::work() {
+	setTraceThreadName("Worker");
+	currentPool = this;
+	while (true) {
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			available.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping) {
+				return;
+			}
+			task = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		// Exceptions are stored in the future and rethrown by get()
+		task();
+	}
+}
+
+size_t getParallelism() {
+	return currentPool ? currentPool->getThreadCount() : 1;
+}
+
+void parallelFor(size_t count, size_t rangeCount,
+                 const std::function<void(size_t, size_t)>& body) {
+	if (count == 0) {
+		return;
+	}
+	if (rangeCount <= 1 || !currentPool) {
+		size_t step = (count + std::max<size_t>(1, rangeCount) - 1) /
+		              std::max<size_t>(1, rangeCount);
+		for (size_t begin = 0; begin < count; begin += step) {
+			body(begin, std::min(count, begin + step));
+		}
+		return;
+	}
+	auto ranges = std::make_shared<ParallelRanges>();
+	ranges->body = &body;
+	ranges->count = count;
+	ranges->step = (count + rangeCount - 1) / rangeCount;
+	ranges->rangeCount = (count + ranges->step - 1) / ranges->step;
+	size_t helpers = std::min<size_t>(ranges->rangeCount,
+	                                  currentPool->getThreadCount()) -
+	                 1;
+	for (size_t i = 0; i < helpers; i++) {
+		currentPool->submit([ranges]() { ranges->run(); });
+	}
+	ranges->run();
+	std::unique_lock<std::mutex> lock(ranges->mutex);
+	ranges->done.wait(
+	    lock, [&] { return ranges->finished == ranges->rangeCount; });
+	if (ranges->error) {
+		std::rethrow_exception(ranges->error);
+	}
+}
@@ -0,0 +1,147 @@
+#include "trace.h"
+#include "include.h"
+
+#include <iomanip>
+#include <memory>
+
+namespace {
+	constexpr size_t TRACE_CHUNK_EVENTS = 4096;
+
+	struct TraceEvent {
+		const char* name;
+		uint64_t start;
+		uint64_t duration;
+	};
+
+	typedef std::array<TraceEvent, TRACE_CHUNK_EVENTS> TraceChunk;
+
+	// Written only by its thread, and read once every thread is done, so
+	// recording takes no locks. Never freed: threads may exit before the
+	// trace is written.
+	struct ThreadBuffer {
+		uint32_t id;
+		const char* name = nullptr;
+		std::vector<std::unique_ptr<TraceChunk>> chunks;
+		size_t count = 0;
+		size_t dropped = 0;
+		ThreadBuffer* next = nullptr;
+	};
+
+	std::atomic<bool> tracing{false};
+	std::string tracePath;
+	std::chrono::steady_clock::time_point traceStart;
+	// Pushed onto lock-free the first time a thread records
+	std::atomic<ThreadBuffer*> threadBuffers{nullptr};
+	std::atomic<uint32_t> nextThreadId{1};
+	thread_local ThreadBuffer* threadBuffer = nullptr;
+
+	ThreadBuffer* getThreadBuffer() {
+		if (!threadBuffer) {
+			threadBuffer = new ThreadBuffer();
+			threadBuffer->id = nextThreadId++;
+			ThreadBuffer* head = threadBuffers.load();
+			do {
+				threadBuffer->next = head;
+			} while (!threadBuffers.compare_exchange_weak(head, threadBuffer));
+		}
+		return threadBuffer;
+	}
+
+	uint64_t getTraceTime() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		           std::chrono::steady_clock::now() - traceStart)
+		    .count();
+	}
+
+	void writeString(std::ofstream& file, const char* text) {
+		file << '"';
+		for (const char* c = text; *c; c++) {
+			if (*c == '"' || *c == '\\') {
+				file << '\\';
+			}
+			file << *c;
+		}
+		file << '"';
+	}
+} // namespace
+
+TraceZone::TraceZone(const char* zoneName) {
+	name = tracing.load(std::memory_order_relaxed) ? zoneName : nullptr;
+	if (name) {
+		start = getTraceTime();
+	}
+}
+
+TraceZone::~TraceZone() {
+	if (!name) {
+		return;
+	}
+	uint64_t end = getTraceTime();
+	ThreadBuffer* buffer = getThreadBuffer();
+	if (buffer->count == TRACE_MAX_EVENTS_PER_THREAD) {
+		buffer->dropped++;
+		return;
+	}
+	size_t chunk = buffer->count / TRACE_CHUNK_EVENTS;
+	if (chunk == buffer->chunks.size()) {
+		buffer->chunks.push_back(std::make_unique<TraceChunk>());
+	}
+	(*buffer->chunks[chunk])[buffer->count % TRACE_CHUNK_EVENTS] = {
+	    name, start, end - start};
+	buffer->count++;
+}
+
+void startTrace(const std::string& path) {
+	tracePath = path;
+	traceStart = std::chrono::steady_clock::now();
+	tracing.store(true, std::memory_order_release);
+	setTraceThreadName("Main");
+}
+
+void setTraceThreadName(const char* name) { getThreadBuffer()->name = name; }
+
+void writeTrace() {
+	if (!tracing.exchange(false)) {
+		return;
+	}
+	std::ofstream file(tracePath);
+	if (!file) {
+		std::cerr << "failed to write trace " << tracePath << "!" << std::endl;
+		return;
+	}
+	// Microseconds, as the format wants them
+	file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+	bool first = true;
+	size_t zones = 0;
+	size_t dropped = 0;
+	for (ThreadBuffer* buffer = threadBuffers.load(); buffer;
+	     buffer = buffer->next) {
+		if (buffer->name) {
+			file << (first ? "" : ",") << "\n{\"name\":\"thread_name\","
+			     << "\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+			     << ",\"args\":{\"name\":";
+			writeString(file, buffer->name);
+			file << "}}";
+			first = false;
+		}
+		for (size_t i = 0; i < buffer->count; i++) {
+			const TraceEvent& event =
+			    (*buffer->chunks[i / TRACE_CHUNK_EVENTS])[i %
+			                                              TRACE_CHUNK_EVENTS];
+			file << (first ? "" : ",") << "\n{\"name\":";
+			writeString(file, event.name);
+			file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+			     << ",\"ts\":" << event.start * 1e-3
+			     << ",\"dur\":" << event.duration * 1e-3 << "}";
+			first = false;
+		}
+		zones += buffer->count;
+		dropped += buffer->dropped;
+	}
+	file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	std::cout << "Trace of " << zones << " zones written to " << tracePath;
+	if (dropped > 0) {
+		std::cout << ", " << dropped << " dropped";
+	}
+	std::cout << std::endl;
+}
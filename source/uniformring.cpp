@@ -0,0 +1,50 @@
+#include "uniformring.h"
+#include "device.h"
+#include "include.h"
+#include "instance.h"
+#include "sync.h"
+#include "util.h"
+
+void UniformRing::create(Instance* instance) {
+	Device* device = instance->device;
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device->physical, &properties);
+	alignment = std::max<VkDeviceSize>(
+	    1, properties.limits.minUniformBufferOffsetAlignment);
+	frameSize = (UNIFORM_RING_FRAME_SIZE + alignment - 1) / alignment *
+	            alignment;
+	VkDeviceSize size = frameSize * MAX_FRAMES_IN_FLIGHT;
+	createBuffer(device, size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+	             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	             buffer, memory);
+	void* data;
+	if (vkMapMemory(device->logical, memory, 0, size, 0, &data) !=
+	    VK_SUCCESS) {
+		throw std::runtime_error("failed to map uniform ring memory!");
+	}
+	mapped = static_cast<uint8_t*>(data);
+	frameStart = 0;
+	offset = 0;
+}
+
+void UniformRing::beginFrame(uint32_t frame) {
+	frameStart = frame * frameSize;
+	offset = 0;
+}
+
+uint32_t UniformRing::push(const void* data, VkDeviceSize size) {
+	if (offset + size > frameSize) {
+		throw std::runtime_error("uniform ring is out of space!");
+	}
+	VkDeviceSize position = frameStart + offset;
+	memcpy(mapped + position, data, static_cast<size_t>(size));
+	offset = (offset + size + alignment - 1) / alignment * alignment;
+	return static_cast<uint32_t>(position);
+}
+
+void UniformRing::destroy(Device* device) {
+	vkUnmapMemory(device->logical, memory);
+	vkDestroyBuffer(device->logical, buffer, nullptr);
+	vkFreeMemory(device->logical, memory, nullptr);
+}
@@ -10,6 +10,11 @@
 #include "sync.h"
 #include "texture.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 void createImage(Device* device, uint32_t width, uint32_t height,
                  uint32_t mipLevels, VkSampleCountFlagBits numSamples,
                  VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
@@ -219,73 +224,18 @@ std::vector<const char*> getRequiredExtensions(bool validationLayersEnabled) {
 	return extensions;
 }
 
-bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
+bool checkInstanceExtensionSupport(const char* name) {
 	uint32_t extensionCount;
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
-	                                     nullptr);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
-	                                     availableExtensions.data());
-	std::set<std::string> requiredExtensions(deviceExtensions.begin(),
-	                                         deviceExtensions.end());
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount,
+	                                       availableExtensions.data());
 	for (const auto& extension : availableExtensions) {
-		requiredExtensions.erase(extension.extensionName);
-	}
-	return requiredExtensions.empty();
-}
-
-QueueFamilyIndices findQueueFamilies(Instance* instance,
-                                     VkPhysicalDevice device) {
-	QueueFamilyIndices indices;
-	uint32_t queueFamilyCount = 0;
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
-	                                         nullptr);
-	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
-	                                         queueFamilies.data());
-	int i = 0;
-	for (const auto& queueFamily : queueFamilies) {
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-			indices.graphicsFamily = i;
-		}
-		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(
-		    device, i, instance->surface->surface, &presentSupport);
-		if (presentSupport) {
-			indices.presentFamily = i;
-		}
-		if (indices.isComplete()) {
-			break;
+		if (strcmp(name, extension.extensionName) == 0) {
+			return true;
 		}
-		i++;
 	}
-	return indices;
-}
-
-SwapChainSupportDetails querySwapChainSupport(Instance* instance,
-                                              VkPhysicalDevice device) {
-	SwapChainSupportDetails details;
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
-	    device, instance->surface->surface, &details.capabilities);
-	uint32_t formatCount;
-	vkGetPhysicalDeviceSurfaceFormatsKHR(device, instance->surface->surface,
-	                                     &formatCount, nullptr);
-	if (formatCount != 0) {
-		details.formats.resize(formatCount);
-		vkGetPhysicalDeviceSurfaceFormatsKHR(device, instance->surface->surface,
-		                                     &formatCount,
-		                                     details.formats.data());
-	}
-	uint32_t presentModeCount;
-	vkGetPhysicalDeviceSurfacePresentModesKHR(
-	    device, instance->surface->surface, &presentModeCount, nullptr);
-	if (presentModeCount != 0) {
-		details.presentModes.resize(presentModeCount);
-		vkGetPhysicalDeviceSurfacePresentModesKHR(
-		    device, instance->surface->surface, &presentModeCount,
-		    details.presentModes.data());
-	}
-	return details;
+	return false;
 }
 
 std::vector<char> readFile(const std::string& filename) {
@@ -301,6 +251,122 @@ std::vector<char> readFile(const std::string& filename) {
 	return buffer;
 }
 
+bool statFile(const std::string& path, size_t& size, int64_t& mtime) {
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+	size = static_cast<size_t>(info.st_size);
+	mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+	        info.st_mtim.tv_nsec;
+	return true;
+}
+
+void MappedFile::map(const std::string& path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("failed to open " + path + "!");
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("failed to stat " + path + "!");
+	}
+	size = static_cast<size_t>(info.st_size);
+	mtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+	        info.st_mtim.tv_nsec;
+	data = nullptr;
+	if (size > 0) {
+		void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("failed to map " + path + "!");
+		}
+		madvise(mapped, size, MADV_SEQUENTIAL);
+		data = static_cast<const uint8_t*>(mapped);
+	}
+	close(fd);
+}
+
+void MappedFile::unmap() {
+	if (data) {
+		munmap(const_cast<uint8_t*>(data), size);
+	}
+	data = nullptr;
+	size = 0;
+}
+
+namespace {
+	uint64_t mix64(uint64_t x) {
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdull;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ull;
+		x ^= x >> 33;
+		return x;
+	}
+
+	uint64_t hashFile(const std::string& path) {
+		MappedFile file;
+		file.map(path);
+		uint64_t hash = hashBytes(file.data, file.size, 0);
+		file.unmap();
+		return hash;
+	}
+} // namespace
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	// Four independent lanes keep the multiplies from serialising
+	uint64_t lanes[4] = {seed, seed + 0x9e3779b97f4a7c15ull,
+	                     seed + 0x3c6ef372fe94f82aull,
+	                     seed + 0xdaa66d2c7ddf743full};
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (int lane = 0; lane < 4; lane++) {
+			uint64_t k;
+			memcpy(&k, p + i + lane * 8, sizeof(k));
+			lanes[lane] = mix64(lanes[lane] ^ k) * 0x9e3779b97f4a7c15ull;
+		}
+	}
+	uint64_t h = mix64(size ^ lanes[0]) ^ mix64(lanes[1]) * 3 ^
+	             mix64(lanes[2]) * 5 ^ mix64(lanes[3]) * 7;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t k;
+		memcpy(&k, p + i, sizeof(k));
+		h = mix64(h ^ k);
+	}
+	if (i < size) {
+		uint64_t k = 0;
+		memcpy(&k, p + i, size - i);
+		h = mix64(h ^ k ^ (static_cast<uint64_t>(size - i) << 56));
+	}
+	return mix64(h);
+}
+
+bool stampSource(const std::string& path, SourceStamp& stamp) {
+	size_t size;
+	if (!statFile(path, size, stamp.mtime)) {
+		return false;
+	}
+	stamp.size = size;
+	stamp.hash = hashFile(path);
+	return true;
+}
+
+bool sourceMatches(const std::string& path, const SourceStamp& stamp) {
+	size_t size;
+	int64_t mtime;
+	if (!statFile(path, size, mtime)) {
+		return true;
+	}
+	if (size != stamp.size) {
+		return false;
+	}
+	// A touched but unchanged source keeps its cache
+	return mtime == stamp.mtime || hashFile(path) == stamp.hash;
+}
+
 VkShaderModule createShaderModule(Device* device,
                                   const std::vector<char>& code) {
 	VkShaderModuleCreateInfo createInfo = {};
@@ -0,0 +1,178 @@
+#include "vertexlayout.h"
+#include "include.h"
+#include "util.h"
+
+namespace {
+	uint16_t floatToHalf(float value) {
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		uint32_t sign = (bits >> 16) & 0x8000;
+		int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+		uint32_t mantissa = bits & 0x7fffff;
+		if (exponent <= 0) {
+			if (exponent < -10) {
+				return static_cast<uint16_t>(sign);
+			}
+			// Denormal, round to nearest
+			mantissa |= 0x800000;
+			uint32_t shift = static_cast<uint32_t>(14 - exponent);
+			uint32_t half = mantissa >> shift;
+			if ((mantissa >> (shift - 1)) & 1) {
+				half++;
+			}
+			return static_cast<uint16_t>(sign | half);
+		}
+		if (exponent >= 31) {
+			return static_cast<uint16_t>(sign | 0x7c00);
+		}
+		uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) |
+		                (mantissa >> 13);
+		// Round to nearest even, a carry into the exponent is still correct
+		uint32_t rest = mantissa & 0x1fff;
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+			half++;
+		}
+		return static_cast<uint16_t>(half);
+	}
+
+	int16_t toSnorm16(float value) {
+		value = std::max(-1.0f, std::min(1.0f, value));
+		return static_cast<int16_t>(std::round(value * 32767.0f));
+	}
+
+	uint16_t toUnorm16(float value) {
+		value = std::max(0.0f, std::min(1.0f, value));
+		return static_cast<uint16_t>(std::round(value * 65535.0f));
+	}
+
+	glm::vec2 octahedralEncode(glm::vec3 n) {
+		float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (sum == 0.0f) {
+			return glm::vec2(0.0f);
+		}
+		n = n / sum;
+		if (n.z >= 0.0f) {
+			return glm::vec2(n.x, n.y);
+		}
+		return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+		                 (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+	}
+
+	uint32_t getPositionSize(PositionFormat format) {
+		// Three component 16-bit formats are rarely fetchable, so pad to four
+		return format == PositionFormat::Unorm16 ? 8 : 12;
+	}
+
+	uint32_t getTexCoordSize(TexCoordFormat format) {
+		return format == TexCoordFormat::Float16 ? 4 : 8;
+	}
+
+	template<typename T> void write(uint8_t*& out, T value) {
+		memcpy(out, &value, sizeof(T));
+		out += sizeof(T);
+	}
+} // namespace
+
+uint32_t VertexLayout::getStride() const {
+	return getPositionSize(position) + (normals ? 4 : 0) +
+	       getTexCoordSize(texCoord) + (colour ? 4 : 0);
+}
+
+VkVertexInputBindingDescription VertexLayout::getBindingDescription() const {
+	VkVertexInputBindingDescription bindingDescription = {};
+	bindingDescription.binding = 0;
+	bindingDescription.stride = getStride();
+	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return bindingDescription;
+}
+
+std::vector<VkVertexInputAttributeDescription>
+VertexLayout::getAttributeDescriptions() const {
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+	VkVertexInputAttributeDescription attribute = {};
+	attribute.binding = 0;
+	attribute.location = 0;
+	attribute.format = position == PositionFormat::Unorm16
+	                       ? VK_FORMAT_R16G16B16A16_UNORM
+	                       : VK_FORMAT_R32G32B32_SFLOAT;
+	attribute.offset = 0;
+	attributeDescriptions.push_back(attribute);
+	uint32_t offset = getPositionSize(position);
+	if (normals) {
+		attribute.location = 3;
+		attribute.format = VK_FORMAT_R16G16_SNORM;
+		attribute.offset = offset;
+		attributeDescriptions.push_back(attribute);
+		offset += 4;
+	}
+	attribute.location = 2;
+	attribute.format = texCoord == TexCoordFormat::Float16
+	                       ? VK_FORMAT_R16G16_SFLOAT
+	                       : VK_FORMAT_R32G32_SFLOAT;
+	attribute.offset = offset;
+	attributeDescriptions.push_back(attribute);
+	offset += getTexCoordSize(texCoord);
+	if (colour) {
+		attribute.location = 1;
+		attribute.format = VK_FORMAT_R8G8B8A8_UNORM;
+		attribute.offset = offset;
+		attributeDescriptions.push_back(attribute);
+	}
+	return attributeDescriptions;
+}
+
+std::string VertexLayout::getShaderPath() const {
+	std::string path = "shaders/shader";
+	if (colour) {
+		path += "_colour";
+	}
+	if (normals) {
+		path += "_normal";
+	}
+	return path + ".vert.spv";
+}
+
+glm::mat4 VertexLayout::getPositionDecode(glm::vec3 minPos,
+                                          glm::vec3 maxPos) const {
+	if (position != PositionFormat::Unorm16) {
+		return glm::mat4(1.0f);
+	}
+	glm::vec3 extent = glm::max(maxPos - minPos, glm::vec3(1e-8f));
+	return glm::scale(glm::translate(glm::mat4(1.0f), minPos), extent);
+}
+
+void VertexLayout::pack(const std::vector<Vertex>& vertices, glm::vec3 minPos,
+                        glm::vec3 maxPos, uint8_t* data) const {
+	glm::vec3 extent = glm::max(maxPos - minPos, glm::vec3(1e-8f));
+	uint8_t* out = data;
+	for (const auto& vertex : vertices) {
+		if (position == PositionFormat::Unorm16) {
+			glm::vec3 p = (vertex.pos - minPos) / extent;
+			write(out, toUnorm16(p.x));
+			write(out, toUnorm16(p.y));
+			write(out, toUnorm16(p.z));
+			write(out, static_cast<uint16_t>(65535));
+		} else {
+			write(out, vertex.pos);
+		}
+		if (normals) {
+			glm::vec2 e = octahedralEncode(vertex.normal);
+			write(out, toSnorm16(e.x));
+			write(out, toSnorm16(e.y));
+		}
+		if (texCoord == TexCoordFormat::Float16) {
+			write(out, floatToHalf(vertex.texCoord.x));
+			write(out, floatToHalf(vertex.texCoord.y));
+		} else {
+			write(out, vertex.texCoord);
+		}
+		if (colour) {
+			for (int i = 0; i < 3; i++) {
+				write(out, static_cast<uint8_t>(std::round(
+				               std::max(0.0f, std::min(1.0f, vertex.colour[i])) *
+				               255.0f)));
+			}
+			write(out, static_cast<uint8_t>(255));
+		}
+	}
+}